@@ -12,6 +12,7 @@
 #include "io_gpio.h"
 #include "time.h"
 #include "ota.h"
+#include "socket.h"
 
 #include <user_interface.h>
 #include <c_types.h>
@@ -27,18 +28,208 @@ typedef struct
 	const char		*description;
 } application_function_table_t;
 
+typedef struct
+{
+	unsigned int	count;
+	unsigned int	total_us;
+	unsigned int	max_us;
+	unsigned int	last_us;
+} application_function_stats_t;
+
 static const application_function_table_t application_function_table[];
+static application_function_stats_t application_function_stats[];
+
+static app_action_t application_function_config_set(const string_t *src, string_t *dst);
+static app_action_t application_function_identification(const string_t *src, string_t *dst);
+static app_action_t application_function_wlan_ap_configure(const string_t *src, string_t *dst);
+static app_action_t application_function_wlan_client_configure(const string_t *src, string_t *dst);
+
+/*
+ * Both aliases of every command, sorted, encoded as (entry << 1) | alias,
+ * so a command can be looked up using a binary search. It's built once,
+ * on first use. Equal aliases are sorted by table position, so the
+ * first matching entry in the table wins, as with a linear search.
+ */
+
+static uint8_t application_alias_index[];
+static int application_aliases = -1;
+
+static unsigned int application_cursor_current;
+
+irom unsigned int application_cursor(void)
+{
+	return(application_cursor_current);
+}
+
+irom void application_cursor_set(unsigned int cursor)
+{
+	application_cursor_current = cursor;
+}
+
+irom static const char *application_alias(unsigned int alias)
+{
+	const application_function_table_t *entry = &application_function_table[alias >> 1];
+
+	return((alias & 0x01) ? entry->command2 : entry->command1);
+}
+
+irom attr_pure static int application_alias_compare(const char *alias, const char *key, int key_length)
+{
+	int alias_length, rv;
+
+	alias_length = strlen(alias);
+
+	if((rv = memcmp(alias, key, (alias_length < key_length) ? alias_length : key_length)) != 0)
+		return(rv);
 
-irom app_action_t application_content(const string_t *src, string_t *dst)
+	return(alias_length - key_length);
+}
+
+irom static void application_alias_index_build(void)
 {
-	string_init(varname_io, "trigger.status.io");
-	string_init(varname_pin, "trigger.status.pin");
+	const char *alias;
+	int entry, current, ix, rv;
 
+	application_aliases = 0;
+
+	for(entry = 0; application_function_table[entry].function; entry++)
+	{
+		for(current = entry << 1; current <= ((entry << 1) | 0x01); current++)
+		{
+			alias = application_alias(current);
+
+			for(ix = application_aliases; ix > 0; ix--)
+			{
+				rv = application_alias_compare(application_alias(application_alias_index[ix - 1]), alias, strlen(alias));
+
+				if((rv < 0) || ((rv == 0) && (application_alias_index[ix - 1] < current)))
+					break;
+
+				application_alias_index[ix] = application_alias_index[ix - 1];
+			}
+
+			application_alias_index[ix] = current;
+			application_aliases++;
+		}
+	}
+}
+
+irom static const application_function_table_t *application_lookup(const string_t *command)
+{
+	int low, high, mid;
+
+	if(application_aliases < 0)
+		application_alias_index_build();
+
+	low = 0;
+	high = application_aliases;
+
+	while(low < high)
+	{
+		mid = (low + high) / 2;
+
+		if(application_alias_compare(application_alias(application_alias_index[mid]), string_buffer(command), string_length(command)) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if((low < application_aliases) &&
+			(application_alias_compare(application_alias(application_alias_index[low]), string_buffer(command), string_length(command)) == 0))
+		return(&application_function_table[application_alias_index[low] >> 1]);
+
+	return((const application_function_table_t *)0);
+}
+
+/*
+ * A packet can hold several commands, separated by newlines or ';'. Return
+ * the offset of the command following the one at "offset" and set "length"
+ * to the length of this one, including a trailing newline, excluding ';'.
+ * The http and ota-send commands carry free form data, they always take the
+ * rest of the packet. Commands that end in free text (config values, the
+ * identification, wlan passphrases, display text) take the rest of their
+ * line, a ';' in the text is part of it.
+ */
+
+irom int application_command_next(const string_t *src, int offset, int *length)
+{
 	const application_function_table_t *tableptr;
+	string_t command;
+	bool_t free_text;
+	int end;
+	char current;
+
+	for(end = offset; end < string_length(src); end++)
+	{
+		current = string_at(src, end);
+
+		if((current == ' ') || (current == '\r') || (current == '\n') || (current == ';'))
+			break;
+	}
+
+	string_set(&command, src->buffer + offset, end - offset, end - offset);
+
+	free_text = false;
+
+	if((tableptr = application_lookup(&command)))
+	{
+		if((tableptr->function == application_function_http_get) || (tableptr->function == application_function_ota_send))
+		{
+			*length = string_length(src) - offset;
+			return(string_length(src));
+		}
+
+		free_text = (tableptr->function == application_function_config_set) ||
+				(tableptr->function == application_function_identification) ||
+				(tableptr->function == application_function_wlan_ap_configure) ||
+				(tableptr->function == application_function_wlan_client_configure) ||
+				(tableptr->function == application_function_display_set) ||
+				(tableptr->function == application_function_display_default_message);
+	}
+
+	for(; end < string_length(src); end++)
+	{
+		current = string_at(src, end);
+
+		if(current == '\n')
+		{
+			*length = end + 1 - offset;
+			return(end + 1);
+		}
+
+		if((current == ';') && !free_text)
+		{
+			*length = end - offset;
+			return(end + 1);
+		}
+	}
+
+	*length = end - offset;
+	return(end);
+}
+
+irom app_action_t application_content(const string_t *src, string_t *dst, unsigned int *cursor)
+{
+	static config_handle_t handle_io, handle_pin;
+	const application_function_table_t *tableptr;
+	application_function_stats_t *stats;
 	int status_io, status_pin;
+	uint32_t start, spent;
+	app_action_t action;
+	parse_args_t args;
 
-	if(config_get_int(&varname_io, -1, -1, &status_io) &&
-			config_get_int(&varname_pin, -1, -1, &status_pin) &&
+	if(!config_handle_bound(&handle_io))
+	{
+		string_init(varname_io, "trigger.status.io");
+		string_init(varname_pin, "trigger.status.pin");
+
+		config_bind(&handle_io, &varname_io, -1, -1);
+		config_bind(&handle_pin, &varname_pin, -1, -1);
+	}
+
+	if((*cursor == 0) &&
+			config_handle_get_int(&handle_io, &status_io) &&
+			config_handle_get_int(&handle_pin, &status_pin) &&
 			(status_io != -1) && (status_pin != -1))
 	{
 		io_trigger_pin((string_t *)0, status_io, status_pin, io_trigger_on);
@@ -47,15 +238,30 @@ irom app_action_t application_content(const string_t *src, string_t *dst)
 	if(parse_string(0, src, dst, ' ') != parse_ok)
 		return(app_action_empty);
 
-	for(tableptr = application_function_table; tableptr->function; tableptr++)
-		if(string_match_cstr(dst, tableptr->command1) ||
-				string_match_cstr(dst, tableptr->command2))
-			break;
-
-	if(tableptr->function)
+	if((tableptr = application_lookup(dst)))
 	{
 		string_clear(dst);
-		return(tableptr->function(src, dst));
+
+		start = system_get_time();
+		parse_args_bind(&args, src, ' ');
+		application_cursor_current = *cursor;
+		action = tableptr->function(src, dst);
+		*cursor = (action == app_action_more) ? application_cursor_current : 0;
+		parse_args_unbind(&args);
+		spent = system_get_time() - start;
+
+		stats = &application_function_stats[tableptr - application_function_table];
+
+		if(action != app_action_more)
+			stats->count++;
+
+		stats->total_us += spent;
+		stats->last_us = spent;
+
+		if(spent > stats->max_us)
+			stats->max_us = spent;
+
+		return(action);
 	}
 
 	string_append(dst, ": command unknown\n");
@@ -64,7 +270,14 @@ irom app_action_t application_content(const string_t *src, string_t *dst)
 
 irom static app_action_t application_function_config_dump(const string_t *src, string_t *dst)
 {
-	config_dump(dst);
+	unsigned int cursor = application_cursor();
+
+	if(!config_dump(dst, &cursor))
+	{
+		application_cursor_set(cursor);
+		return(app_action_more);
+	}
+
 	return(app_action_normal);
 }
 
@@ -78,7 +291,7 @@ irom static app_action_t application_function_config_write(const string_t *src,
 		return(app_action_error);
 	}
 
-	string_format(dst, "> config write done, space used: %u, free: %u\n", size, SPI_FLASH_SEC_SIZE - size);
+	string_format(dst, "> config write done, space used: %u, free: %u\n", size, config_size() - size);
 	return(app_action_normal);
 }
 
@@ -167,7 +380,7 @@ irom static app_action_t application_function_config_set(const string_t *src, st
 		return(app_action_error);
 	}
 
-	if((offset = string_sep(src, 0, 4, ' ')) < 0)
+	if((offset = parse_offset(4, src, ' ')) < 0)
 	{
 		string_append(dst, "missing variable value\n");
 		return(app_action_error);
@@ -226,23 +439,15 @@ irom static app_action_t application_function_help(const string_t *src, string_t
 
 irom static app_action_t application_function_identification(const string_t *src, string_t *dst)
 {
-	int start, length;
-	char last;
+	int start;
+	string_t trimmed = *src;
 	string_init(varname_identification, "identification");
 
-	if((start = string_sep(src, 0, 1, ' ')) > 0)
-	{
-		length = string_length(src) - 1;
-
-		if(length > 0)
-		{
-			last = string_at(src, length - 1);
+	string_trim_nl(&trimmed);
 
-			if((last == '\n') || (last == '\r'))
-				length--;
-		}
-
-		if(!config_set_string(&varname_identification, -1, -1, src, start, length - start))
+	if((start = parse_offset(1, src, ' ')) > 0)
+	{
+		if(!config_set_string(&varname_identification, -1, -1, src, start, string_length(&trimmed) - start))
 		{
 			string_append(dst, "> cannot set identification\n");
 			return(app_action_error);
@@ -299,6 +504,36 @@ irom static app_action_t application_function_stats_i2c(const string_t *src, str
 	return(app_action_normal);
 }
 
+irom void application_stats_commands(string_t *dst)
+{
+	const application_function_table_t *tableptr;
+	const application_function_stats_t *stats;
+
+	for(tableptr = application_function_table; tableptr->function; tableptr++)
+	{
+		stats = &application_function_stats[tableptr - application_function_table];
+
+		if(stats->count == 0)
+			continue;
+
+		string_format(dst, "> %s: calls: %u, total: %u us, avg: %u us, max: %u us, last: %u us\n",
+				tableptr->command2, stats->count, stats->total_us,
+				stats->total_us / stats->count, stats->max_us, stats->last_us);
+	}
+}
+
+irom static app_action_t application_function_stats_commands(const string_t *src, string_t *dst)
+{
+	application_stats_commands(dst);
+	return(app_action_normal);
+}
+
+irom static app_action_t application_function_stats_scheduler(const string_t *src, string_t *dst)
+{
+	stats_scheduler(dst);
+	return(app_action_normal);
+}
+
 irom static app_action_t application_function_stats_wlan(const string_t *src, string_t *dst)
 {
 	stats_wlan(dst);
@@ -367,6 +602,50 @@ irom static app_action_t application_function_bridge_timeout(const string_t *src
 	return(app_action_normal);
 }
 
+irom static app_action_t application_function_bridge_coalesce(const string_t *src, string_t *dst)
+{
+	string_init(varname_bridge_coalesce_bytes, "bridge.coalesce.bytes");
+	string_init(varname_bridge_coalesce_time, "bridge.coalesce.time");
+	int bytes, time;
+
+	if((parse_int(1, src, &bytes, 0, ' ') == parse_ok) && (parse_int(2, src, &time, 0, ' ') == parse_ok))
+	{
+		if((bytes < 0) || (bytes > 4096) || (time < 0) || (time > 1000000))
+		{
+			string_format(dst, "> invalid coalesce bytes/time: %d/%d\n", bytes, time);
+			return(app_action_error);
+		}
+
+		if(bytes == 0)
+			config_delete(&varname_bridge_coalesce_bytes, -1, -1, false);
+		else
+			if(!config_set_int(&varname_bridge_coalesce_bytes, -1, -1, bytes))
+			{
+				string_append(dst, "> cannot set config\n");
+				return(app_action_error);
+			}
+
+		if(time == 0)
+			config_delete(&varname_bridge_coalesce_time, -1, -1, false);
+		else
+			if(!config_set_int(&varname_bridge_coalesce_time, -1, -1, time))
+			{
+				string_append(dst, "> cannot set config\n");
+				return(app_action_error);
+			}
+	}
+
+	if(!config_get_int(&varname_bridge_coalesce_bytes, -1, -1, &bytes))
+		bytes = 0;
+
+	if(!config_get_int(&varname_bridge_coalesce_time, -1, -1, &time))
+		time = 0;
+
+	string_format(dst, "> coalesce bytes: %d, time: %d us\n", bytes, time);
+
+	return(app_action_normal);
+}
+
 irom static app_action_t application_function_command_port(const string_t *src, string_t *dst)
 {
 	string_init(varname_cmdport, "cmd.port");
@@ -429,6 +708,37 @@ irom static app_action_t application_function_command_timeout(const string_t *sr
 	return(app_action_normal);
 }
 
+irom static app_action_t application_function_command_clients(const string_t *src, string_t *dst)
+{
+	string_init(varname_cmdclients, "cmd.clients");
+	int clients;
+
+	if(parse_int(1, src, &clients, 0, ' ') == parse_ok)
+	{
+		if((clients < 1) || (clients > socket_tcp_children_max))
+		{
+			string_format(dst, "> invalid number of clients: %d (1 - %d)\n", clients, socket_tcp_children_max);
+			return(app_action_error);
+		}
+
+		if(clients == 3)
+			config_delete(&varname_cmdclients, -1, -1, false);
+		else
+			if(!config_set_int(&varname_cmdclients, -1, -1, clients))
+			{
+				string_append(dst, "> cannot set config\n");
+				return(app_action_error);
+			}
+	}
+
+	if(!config_get_int(&varname_cmdclients, -1, -1, &clients))
+		clients = 3;
+
+	string_format(dst, "> clients: %d\n", clients);
+
+	return(app_action_normal);
+}
+
 irom static app_action_t application_function_uart_baud_rate(const string_t *src, string_t *dst)
 {
 	string_init(varname_baudrate, "uart.baud");
@@ -460,6 +770,68 @@ irom static app_action_t application_function_uart_baud_rate(const string_t *src
 	return(app_action_normal);
 }
 
+irom static app_action_t application_function_uart_rx(const string_t *src, string_t *dst)
+{
+	string_init(varname_uart_rx_threshold, "uart.rx.threshold");
+	string_init(varname_uart_rx_timeout, "uart.rx.timeout");
+	string_init(varname_uart_rx_adaptive, "uart.rx.adaptive");
+	int threshold, timeout, adaptive;
+
+	if((parse_int(1, src, &threshold, 0, ' ') == parse_ok) && (parse_int(2, src, &timeout, 0, ' ') == parse_ok))
+	{
+		if(parse_int(3, src, &adaptive, 0, ' ') != parse_ok)
+			adaptive = 0;
+
+		if((threshold < 1) || (threshold > 112) || (timeout < 1) || (timeout > 127) || (adaptive < 0) || (adaptive > 1))
+		{
+			string_format(dst, "> invalid rx threshold/timeout/adaptive: %d/%d/%d\n", threshold, timeout, adaptive);
+			return(app_action_error);
+		}
+
+		if(threshold == 16)
+			config_delete(&varname_uart_rx_threshold, -1, -1, false);
+		else
+			if(!config_set_int(&varname_uart_rx_threshold, -1, -1, threshold))
+			{
+				string_append(dst, "> cannot set config\n");
+				return(app_action_error);
+			}
+
+		if(timeout == 2)
+			config_delete(&varname_uart_rx_timeout, -1, -1, false);
+		else
+			if(!config_set_int(&varname_uart_rx_timeout, -1, -1, timeout))
+			{
+				string_append(dst, "> cannot set config\n");
+				return(app_action_error);
+			}
+
+		if(adaptive == 0)
+			config_delete(&varname_uart_rx_adaptive, -1, -1, false);
+		else
+			if(!config_set_int(&varname_uart_rx_adaptive, -1, -1, adaptive))
+			{
+				string_append(dst, "> cannot set config\n");
+				return(app_action_error);
+			}
+
+		uart_rx_config(threshold, timeout, !!adaptive);
+	}
+
+	if(!config_get_int(&varname_uart_rx_threshold, -1, -1, &threshold))
+		threshold = 16;
+
+	if(!config_get_int(&varname_uart_rx_timeout, -1, -1, &timeout))
+		timeout = 2;
+
+	if(!config_get_int(&varname_uart_rx_adaptive, -1, -1, &adaptive))
+		adaptive = 0;
+
+	string_format(dst, "> rx fifo threshold: %d, timeout: %d, adaptive: %s\n", threshold, timeout, yesno(adaptive));
+
+	return(app_action_normal);
+}
+
 irom static app_action_t application_function_uart_data_bits(const string_t *src, string_t *dst)
 {
 	int data_bits;
@@ -781,7 +1153,6 @@ irom static app_action_t application_function_i2c_sensor_calibrate(const string_
 {
 	unsigned int intin, bus;
 	i2c_sensor_t sensor;
-	double factor, offset;
 	int int_factor, int_offset;
 	string_init(varname_i2s, "i2s.%u.%u.");
 	string_init(varname_i2s_factor, "i2s.%u.%u.factor");
@@ -813,11 +1184,8 @@ irom static app_action_t application_function_i2c_sensor_calibrate(const string_
 
 	sensor = (i2c_sensor_t)intin;
 
-	if((parse_float(3, src, &factor, ' ') == parse_ok) && (parse_float(4, src, &offset, ' ') == parse_ok))
+	if((parse_milli(3, src, &int_factor, ' ') == parse_ok) && (parse_milli(4, src, &int_offset, ' ') == parse_ok))
 	{
-		int_factor = (int)(factor * 1000.0);
-		int_offset = (int)(offset * 1000.0);
-
 		config_delete(&varname_i2s, bus, sensor, true);
 
 		if((int_factor != 1000) && !config_set_int(&varname_i2s_factor, bus, sensor, int_factor))
@@ -840,9 +1208,9 @@ irom static app_action_t application_function_i2c_sensor_calibrate(const string_
 		int_offset = 0;
 
 	string_format(dst, "> i2c sensor %u/%u calibration set to factor ", bus, (int)sensor);
-	string_double(dst, int_factor / 1000.0, 4, 1e10);
+	string_milli(dst, int_factor, 3, 1000000);
 	string_append(dst, ", offset: ");
-	string_double(dst, int_offset / 1000.0, 4, 1e10);
+	string_milli(dst, int_offset, 3, 1000000);
 	string_append(dst, "\n");
 
 	return(app_action_normal);
@@ -853,6 +1221,7 @@ irom static app_action_t application_function_i2c_sensor_dump(const string_t *sr
 	i2c_sensor_t sensor;
 	int option, bus;
 	bool_t all, verbose;
+	unsigned int cursor, first;
 	int original_length = string_length(dst);
 
 	all = false;
@@ -871,17 +1240,27 @@ irom static app_action_t application_function_i2c_sensor_dump(const string_t *sr
 		}
 	}
 
-	for(bus = 0; bus < i2c_busses; bus++)
-		for(sensor = 0; sensor < i2c_sensor_size; sensor++)
+	first = application_cursor();
+
+	for(cursor = first; cursor < (i2c_busses * i2c_sensor_size); cursor++)
+	{
+		bus = cursor / i2c_sensor_size;
+		sensor = cursor % i2c_sensor_size;
+
+		if(all || i2c_sensor_detected(bus, sensor))
 		{
-			if(all || i2c_sensor_detected(bus, sensor))
+			if((string_length(dst) != original_length) && application_part_full(dst))
 			{
-				i2c_sensor_read(dst, bus, sensor, verbose, false);
-				string_append(dst, "\n");
+				application_cursor_set(cursor);
+				return(app_action_more);
 			}
+
+			i2c_sensor_read(dst, bus, sensor, verbose, false);
+			string_append(dst, "\n");
 		}
+	}
 
-	if(string_length(dst) == original_length)
+	if((first == 0) && (string_length(dst) == original_length))
 		string_append(dst, "> no sensors detected\n");
 
 	return(app_action_normal);
@@ -1201,7 +1580,7 @@ irom static app_action_t application_function_log_clear(const string_t *src, str
 
 irom static app_action_t application_function_wlan_scan(const string_t *src, string_t *dst)
 {
-	if(ota_is_active() || config_uses_logbuffer())
+	if(ota_is_active())
 	{
 		string_append(dst, "wlan-scan: output buffer is in use\n");
 		return(app_action_error);
@@ -1427,6 +1806,16 @@ static const application_function_table_t application_function_table[] =
 		application_function_stats_i2c,
 		"stats (i2c)",
 	},
+	{
+		"scm", "stats-commands",
+		application_function_stats_commands,
+		"stats (command execution time)",
+	},
+	{
+		"ss", "stats-scheduler",
+		application_function_stats_scheduler,
+		"stats (background scheduler latency)",
+	},
 	{
 		"st", "stats-time",
 		application_function_stats_time,
@@ -1447,6 +1836,11 @@ static const application_function_table_t application_function_table[] =
 		application_function_bridge_timeout,
 		"set uart bridge tcp connection timeout (default 0)"
 	},
+	{
+		"bc", "bridge-coalesce",
+		application_function_bridge_coalesce,
+		"hold back uart bridge data until <bytes> are available or <time> us passed (default 0 0)"
+	},
 	{
 		"cp", "command-port",
 		application_function_command_port,
@@ -1457,6 +1851,11 @@ static const application_function_table_t application_function_table[] =
 		application_function_command_timeout,
 		"set command tcp connection timeout (default 0)"
 	},
+	{
+		"cc", "command-clients",
+		application_function_command_clients,
+		"set max concurrent command tcp connections (default 3)"
+	},
 	{
 		"cd", "config-dump",
 		application_function_config_dump,
@@ -1532,6 +1931,11 @@ static const application_function_table_t application_function_table[] =
 		application_function_i2c_write_read,
 		"write data to i2c slave and read back data",
 	},
+	{
+		"if", "io-fade",
+		application_function_io_fade,
+		"fade analog output to a value in a time",
+	},
 	{
 		"im", "io-mode",
 		application_function_io_mode,
@@ -1540,7 +1944,7 @@ static const application_function_table_t application_function_table[] =
 	{
 		"ir", "io-read",
 		application_function_io_read,
-		"read from i/o pin",
+		"read from i/o pin, frequency pins: [frequency|period|duty]",
 	},
 	{
 		"it", "io-trigger",
@@ -1612,6 +2016,11 @@ static const application_function_table_t application_function_table[] =
 		application_function_uart_baud_rate,
 		"set uart baud rate [1-1000000]",
 	},
+	{
+		"ur", "uart-rx",
+		application_function_uart_rx,
+		"set uart rx fifo threshold [1-112], timeout [1-127 chars] and adaptive [0/1] (default 16 2 0)",
+	},
 	{
 		"ud", "uart-data",
 		application_function_uart_data_bits,
@@ -1728,3 +2137,9 @@ static const application_function_table_t application_function_table[] =
 		"",
 	},
 };
+
+static application_function_stats_t application_function_stats[sizeof(application_function_table) / sizeof(*application_function_table)] = { { 0 } };
+
+_Static_assert((sizeof(application_function_table) / sizeof(*application_function_table)) <= 128, "application_function_table too large for alias index");
+
+static uint8_t application_alias_index[2 * (sizeof(application_function_table) / sizeof(*application_function_table))] = { 0 };
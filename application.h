@@ -1,6 +1,8 @@
 #ifndef application_h
 #define application_h
 
+#include "util.h"
+
 #include <stdint.h>
 
 typedef enum
@@ -12,9 +14,33 @@ typedef enum
 	app_action_reset,
 	app_action_ota_commit,
 	app_action_http_ok,
+	app_action_more,
 } app_action_t;
 
 _Static_assert(sizeof(app_action_t) == 4, "sizeof(app_action_t) != 4");
 
-app_action_t application_content(const string_t *src, string_t *dst);
+/*
+ * Commands whose output may not fit in the send buffer produce it in parts.
+ * A new command starts with cursor 0. A handler that runs short of space
+ * stores where to resume with application_cursor_set() and returns
+ * app_action_more. The command is then run again, with that cursor, when
+ * the part has been sent. A part always holds at least one item, so the
+ * cursor keeps moving even when an item doesn't fit.
+ */
+
+enum
+{
+	application_part_reserve = 1024,
+};
+
+always_inline static bool_t application_part_full(const string_t *dst)
+{
+	return((string_size(dst) - string_length(dst)) < application_part_reserve);
+}
+
+int application_command_next(const string_t *src, int offset, int *length);
+app_action_t application_content(const string_t *src, string_t *dst, unsigned int *cursor);
+unsigned int application_cursor(void);
+void application_cursor_set(unsigned int cursor);
+void application_stats_commands(string_t *dst);
 #endif
@@ -0,0 +1,341 @@
+#include "binary.h"
+
+#include "util.h"
+#include "io.h"
+#include "i2c.h"
+#include "i2c_sensor.h"
+#include "stats.h"
+
+enum
+{
+	binary_offset_length = 1,
+	binary_offset_opcode = 3,
+	binary_offset_id = 4,
+	binary_offset_status = 6,
+};
+
+typedef struct
+{
+	unsigned int	present;
+	int				io;
+	int				pin;
+	int				value;
+	int				trigger;
+	int				bus;
+	int				sensor;
+} binary_args_t;
+
+always_inline static unsigned int binary_get_byte(const string_t *src, int offset)
+{
+	return((uint8_t)string_at(src, offset));
+}
+
+always_inline static unsigned int binary_get_uint16(const string_t *src, int offset)
+{
+	return((binary_get_byte(src, offset + 0) << 0) |
+			(binary_get_byte(src, offset + 1) << 8));
+}
+
+always_inline static uint32_t binary_get_uint32(const string_t *src, int offset)
+{
+	return((binary_get_byte(src, offset + 0) << 0) |
+			(binary_get_byte(src, offset + 1) << 8) |
+			(binary_get_byte(src, offset + 2) << 16) |
+			(binary_get_byte(src, offset + 3) << 24));
+}
+
+always_inline static void binary_put_byte(string_t *dst, unsigned int value)
+{
+	string_append_char(dst, (char)(value & 0xff));
+}
+
+irom static void binary_put_uint32(string_t *dst, uint32_t value)
+{
+	binary_put_byte(dst, value >> 0);
+	binary_put_byte(dst, value >> 8);
+	binary_put_byte(dst, value >> 16);
+	binary_put_byte(dst, value >> 24);
+}
+
+irom static void binary_put_tlv_value(string_t *dst, binary_tlv_t type, int value)
+{
+	binary_put_byte(dst, type);
+	binary_put_byte(dst, 4);
+	binary_put_uint32(dst, (uint32_t)value);
+}
+
+irom static void binary_put_tlv_pin_value(string_t *dst, int io, int pin, int value)
+{
+	binary_put_byte(dst, binary_tlv_pin_value);
+	binary_put_byte(dst, 6);
+	binary_put_byte(dst, io);
+	binary_put_byte(dst, pin);
+	binary_put_uint32(dst, (uint32_t)value);
+}
+
+irom static bool_t binary_parse_args(const string_t *src, int offset, int end, binary_args_t *args)
+{
+	unsigned int type, length;
+
+	args->present = 0;
+	args->io = args->pin = args->value = args->trigger = args->bus = args->sensor = 0;
+
+	while(offset < end)
+	{
+		if((offset + 2) > end)
+			return(false);
+
+		type = binary_get_byte(src, offset + 0);
+		length = binary_get_byte(src, offset + 1);
+		offset += 2;
+
+		if((offset + (int)length) > end)
+			return(false);
+
+		if((type == binary_tlv_value) ? (length != 4) : ((type <= binary_tlv_sensor) && (length != 1)))
+			return(false);
+
+		// unknown arguments are skipped, for forward compatibility
+
+		switch(type)
+		{
+			case(binary_tlv_io):
+			{
+				args->io = binary_get_byte(src, offset);
+				break;
+			}
+
+			case(binary_tlv_pin):
+			{
+				args->pin = binary_get_byte(src, offset);
+				break;
+			}
+
+			case(binary_tlv_value):
+			{
+				args->value = (int)binary_get_uint32(src, offset);
+				break;
+			}
+
+			case(binary_tlv_trigger):
+			{
+				args->trigger = binary_get_byte(src, offset);
+				break;
+			}
+
+			case(binary_tlv_bus):
+			{
+				args->bus = binary_get_byte(src, offset);
+				break;
+			}
+
+			case(binary_tlv_sensor):
+			{
+				args->sensor = binary_get_byte(src, offset);
+				break;
+			}
+		}
+
+		if(type < (sizeof(args->present) * 8))
+			args->present |= 1U << type;
+
+		offset += length;
+	}
+
+	return(true);
+}
+
+always_inline static bool_t binary_has(const binary_args_t *args, binary_tlv_t type)
+{
+	return(!!(args->present & (1U << type)));
+}
+
+irom static binary_status_t binary_execute(binary_op_t op, const binary_args_t *args, string_t *dst)
+{
+	int io, pin, value, age;
+
+	switch(op)
+	{
+		case(binary_op_io_read):
+		{
+			if(!binary_has(args, binary_tlv_io) || !binary_has(args, binary_tlv_pin))
+				return(binary_status_argument_error);
+
+			if(io_read_pin((string_t *)0, args->io, args->pin, &value) != io_ok)
+				return(binary_status_io_error);
+
+			binary_put_tlv_value(dst, binary_tlv_value, value);
+
+			return(binary_status_ok);
+		}
+
+		case(binary_op_io_write):
+		{
+			if(!binary_has(args, binary_tlv_io) || !binary_has(args, binary_tlv_pin) || !binary_has(args, binary_tlv_value))
+				return(binary_status_argument_error);
+
+			if(io_write_pin((string_t *)0, args->io, args->pin, args->value) != io_ok)
+				return(binary_status_io_error);
+
+			return(binary_status_ok);
+		}
+
+		case(binary_op_io_trigger):
+		{
+			if(!binary_has(args, binary_tlv_io) || !binary_has(args, binary_tlv_pin) || !binary_has(args, binary_tlv_trigger) ||
+					(args->trigger <= io_trigger_none) || (args->trigger >= io_trigger_size))
+				return(binary_status_argument_error);
+
+			if(io_trigger_pin((string_t *)0, args->io, args->pin, (io_trigger_t)args->trigger) != io_ok)
+				return(binary_status_io_error);
+
+			return(binary_status_ok);
+		}
+
+		case(binary_op_io_snapshot):
+		{
+			for(io = 0; io < io_id_size; io++)
+			{
+				if(binary_has(args, binary_tlv_io) && (io != args->io))
+					continue;
+
+				for(pin = 0; pin < max_pins_per_io; pin++)
+					if(io_read_pin((string_t *)0, io, pin, &value) == io_ok)
+						binary_put_tlv_pin_value(dst, io, pin, value);
+			}
+
+			return(binary_status_ok);
+		}
+
+		case(binary_op_sensor_read):
+		{
+			if(!binary_has(args, binary_tlv_bus) || !binary_has(args, binary_tlv_sensor) ||
+					(args->bus >= i2c_busses) || (args->sensor >= i2c_sensor_size))
+				return(binary_status_argument_error);
+
+			if(!i2c_sensor_cached(args->bus, (i2c_sensor_t)args->sensor, &value, &age))
+				return(binary_status_sensor_error);
+
+			binary_put_tlv_value(dst, binary_tlv_value, value);
+			binary_put_tlv_value(dst, binary_tlv_age, age);
+
+			return(binary_status_ok);
+		}
+	}
+
+	return(binary_status_unknown_opcode);
+}
+
+// a frame too short to hold the opcode and request id gets a reply with both zero
+
+irom static void binary_reply_header(const string_t *src, string_t *dst, binary_status_t status)
+{
+	unsigned int op, id;
+
+	if(string_length(src) >= binary_header_size)
+	{
+		op = binary_get_byte(src, binary_offset_opcode);
+		id = binary_get_uint16(src, binary_offset_id);
+	}
+	else
+	{
+		op = 0;
+		id = 0;
+	}
+
+	string_clear(dst);
+
+	binary_put_byte(dst, binary_magic);
+	binary_put_byte(dst, 0);
+	binary_put_byte(dst, 0);
+	binary_put_byte(dst, op | binary_reply);
+	binary_put_byte(dst, id >> 0);
+	binary_put_byte(dst, id >> 8);
+	binary_put_byte(dst, status);
+}
+
+// fill in the length and append the crc
+
+irom static void binary_reply_finish(string_t *dst)
+{
+	int length = string_length(dst) + binary_crc_size;
+
+	string_replace(dst, binary_offset_length + 0, (char)((length >> 0) & 0xff));
+	string_replace(dst, binary_offset_length + 1, (char)((length >> 8) & 0xff));
+	binary_put_uint32(dst, string_crc32(dst, 0, string_length(dst)));
+}
+
+/*
+ * The length of the frame at the start of "src": the length when all of it
+ * is there, 0 if more data is needed to complete it, -1 if the length field
+ * is out of range, the stream can't be followed from there on.
+ */
+
+irom int binary_frame_length(const string_t *src)
+{
+	int length;
+
+	if(string_length(src) < (binary_offset_length + 2))
+		return(0);
+
+	length = binary_get_uint16(src, binary_offset_length);
+
+	if((length < binary_frame_size_min) || (length > binary_request_size_max))
+		return(-1);
+
+	if(string_length(src) < length)
+		return(0);
+
+	return(length);
+}
+
+irom unsigned int binary_request_id(const string_t *src)
+{
+	if(string_length(src) < binary_header_size)
+		return(0);
+
+	return(binary_get_uint16(src, binary_offset_id));
+}
+
+irom void binary_reply_status(const string_t *src, string_t *dst, binary_status_t status)
+{
+	binary_reply_header(src, dst, status);
+	binary_reply_finish(dst);
+}
+
+// "src" is one frame, as delimited by binary_frame_length()
+
+irom void binary_request(const string_t *src, string_t *dst)
+{
+	binary_args_t args;
+	binary_status_t status;
+	unsigned int op;
+	int end;
+
+	op = binary_get_byte(src, binary_offset_opcode);
+	binary_reply_header(src, dst, binary_status_ok);
+
+	end = string_length(src) - binary_crc_size;
+
+	if((end < binary_header_size) || ((int)binary_get_uint16(src, binary_offset_length) != string_length(src)))
+		status = binary_status_frame_error;
+	else
+		if(string_crc32(src, 0, end) != binary_get_uint32(src, end))
+			status = binary_status_crc_error;
+		else
+			if(!binary_parse_args(src, binary_header_size, end, &args))
+				status = binary_status_argument_error;
+			else
+				status = binary_execute((binary_op_t)op, &args, dst);
+
+	if(status != binary_status_ok)
+	{
+		stat_cmd_binary_errors++;
+		string_setlength(dst, binary_offset_status);
+		binary_put_byte(dst, status);
+	}
+
+	stat_cmd_binary++;
+
+	binary_reply_finish(dst);
+}
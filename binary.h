@@ -0,0 +1,90 @@
+#ifndef binary_h
+#define binary_h
+
+#include "util.h"
+
+/*
+ * Binary framing on the command port, for the operations that are polled
+ * often. All multi-byte fields are little endian:
+ *
+ *	0		magic (binary_magic)
+ *	1-2		length of the whole frame, magic and crc included
+ *	3		opcode
+ *	4-5		request id, echoed in the reply
+ *	6-n		arguments, each as type (1 byte), length (1 byte), value
+ *	n-4		crc32 of all preceding bytes (same crc as ota-send)
+ *
+ * The reply has the same layout with opcode | binary_reply and a status
+ * byte between the request id and the arguments. Text commands never start
+ * with the magic byte, so both can be used on the same connection. On tcp
+ * the length delimits the frames in the stream: a packet may hold several
+ * frames and a frame may be split over several packets.
+ *
+ * Over udp a nonzero request id asks for duplicate detection: a request with
+ * the same id from the same address and port as one of the last four requests
+ * that carried an id (from any peer) is taken for a retransmission. It is
+ * answered with the reply kept from the first time and not run again. So a
+ * client must give every new request an id it hasn't used for its last four,
+ * counting up and skipping 0 will do. Id 0 turns duplicate detection off, the
+ * request is always run, e.g. for a poller that doesn't retransmit. Over tcp
+ * the id is only echoed.
+ */
+
+enum
+{
+	binary_magic = 0xb5,
+	binary_reply = 0x80,
+	binary_header_size = 6,
+	binary_crc_size = 4,
+	binary_frame_size_min = binary_header_size + binary_crc_size,
+	binary_request_size_max = 64,
+};
+
+typedef enum
+{
+	binary_op_io_read = 0x01,			// io, pin -> value
+	binary_op_io_write = 0x02,			// io, pin, value
+	binary_op_io_trigger = 0x03,		// io, pin, trigger
+	binary_op_io_snapshot = 0x04,		// [io] -> pin_value for every readable pin
+	binary_op_sensor_read = 0x05,		// bus, sensor -> value (1/1000 unit), age (ms)
+} binary_op_t;
+
+typedef enum
+{
+	binary_tlv_io = 0x01,				// 1 byte
+	binary_tlv_pin = 0x02,				// 1 byte
+	binary_tlv_value = 0x03,			// 4 bytes, signed
+	binary_tlv_trigger = 0x04,			// 1 byte, io_trigger_t
+	binary_tlv_bus = 0x05,				// 1 byte
+	binary_tlv_sensor = 0x06,			// 1 byte, i2c_sensor_t
+	binary_tlv_age = 0x07,				// 4 bytes, ms since sampled
+	binary_tlv_pin_value = 0x08,		// 6 bytes, io, pin, value
+} binary_tlv_t;
+
+typedef enum
+{
+	binary_status_ok = 0,
+	binary_status_frame_error,
+	binary_status_crc_error,
+	binary_status_unknown_opcode,
+	binary_status_argument_error,
+	binary_status_io_error,
+	binary_status_sensor_error,
+	binary_status_duplicate,		// retransmitted request, reply was not kept
+} binary_status_t;
+
+assert_size(binary_op_t, 4);
+assert_size(binary_tlv_t, 4);
+assert_size(binary_status_t, 4);
+
+always_inline static bool_t binary_frame(const string_t *src)
+{
+	return((string_length(src) > 0) && ((uint8_t)string_at(src, 0) == binary_magic));
+}
+
+int binary_frame_length(const string_t *src);
+unsigned int binary_request_id(const string_t *src);
+void binary_request(const string_t *src, string_t *dst);
+void binary_reply_status(const string_t *src, string_t *dst, binary_status_t status);
+
+#endif
@@ -0,0 +1,457 @@
+#include "binaryclient.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+
+enum
+{
+	offset_length = 1,
+	offset_opcode = 3,
+	offset_id = 4,
+	offset_status = 6,
+	reply_header_size = 7,
+};
+
+static uint32_t crc_table[256];
+
+void binary_client_crc32_init(void)
+{
+	unsigned int dividend, bit;
+	uint32_t remainder;
+
+	for(dividend = 0; dividend < (sizeof(crc_table) / sizeof(*crc_table)); dividend++)
+	{
+		remainder = dividend << (32 - 8);
+
+		for (bit = 8; bit > 0; --bit)
+		{
+			if (remainder & (1U << 31))
+				remainder = (remainder << 1) ^ 0x04c11db7;
+			else
+				remainder = (remainder << 1);
+		}
+
+		crc_table[dividend] = remainder;
+	}
+}
+
+static uint32_t crc32(int length, const uint8_t *src)
+{
+	uint32_t remainder = 0xffffffff;
+	uint8_t data;
+	int offset;
+
+	for(offset = 0; offset < length; offset++)
+	{
+		data = src[offset] ^ (remainder >> (32 - 8));
+		remainder = crc_table[data] ^ (remainder << 8);
+	}
+
+	return(remainder ^ 0xffffffff);
+}
+
+static unsigned int get_uint16(const uint8_t *src)
+{
+	return(src[0] | (src[1] << 8));
+}
+
+static uint32_t get_uint32(const uint8_t *src)
+{
+	return((uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24));
+}
+
+static void put_uint16(uint8_t *dst, unsigned int value)
+{
+	dst[0] = (value >> 0) & 0xff;
+	dst[1] = (value >> 8) & 0xff;
+}
+
+static void put_uint32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (value >> 0) & 0xff;
+	dst[1] = (value >> 8) & 0xff;
+	dst[2] = (value >> 16) & 0xff;
+	dst[3] = (value >> 24) & 0xff;
+}
+
+void binary_client_init(binary_client_t *client, int fd, int stream, int timeout)
+{
+	client->fd = fd;
+	client->stream = stream;
+	client->timeout = timeout;
+	client->next_id = 1;
+	client->length = 0;
+}
+
+int binary_client_connect(binary_client_t *client, const char *host, int port, int udp, int timeout)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	char service[16];
+	int fd, one = 1;
+
+	snprintf(service, sizeof(service), "%u", port);
+	memset(&hints, 0, sizeof(hints));
+
+	hints.ai_family		=	AF_INET6;
+	hints.ai_socktype	=	udp ? SOCK_DGRAM : SOCK_STREAM;
+	hints.ai_flags		=	AI_NUMERICSERV | AI_V4MAPPED;
+
+	if(getaddrinfo(host, service, &hints, &res))
+		return(-1);
+
+	if((fd = socket(AF_INET6, hints.ai_socktype, 0)) < 0)
+	{
+		freeaddrinfo(res);
+		return(-1);
+	}
+
+	// the requests are small, don't hold them back to fill a segment
+
+	if(!udp)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if(connect(fd, res->ai_addr, res->ai_addrlen))
+	{
+		freeaddrinfo(res);
+		close(fd);
+		return(-1);
+	}
+
+	freeaddrinfo(res);
+	binary_client_init(client, fd, !udp, timeout);
+
+	return(0);
+}
+
+void binary_client_close(binary_client_t *client)
+{
+	if(client->fd >= 0)
+		close(client->fd);
+
+	client->fd = -1;
+	client->length = 0;
+}
+
+// append one argument, "length" is 1 or 4 bytes, returns the new offset
+
+int binary_client_arg(uint8_t *args, int offset, int size, unsigned int type, unsigned int length, uint32_t value)
+{
+	if((offset < 0) || ((length != 1) && (length != 4)) || ((offset + 2 + (int)length) > size))
+		return(-1);
+
+	args[offset++] = type;
+	args[offset++] = length;
+
+	if(length == 1)
+		args[offset++] = value & 0xff;
+	else
+	{
+		put_uint32(&args[offset], value);
+		offset += 4;
+	}
+
+	return(offset);
+}
+
+int binary_client_encode(uint8_t *frame, int size, unsigned int op, unsigned int id, const uint8_t *args, int args_length)
+{
+	int length;
+
+	length = binary_client_header_size + args_length + binary_client_crc_size;
+
+	if((args_length < 0) || (length > size) || (length > binary_client_request_size_max))
+		return(-1);
+
+	frame[0] = binary_client_magic;
+	put_uint16(&frame[offset_length], length);
+	frame[offset_opcode] = op;
+	put_uint16(&frame[offset_id], id);
+
+	if(args_length > 0)
+		memcpy(&frame[binary_client_header_size], args, args_length);
+
+	put_uint32(&frame[length - binary_client_crc_size], crc32(length - binary_client_crc_size, frame));
+
+	return(length);
+}
+
+/*
+ * Returns the length of the reply frame at the start of "data" and fills
+ * in "reply" when all of it is there, 0 when more data is needed and -1
+ * when it isn't a valid reply.
+ */
+
+int binary_client_decode(const uint8_t *data, int length, binary_client_reply_t *reply)
+{
+	int frame_length;
+
+	if(length < 1)
+		return(0);
+
+	if(data[0] != binary_client_magic)
+		return(-1);
+
+	if(length < (offset_length + 2))
+		return(0);
+
+	frame_length = get_uint16(&data[offset_length]);
+
+	if((frame_length < (reply_header_size + binary_client_crc_size)) || (frame_length > binary_client_reply_size_max))
+		return(-1);
+
+	if(length < frame_length)
+		return(0);
+
+	if(crc32(frame_length - binary_client_crc_size, data) != get_uint32(&data[frame_length - binary_client_crc_size]))
+		return(-1);
+
+	if(!(data[offset_opcode] & binary_client_reply))
+		return(-1);
+
+	memcpy(reply->frame, data, frame_length);
+	reply->length = frame_length;
+	reply->op = data[offset_opcode] & ~binary_client_reply;
+	reply->id = get_uint16(&data[offset_id]);
+	reply->status = data[offset_status];
+
+	return(frame_length);
+}
+
+// find the "index"th argument of "type" in a reply, 1 and 4 byte values only
+
+int binary_client_reply_arg(const binary_client_reply_t *reply, unsigned int type, int index, int *value)
+{
+	int offset, end, length;
+
+	end = reply->length - binary_client_crc_size;
+
+	for(offset = reply_header_size; (offset + 2) <= end; offset += 2 + length)
+	{
+		length = reply->frame[offset + 1];
+
+		if((offset + 2 + length) > end)
+			return(-1);
+
+		if((reply->frame[offset] != type) || (index-- > 0))
+			continue;
+
+		if(length == 1)
+			*value = reply->frame[offset + 2];
+		else
+			if(length == 4)
+				*value = (int32_t)get_uint32(&reply->frame[offset + 2]);
+			else
+				return(-1);
+
+		return(0);
+	}
+
+	return(-1);
+}
+
+int binary_client_reply_pin_value(const binary_client_reply_t *reply, int index, int *io, int *pin, int *value)
+{
+	int offset, end, length;
+
+	end = reply->length - binary_client_crc_size;
+
+	for(offset = reply_header_size; (offset + 2) <= end; offset += 2 + length)
+	{
+		length = reply->frame[offset + 1];
+
+		if((offset + 2 + length) > end)
+			return(-1);
+
+		if((reply->frame[offset] != binary_client_tlv_pin_value) || (length != 6) || (index-- > 0))
+			continue;
+
+		*io = reply->frame[offset + 2];
+		*pin = reply->frame[offset + 3];
+		*value = (int32_t)get_uint32(&reply->frame[offset + 4]);
+
+		return(0);
+	}
+
+	return(-1);
+}
+
+// returns the request id, the reply can be collected later with binary_client_receive()
+
+int binary_client_send(binary_client_t *client, unsigned int op, const uint8_t *args, int args_length)
+{
+	uint8_t frame[binary_client_request_size_max];
+	struct pollfd pfd;
+	unsigned int id;
+	int length;
+
+	// id 0 would turn off duplicate detection on the device, see binary.h
+
+	id = client->next_id;
+	client->next_id = (client->next_id % 0xffff) + 1;
+
+	if((length = binary_client_encode(frame, sizeof(frame), op, id, args, args_length)) < 0)
+		return(-1);
+
+	pfd.fd		= client->fd;
+	pfd.events	= POLLOUT;
+
+	if(poll(&pfd, 1, client->timeout) != 1)
+		return(-1);
+
+	if(write(client->fd, frame, length) != length)
+		return(-1);
+
+	return(id);
+}
+
+int binary_client_receive(binary_client_t *client, binary_client_reply_t *reply)
+{
+	struct pollfd pfd;
+	ssize_t length;
+	int rv;
+
+	for(;;)
+	{
+		if(client->length > 0)
+		{
+			if((rv = binary_client_decode(client->buffer, client->length, reply)) < 0)
+			{
+				client->length = 0;
+				return(-1);
+			}
+
+			if(rv > 0)
+			{
+				memmove(client->buffer, client->buffer + rv, client->length - rv);
+				client->length -= rv;
+				return(0);
+			}
+
+			// a datagram holds whole frames, there is no rest to wait for
+
+			if(!client->stream)
+			{
+				client->length = 0;
+				return(-1);
+			}
+		}
+
+		pfd.fd		= client->fd;
+		pfd.events	= POLLIN;
+
+		if(poll(&pfd, 1, client->timeout) != 1)
+			return(-1);
+
+		if((length = read(client->fd, client->buffer + client->length, sizeof(client->buffer) - client->length)) <= 0)
+			return(-1);
+
+		client->length += length;
+	}
+}
+
+// replies to earlier requests that were given up on are skipped
+
+int binary_client_request(binary_client_t *client, unsigned int op, const uint8_t *args, int args_length, binary_client_reply_t *reply)
+{
+	int id;
+
+	if((id = binary_client_send(client, op, args, args_length)) < 0)
+		return(-1);
+
+	for(;;)
+	{
+		if(binary_client_receive(client, reply))
+			return(-1);
+
+		if(reply->id == (unsigned int)id)
+			break;
+	}
+
+	if(reply->op != op)
+		return(-1);
+
+	return(reply->status);
+}
+
+int binary_client_io_read(binary_client_t *client, int io, int pin, int *value)
+{
+	binary_client_reply_t reply;
+	uint8_t args[16];
+	int length, status;
+
+	length = binary_client_arg(args, 0, sizeof(args), binary_client_tlv_io, 1, io);
+	length = binary_client_arg(args, length, sizeof(args), binary_client_tlv_pin, 1, pin);
+
+	if((status = binary_client_request(client, binary_client_op_io_read, args, length, &reply)) != binary_client_status_ok)
+		return(status);
+
+	if(binary_client_reply_arg(&reply, binary_client_tlv_value, 0, value))
+		return(-1);
+
+	return(binary_client_status_ok);
+}
+
+int binary_client_io_write(binary_client_t *client, int io, int pin, int value)
+{
+	binary_client_reply_t reply;
+	uint8_t args[16];
+	int length;
+
+	length = binary_client_arg(args, 0, sizeof(args), binary_client_tlv_io, 1, io);
+	length = binary_client_arg(args, length, sizeof(args), binary_client_tlv_pin, 1, pin);
+	length = binary_client_arg(args, length, sizeof(args), binary_client_tlv_value, 4, (uint32_t)value);
+
+	return(binary_client_request(client, binary_client_op_io_write, args, length, &reply));
+}
+
+int binary_client_io_trigger(binary_client_t *client, int io, int pin, int trigger)
+{
+	binary_client_reply_t reply;
+	uint8_t args[16];
+	int length;
+
+	length = binary_client_arg(args, 0, sizeof(args), binary_client_tlv_io, 1, io);
+	length = binary_client_arg(args, length, sizeof(args), binary_client_tlv_pin, 1, pin);
+	length = binary_client_arg(args, length, sizeof(args), binary_client_tlv_trigger, 1, trigger);
+
+	return(binary_client_request(client, binary_client_op_io_trigger, args, length, &reply));
+}
+
+// io < 0 for all ios, read the values from the reply with binary_client_reply_pin_value()
+
+int binary_client_io_snapshot(binary_client_t *client, int io, binary_client_reply_t *reply)
+{
+	uint8_t args[16];
+	int length = 0;
+
+	if(io >= 0)
+		length = binary_client_arg(args, 0, sizeof(args), binary_client_tlv_io, 1, io);
+
+	return(binary_client_request(client, binary_client_op_io_snapshot, args, length, reply));
+}
+
+int binary_client_sensor_read(binary_client_t *client, int bus, int sensor, int *value, int *age)
+{
+	binary_client_reply_t reply;
+	uint8_t args[16];
+	int length, status;
+
+	length = binary_client_arg(args, 0, sizeof(args), binary_client_tlv_bus, 1, bus);
+	length = binary_client_arg(args, length, sizeof(args), binary_client_tlv_sensor, 1, sensor);
+
+	if((status = binary_client_request(client, binary_client_op_sensor_read, args, length, &reply)) != binary_client_status_ok)
+		return(status);
+
+	if(binary_client_reply_arg(&reply, binary_client_tlv_value, 0, value) ||
+			binary_client_reply_arg(&reply, binary_client_tlv_age, 0, age))
+		return(-1);
+
+	return(binary_client_status_ok);
+}
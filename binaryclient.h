@@ -0,0 +1,97 @@
+#ifndef binaryclient_h
+#define binaryclient_h
+
+#include <stdint.h>
+
+/*
+ * Host side client for the binary framing on the command port, see binary.h
+ * for the frame layout. Over tcp the replies are taken out of the stream by
+ * their length, so several requests can be sent before the replies are read.
+ * Functions that return an int return -1 on a transport or framing error,
+ * the request functions otherwise return the status byte of the reply.
+ */
+
+enum
+{
+	binary_client_magic = 0xb5,
+	binary_client_reply = 0x80,
+	binary_client_header_size = 6,
+	binary_client_crc_size = 4,
+	binary_client_request_size_max = 64,
+	binary_client_reply_size_max = 8192,
+};
+
+enum
+{
+	binary_client_op_io_read = 0x01,
+	binary_client_op_io_write = 0x02,
+	binary_client_op_io_trigger = 0x03,
+	binary_client_op_io_snapshot = 0x04,
+	binary_client_op_sensor_read = 0x05,
+};
+
+enum
+{
+	binary_client_tlv_io = 0x01,
+	binary_client_tlv_pin = 0x02,
+	binary_client_tlv_value = 0x03,
+	binary_client_tlv_trigger = 0x04,
+	binary_client_tlv_bus = 0x05,
+	binary_client_tlv_sensor = 0x06,
+	binary_client_tlv_age = 0x07,
+	binary_client_tlv_pin_value = 0x08,
+};
+
+enum
+{
+	binary_client_status_ok = 0,
+	binary_client_status_frame_error,
+	binary_client_status_crc_error,
+	binary_client_status_unknown_opcode,
+	binary_client_status_argument_error,
+	binary_client_status_io_error,
+	binary_client_status_sensor_error,
+	binary_client_status_duplicate,
+};
+
+typedef struct
+{
+	int				fd;
+	int				stream;
+	int				timeout;
+	unsigned int	next_id;
+	int				length;
+	uint8_t			buffer[binary_client_reply_size_max];
+} binary_client_t;
+
+typedef struct
+{
+	unsigned int	op;
+	unsigned int	id;
+	unsigned int	status;
+	int				length;
+	uint8_t			frame[binary_client_reply_size_max];
+} binary_client_reply_t;
+
+void	binary_client_crc32_init(void);
+void	binary_client_init(binary_client_t *client, int fd, int stream, int timeout);
+int		binary_client_connect(binary_client_t *client, const char *host, int port, int udp, int timeout);
+void	binary_client_close(binary_client_t *client);
+
+int		binary_client_arg(uint8_t *args, int offset, int size, unsigned int type, unsigned int length, uint32_t value);
+int		binary_client_encode(uint8_t *frame, int size, unsigned int op, unsigned int id, const uint8_t *args, int args_length);
+int		binary_client_decode(const uint8_t *data, int length, binary_client_reply_t *reply);
+int		binary_client_reply_arg(const binary_client_reply_t *reply, unsigned int type, int index, int *value);
+int		binary_client_reply_pin_value(const binary_client_reply_t *reply, int index, int *io, int *pin, int *value);
+
+int		binary_client_send(binary_client_t *client, unsigned int op, const uint8_t *args, int args_length);
+int		binary_client_receive(binary_client_t *client, binary_client_reply_t *reply);
+int		binary_client_request(binary_client_t *client, unsigned int op, const uint8_t *args, int args_length, binary_client_reply_t *reply);
+
+int		binary_client_io_read(binary_client_t *client, int io, int pin, int *value);
+int		binary_client_io_write(binary_client_t *client, int io, int pin, int value);
+int		binary_client_io_trigger(binary_client_t *client, int io, int pin, int trigger);
+int		binary_client_io_snapshot(binary_client_t *client, int io, binary_client_reply_t *reply);
+int		binary_client_sensor_read(binary_client_t *client, int bus, int sensor, int *value, int *age);
+
+#endif
@@ -13,28 +13,139 @@
 
 enum
 {
-	config_entries_size = 100,
-	config_entry_id_size = 28,
-	config_entry_string_size = 32
+	config_entries_size = 128,
+	config_arena_size = 3072,
+	config_index_size = 256,
+	config_index_empty = 0xff,
+	config_value_int_only = 0xff,
+	config_journal_sectors = USER_CONFIG_JOURNAL_SECTORS,
+	config_snapshot_sectors_max = config_journal_sectors / 2,
+	config_journal_magic = 0x4a474643,
+	config_journal_flag_snapshot = 1 << 0,
 };
 
+typedef enum
+{
+	config_record_set = 0x01,
+	config_record_commit = 0x02,
+	config_record_free = 0xff,
+} config_record_type_t;
+
+typedef enum
+{
+	config_record_ok,
+	config_record_end,
+	config_record_corrupt,
+} config_record_status_t;
+
+_Static_assert(config_index_size > config_entries_size, "config_index_size <= config_entries_size");
+_Static_assert(config_entries_size < config_index_empty, "config_entries_size >= config_index_empty");
+_Static_assert((config_index_size & (config_index_size - 1)) == 0, "config_index_size not power of two");
+_Static_assert(config_snapshot_sectors_max > 0, "config_journal_sectors < 2");
+
+/*
+ * Ids and values are packed back to back into config_arena[], without
+ * terminating zero. Values that are plain decimal integers only live in
+ * int_value and take no arena space at all. Space of values that are
+ * replaced by longer ones and of deleted entries is reclaimed by sliding
+ * the entries together once the arena is full.
+ */
+
 typedef struct
 {
-	char	id[config_entry_id_size];
-	char	string_value[config_entry_string_size];
-	int		int_value;
+	uint16_t	offset;
+	uint8_t		id_length;		// 0 = slot unused
+	uint8_t		value_length;	// config_value_int_only = only int_value is valid
+	int			int_value;
 } config_entry_t;
 
-assert_size(config_entry_t, 64);
+assert_size(config_entry_t, 8);
+
+/*
+ * The config is stored in flash as an append-only journal of binary records,
+ * spread over config_journal_sectors sectors that are used as a ring. Every
+ * sector starts with a header carrying a sequence number, a sector that
+ * starts a full snapshot of the config carries the snapshot flag. A snapshot
+ * is only valid once its commit record has been written. After the commit,
+ * changed entries are appended as set records, again followed by a commit
+ * record, so a write counts as a whole or not at all. When the ring runs out of
+ * free sectors, a new snapshot is written to the free sectors after the
+ * current one, which makes the old sectors free for reuse.
+ *
+ * The old snapshot and the records appended to it must stay intact until the
+ * new snapshot has been committed. A snapshot is therefore limited to half
+ * of the sectors and appends never take the chain beyond the other half, so
+ * there is always room for a compaction. A change that would make the
+ * snapshot larger is refused by config_set_*(). To keep sets cheap, they
+ * check a running size of the snapshot against a bound of the sectors it
+ * takes, instead of packing all records into sectors again.
+ */
 
-config_options_t config_options =
+typedef struct
 {
-	.using_logbuffer = 0
-};
+	uint32_t	magic;
+	uint32_t	sequence;
+	uint32_t	flags;
+	uint32_t	crc;
+} config_sector_header_t;
+
+assert_size(config_sector_header_t, 16);
+
+typedef struct
+{
+	uint8_t		type;
+	uint8_t		id_length;
+	uint8_t		value_length;
+	uint8_t		spare;
+	uint32_t	crc;
+} config_record_header_t;
+
+assert_size(config_record_header_t, 8);
+
+typedef union
+{
+	struct
+	{
+		config_record_header_t	header;
+		char					payload[config_entry_id_size + config_entry_string_size];
+	};
+	char		byte[sizeof(config_record_header_t) + config_entry_id_size + config_entry_string_size];
+	uint32_t	word[(sizeof(config_record_header_t) + config_entry_id_size + config_entry_string_size) / sizeof(uint32_t)];
+} config_record_t;
+
+assert_size(config_record_t, 104);
+
+typedef struct
+{
+	unsigned int	valid:1;
+	unsigned int	compact:1;
+	unsigned int	head;
+	unsigned int	offset;
+	unsigned int	live;
+	unsigned int	used;
+	uint32_t		sequence;
+} config_journal_t;
 
 config_flags_t flags_cache;
 static unsigned int config_entries_length = 0;
 static config_entry_t config_entries[config_entries_size];
+static char config_arena[config_arena_size];
+static unsigned int config_arena_used = 0;
+
+// open addressed hash index over config_entries[], maps key hash -> entry number
+
+static uint16_t config_entries_hash[config_entries_size];
+static uint32_t config_entries_dirty[(config_entries_size + 31) / 32];
+static config_journal_t config_journal;
+static uint8_t config_index[config_index_size] = { [0 ... config_index_size - 1] = config_index_empty };
+
+// bumped whenever the index changes, invalidates all config handles
+
+static unsigned int config_generation = 1;
+
+// bytes of all records of a snapshot of the current entries, including the commit record
+
+static unsigned int config_snapshot_size = sizeof(config_record_header_t);
 
 irom static bool_t config_flags_set(config_flags_t flags)
 {
@@ -167,33 +278,241 @@ typedef enum
 	state_parse_eol,
 } state_parse_t;
 
+always_inline static const char *config_entry_id(const config_entry_t *entry)
+{
+	return(&config_arena[entry->offset]);
+}
+
+always_inline static unsigned int config_entry_string_length(const config_entry_t *entry)
+{
+	return((entry->value_length == config_value_int_only) ? 0 : entry->value_length);
+}
+
+always_inline static unsigned int config_entry_arena_size(const config_entry_t *entry)
+{
+	return(entry->id_length + config_entry_string_length(entry));
+}
+
+irom static void config_entry_value(const config_entry_t *entry, string_t *dst)
+{
+	unsigned int length;
+
+	if(entry->value_length == config_value_int_only)
+	{
+		string_format(dst, "%d", entry->int_value);
+		return;
+	}
+
+	length = entry->value_length;
+
+	if((string_length(dst) + length) >= (unsigned int)string_size(dst))
+		length = string_size(dst) - string_length(dst) - 1;
+
+	memcpy(string_buffer_nonconst(dst) + string_length(dst), &config_arena[entry->offset + entry->id_length], length);
+	string_setlength(dst, string_length(dst) + length);
+	string_buffer_nonconst(dst)[string_length(dst)] = '\0';
+}
+
+irom static void config_arena_compact(void)
+{
+	config_entry_t *entry, *next;
+	unsigned int ix, cursor, size;
+
+	for(cursor = 0;; cursor += size)
+	{
+		next = (config_entry_t *)0;
+
+		for(ix = 0; ix < config_entries_length; ix++)
+		{
+			entry = &config_entries[ix];
+
+			if(!entry->id_length || (entry->offset < cursor))
+				continue;
+
+			if(!next || (entry->offset < next->offset))
+				next = entry;
+		}
+
+		if(!next)
+			break;
+
+		size = config_entry_arena_size(next);
+		memmove(&config_arena[cursor], &config_arena[next->offset], size);
+		next->offset = cursor;
+	}
+
+	config_arena_used = cursor;
+}
+
+irom static bool_t config_arena_alloc(unsigned int size, unsigned int *offset)
+{
+	if((config_arena_used + size) > config_arena_size)
+		config_arena_compact();
+
+	if((config_arena_used + size) > config_arena_size)
+		return(false);
+
+	*offset = config_arena_used;
+	config_arena_used += size;
+
+	return(true);
+}
+
+attr_const irom static unsigned int config_record_size(unsigned int id_length, unsigned int value_length)
+{
+	return((sizeof(config_record_header_t) + id_length + value_length + 3) & ~3U);
+}
+
+attr_const irom static unsigned int config_int_length(int value)
+{
+	unsigned int length, magnitude;
+
+	length = (value < 0) ? 2 : 1;
+	magnitude = (value < 0) ? (0U - (unsigned int)value) : (unsigned int)value;
+
+	for(; magnitude >= 10; magnitude /= 10)
+		length++;
+
+	return(length);
+}
+
+// size of the set record of an entry, without formatting its value
+
+attr_pure irom static unsigned int config_entry_record_size(const config_entry_t *entry)
+{
+	return(config_record_size(entry->id_length,
+			(entry->value_length == config_value_int_only) ? config_int_length(entry->int_value) : entry->value_length));
+}
+
+/*
+ * A snapshot sector is only left for the next one when the next record
+ * doesn't fit, so every sector but the last holds more than its space less
+ * the largest record. That bounds the sectors a snapshot of size bytes takes,
+ * whatever the order of the records.
+ */
+
+attr_const irom static unsigned int config_snapshot_sectors_bound(unsigned int size)
+{
+	return(1 + (size / (SPI_FLASH_SEC_SIZE - sizeof(config_sector_header_t) - sizeof(config_record_t) + 1)));
+}
+
+// sectors a snapshot of the current entries takes
+
+irom static unsigned int config_snapshot_sectors(void)
+{
+	const config_entry_t *entry;
+	unsigned int ix, size, offset, sectors;
+
+	offset = sizeof(config_sector_header_t);
+	sectors = 1;
+
+	for(ix = 0; ix <= config_entries_length; ix++)
+	{
+		if(ix == config_entries_length)
+			size = config_record_size(0, 0); // commit record
+		else
+		{
+			entry = &config_entries[ix];
+
+			if(!entry->id_length)
+				continue;
+
+			size = config_entry_record_size(entry);
+		}
+
+		if((offset + size) > SPI_FLASH_SEC_SIZE)
+		{
+			offset = sizeof(config_sector_header_t);
+			sectors++;
+		}
+
+		offset += size;
+	}
+
+	return(sectors);
+}
+
 irom static string_t *expand_varid(const string_t *varid, int index1, int index2)
 {
 	string_new(static, varid_in, 64);
 	string_new(static, varid_out, 64);
 
-	string_clear(&varid_in);
 	string_clear(&varid_out);
 
+	if(string_find(varid, 0, '%') < 0)
+	{
+		string_append_string(&varid_out, varid);
+		return(&varid_out);
+	}
+
+	string_clear(&varid_in);
 	string_append_string(&varid_in, varid);
 	string_format_cstr(&varid_out, string_to_cstr(&varid_in), index1, index2);
 
 	return(&varid_out);
 }
 
+attr_pure irom static unsigned int config_hash(const char *id, int length)
+{
+	uint32_t hash = 2166136261U;	// FNV-1a
+
+	while(length-- > 0)
+	{
+		hash ^= (uint8_t)*id++;
+		hash *= 16777619U;
+	}
+
+	return((hash >> 16) ^ (hash & 0xffff));
+}
+
+irom static void config_index_insert(unsigned int entry)
+{
+	unsigned int slot = config_entries_hash[entry];
+
+	while(config_index[slot & (config_index_size - 1)] != config_index_empty)
+		slot++;
+
+	config_index[slot & (config_index_size - 1)] = entry;
+	config_generation++;
+}
+
+irom static void config_index_rebuild(void)
+{
+	unsigned int ix;
+
+	memset(config_index, config_index_empty, sizeof(config_index));
+	config_generation++;
+	config_snapshot_size = config_record_size(0, 0);
+
+	for(ix = 0; ix < config_entries_length; ix++)
+	{
+		if(!config_entries[ix].id_length)
+			continue;
+
+		config_snapshot_size += config_entry_record_size(&config_entries[ix]);
+		config_entries_hash[ix] = config_hash(config_entry_id(&config_entries[ix]), config_entries[ix].id_length);
+		config_index_insert(ix);
+	}
+}
+
 irom static config_entry_t *find_config_entry(const string_t *id, int index1, int index2)
 {
 	config_entry_t *config_entry;
 	const string_t *varid;
-	unsigned int ix;
+	unsigned int hash, slot, entry;
 
 	varid = expand_varid(id, index1, index2);
+	hash = config_hash(string_buffer(varid), string_length(varid));
 
-	for(ix = 0; ix < config_entries_length; ix++)
+	for(slot = hash; (entry = config_index[slot & (config_index_size - 1)]) != config_index_empty; slot++)
 	{
-		config_entry = &config_entries[ix];
+		if(config_entries_hash[entry] != hash)
+			continue;
 
-		if(string_match_cstr(varid, config_entry->id))
+		config_entry = &config_entries[entry];
+
+		if((string_length(varid) == config_entry->id_length) &&
+				!memcmp(string_buffer(varid), config_entry_id(config_entry), config_entry->id_length))
 			return(config_entry);
 	}
 
@@ -207,7 +526,7 @@ irom bool_t config_get_string(const string_t *id, int index1, int index2, string
 	if(!(config_entry = find_config_entry(id, index1, index2)))
 		return(false);
 
-	string_format(value, "%s", config_entry->string_value);
+	config_entry_value(config_entry, value);
 
 	return(true);
 }
@@ -224,12 +543,73 @@ irom bool_t config_get_int(const string_t *id, int index1, int index2, int *valu
 	return(true);
 }
 
-irom bool_t config_set_string(const string_t *id, int index1, int index2, const string_t *value, int value_offset, int value_length)
+irom void config_bind(config_handle_t *handle, const string_t *id, int index1, int index2)
 {
-	string_t string;
 	string_t *varid;
+
+	varid = expand_varid(id, index1, index2);
+	strecpy(handle->id, string_to_cstr(varid), sizeof(handle->id));
+
+	handle->generation = config_generation - 1;
+	handle->entry = -1;
+}
+
+irom static config_entry_t *config_handle_resolve(config_handle_t *handle)
+{
+	config_entry_t *config_entry;
+	string_t varid;
+
+	if(handle->generation != config_generation)
+	{
+		varid = string_from_cstr(sizeof(handle->id), handle->id);
+
+		if((config_entry = find_config_entry(&varid, -1, -1)))
+			handle->entry = config_entry - config_entries;
+		else
+			handle->entry = -1;
+
+		handle->generation = config_generation;
+	}
+
+	if(handle->entry < 0)
+		return((config_entry_t *)0);
+
+	return(&config_entries[handle->entry]);
+}
+
+irom bool_t config_handle_get_string(config_handle_t *handle, string_t *value)
+{
+	config_entry_t *config_entry;
+
+	if(!(config_entry = config_handle_resolve(handle)))
+		return(false);
+
+	config_entry_value(config_entry, value);
+
+	return(true);
+}
+
+irom bool_t config_handle_get_int(config_handle_t *handle, int *value)
+{
+	config_entry_t *config_entry;
+
+	if(!(config_entry = config_handle_resolve(handle)))
+		return(false);
+
+	*value = config_entry->int_value;
+
+	return(true);
+}
+
+irom bool_t config_set_string(const string_t *id, int index1, int index2, const string_t *value, int value_offset, int value_length)
+{
+	string_new(stack, string, config_entry_string_size);
+	string_new(stack, current, config_entry_string_size + 8);
+	const string_t *varid;
 	config_entry_t *config_current;
-	unsigned int ix;
+	unsigned int ix, offset, length, snapshot_size;
+	int int_value;
+	bool_t int_only;
 
 	if(value_offset >= string_length(value))
 		value_offset = string_length(value) - 1;
@@ -244,39 +624,92 @@ irom bool_t config_set_string(const string_t *id, int index1, int index2, const
 		value_length = string_length(value) - value_offset;
 
 	if(value_length >= config_entry_string_size)
-		value_length = config_entry_string_size - 1;
+		return(false);
 
 	if(value_length < 0)
 		value_length = 0;
 
-	if(!(config_current = find_config_entry(id, index1, index2)))
+	string_splice(&string, value, value_offset, value_length);
+
+	// don't store a string copy of values that format back to exactly the same text
+
+	int_only = false;
+
+	if(parse_int(0, &string, &int_value, 0, ' ') == parse_ok)
 	{
-		for(ix = 0; ix < config_entries_length; ix++)
-		{
-			config_current = &config_entries[ix];
+		string_format(&current, "%d", int_value);
+		int_only = string_match_string(&current, &string);
+	}
+	else
+		int_value = -1;
 
-			if(!config_current->id[0])
-				break;
-		}
+	length = int_only ? 0 : string_length(&string);
 
-		if(ix >= config_entries_length)
+	if((config_current = find_config_entry(id, index1, index2)))
+	{
+		string_clear(&current);
+		config_entry_value(config_current, &current);
+
+		if(string_match_string(&current, &string))
+			return(true);
+
+		snapshot_size = config_snapshot_size - config_entry_record_size(config_current) +
+				config_record_size(config_current->id_length, string_length(&string));
+
+		if(config_snapshot_sectors_bound(snapshot_size) > config_snapshot_sectors_max)
+			return(false);
+
+		if(length > config_entry_string_length(config_current))
 		{
-			if((config_entries_length + 1) >= config_entries_size)
+			if(!config_arena_alloc(config_current->id_length + length, &offset))
 				return(false);
 
-			config_current = &config_entries[config_entries_length++];
+			memmove(&config_arena[offset], config_entry_id(config_current), config_current->id_length);
+			config_current->offset = offset;
 		}
-
+	}
+	else
+	{
 		varid = expand_varid(id, index1, index2);
-		strecpy(config_current->id, string_to_cstr(varid), config_entry_string_size);
+
+		if((string_length(varid) == 0) || (string_length(varid) >= config_entry_id_size))
+			return(false);
+
+		for(ix = 0; ix < config_entries_length; ix++)
+			if(!config_entries[ix].id_length)
+				break;
+
+		if((ix >= config_entries_length) && (config_entries_length >= config_entries_size))
+			return(false);
+
+		snapshot_size = config_snapshot_size + config_record_size(string_length(varid), string_length(&string));
+
+		if(config_snapshot_sectors_bound(snapshot_size) > config_snapshot_sectors_max)
+			return(false);
+
+		if(!config_arena_alloc(string_length(varid) + length, &offset))
+			return(false);
+
+		if(ix >= config_entries_length)
+			config_entries_length++;
+
+		config_current = &config_entries[ix];
+		config_current->offset = offset;
+		config_current->id_length = string_length(varid);
+		memcpy(&config_arena[offset], string_buffer(varid), config_current->id_length);
+
+		config_entries_hash[ix] = config_hash(config_entry_id(config_current), config_current->id_length);
+		config_index_insert(ix);
 	}
 
-	strecpy(config_current->string_value, string_buffer(value) + value_offset, value_length + 1);
+	config_current->value_length = int_only ? config_value_int_only : length;
+	config_current->int_value = int_value;
+	memcpy(&config_arena[config_current->offset + config_current->id_length], string_buffer(&string), length);
 
-	string = string_from_cstr(value_length + 1, config_current->string_value);
+	config_snapshot_size = snapshot_size;
 
-	if(parse_int(0, &string, &config_current->int_value, 0, ' ') != parse_ok)
-		config_current->int_value = -1;
+	ix = config_current - config_entries;
+	config_entries_dirty[ix / 32] |= 1U << (ix % 32);
 
 	return(true);
 }
@@ -292,150 +725,550 @@ irom bool_t config_set_int(const string_t *id, int index1, int index2, int value
 
 irom unsigned int config_delete(const string_t *id, int index1, int index2, bool_t wildcard)
 {
-	const char *varidptr;
+	const string_t *varid;
 	config_entry_t *config_current;
 	unsigned int ix;
 	unsigned int amount, length;
 
-	varidptr = string_to_cstr(expand_varid(id, index1, index2));
-	length = strlen(varidptr);
+	varid = expand_varid(id, index1, index2);
+	length = string_length(varid);
 
 	for(ix = 0, amount = 0; ix < config_entries_length; ix++)
 	{
 		config_current = &config_entries[ix];
 
-		if((wildcard && !strncmp(config_current->id, varidptr, length)) ||
-			(!wildcard && !strcmp(config_current->id, varidptr)))
+		if(!config_current->id_length)
+			continue;
+
+		if((wildcard && (config_current->id_length >= length) && !memcmp(config_entry_id(config_current), string_buffer(varid), length)) ||
+			(!wildcard && (config_current->id_length == length) && !memcmp(config_entry_id(config_current), string_buffer(varid), length)))
 		{
 			amount++;
-			config_current->id[0] = '\0';
-			config_current->string_value[0] = '\0';
-			config_current->int_value = '0';
+			config_current->id_length = 0;
+			config_current->value_length = 0;
+			config_current->int_value = 0;
 		}
 	}
 
+	if(amount > 0)
+	{
+		config_index_rebuild();
+		config_journal.compact = 1;
+	}
+
 	return(amount);
 }
 
-irom bool_t config_read(void)
+attr_const irom static uint32_t config_journal_address(unsigned int sector, unsigned int offset)
 {
-	string_new(stack, string, 64);
-	int current_index, id_index, id_length, value_index, value_length;
-	char current;
-	state_parse_t parse_state;
-	bool_t rv = false;
+	return(((USER_CONFIG_JOURNAL_SECTOR + sector) * SPI_FLASH_SEC_SIZE) + offset);
+}
 
-	config_options.using_logbuffer = 1;
-	string_clear(&logbuffer);
+// crc over a header or record with its own crc field taken as zero, result goes into the crc field
 
-	if(ota_is_active())
-		goto done;
+irom static void config_crc(char *buffer, unsigned int length, uint32_t *crc)
+{
+	string_t string;
 
-	if(string_size(&logbuffer) < SPI_FLASH_SEC_SIZE)
-		goto done;
+	*crc = 0;
+	string_set(&string, buffer, length, length);
+	*crc = string_crc32(&string, 0, length);
+}
 
-	if(spi_flash_read(USER_CONFIG_SECTOR * SPI_FLASH_SEC_SIZE, string_buffer_nonconst(&logbuffer), SPI_FLASH_SEC_SIZE) != SPI_FLASH_RESULT_OK)
-		goto done;
+irom static bool_t config_sector_header_read(unsigned int sector, config_sector_header_t *header)
+{
+	union
+	{
+		config_sector_header_t	header;
+		char					byte[sizeof(config_sector_header_t)];
+	} buffer;
 
-	string_setlength(&logbuffer, SPI_FLASH_SEC_SIZE);
+	if(spi_flash_read(config_journal_address(sector, 0), &buffer.header, sizeof(buffer.header)) != SPI_FLASH_RESULT_OK)
+		return(false);
 
-	string_append(&string, CONFIG_MAGIC);
-	string_append(&string, "\n");
+	*header = buffer.header;
 
-	current_index = string_length(&string);
+	if(header->magic != config_journal_magic)
+		return(false);
 
-	if(!string_nmatch_string(&logbuffer, &string, current_index))
-		goto done;
+	config_crc(buffer.byte, sizeof(buffer.byte), &buffer.header.crc);
 
-	id_index = current_index;
-	id_length = 0;
-	value_index = 0;
-	value_length = 0;
+	return(buffer.header.crc == header->crc);
+}
 
-	config_entries_length = 0;
+irom static bool_t config_sector_start(unsigned int sector, uint32_t sequence, uint32_t flags)
+{
+	unsigned int next;
+	union
+	{
+		config_sector_header_t	header;
+		char					byte[sizeof(config_sector_header_t)];
+	} buffer;
+
+	buffer.header.magic = config_journal_magic;
+	buffer.header.sequence = sequence;
+	buffer.header.flags = flags;
+	config_crc(buffer.byte, sizeof(buffer.byte), &buffer.header.crc);
+
+	if(spi_flash_erase_sector(USER_CONFIG_JOURNAL_SECTOR + sector) != SPI_FLASH_RESULT_OK)
+		return(false);
+
+	if(spi_flash_write(config_journal_address(sector, 0), &buffer.header, sizeof(buffer.header)) != SPI_FLASH_RESULT_OK)
+		return(false);
+
+	// a leftover sector from an interrupted write must not look like a continuation of this one
+
+	next = (sector + 1) % config_journal_sectors;
+
+	if(config_sector_header_read(next, &buffer.header) && (buffer.header.sequence > sequence) &&
+			(spi_flash_erase_sector(USER_CONFIG_JOURNAL_SECTOR + next) != SPI_FLASH_RESULT_OK))
+		return(false);
+
+	config_journal.head = sector;
+	config_journal.offset = sizeof(config_sector_header_t);
+	config_journal.sequence = sequence;
+	config_journal.live++;
+	config_journal.used += sizeof(config_sector_header_t);
+
+	return(true);
+}
+
+irom static config_record_status_t config_record_read(unsigned int sector, unsigned int offset, config_record_t *record, unsigned int *size)
+{
+	uint32_t crc;
+
+	if((offset + sizeof(config_record_header_t)) > SPI_FLASH_SEC_SIZE)
+		return(config_record_end);
+
+	if(spi_flash_read(config_journal_address(sector, offset), &record->header, sizeof(record->header)) != SPI_FLASH_RESULT_OK)
+		return(config_record_corrupt);
+
+	if(record->header.type == config_record_free)
+		return(config_record_end);
+
+	if((record->header.id_length >= config_entry_id_size) || (record->header.value_length >= config_entry_string_size))
+		return(config_record_corrupt);
+
+	*size = config_record_size(record->header.id_length, record->header.value_length);
+
+	if((offset + *size) > SPI_FLASH_SEC_SIZE)
+		return(config_record_corrupt);
+
+	if((*size > sizeof(config_record_header_t)) &&
+			(spi_flash_read(config_journal_address(sector, offset + sizeof(config_record_header_t)),
+				&record->word[sizeof(config_record_header_t) / sizeof(uint32_t)],
+				*size - sizeof(config_record_header_t)) != SPI_FLASH_RESULT_OK))
+		return(config_record_corrupt);
+
+	crc = record->header.crc;
+	config_crc(record->byte, *size, &record->header.crc);
+
+	if(record->header.crc != crc)
+		return(config_record_corrupt);
+
+	return(config_record_ok);
+}
+
+irom static bool_t config_record_write(config_record_t *record, unsigned int size)
+{
+	config_record_t verify;
 
-	for(parse_state = state_parse_id; current_index < SPI_FLASH_SEC_SIZE; current_index++)
+	if((config_journal.offset + size) > SPI_FLASH_SEC_SIZE)
+		return(false);
+
+	if(spi_flash_write(config_journal_address(config_journal.head, config_journal.offset), record->word, size) != SPI_FLASH_RESULT_OK)
+		return(false);
+
+	if(spi_flash_read(config_journal_address(config_journal.head, config_journal.offset), verify.word, size) != SPI_FLASH_RESULT_OK)
+		return(false);
+
+	config_journal.offset += size;
+	config_journal.used += size;
+
+	// don't append to a sector that doesn't read back correctly
+
+	if(memcmp(record->word, verify.word, size))
 	{
-		current = string_at(&logbuffer, current_index);
+		config_journal.offset = SPI_FLASH_SEC_SIZE;
+		return(false);
+	}
+
+	return(true);
+}
+
+irom static unsigned int config_record_build(config_record_t *record, config_record_type_t type, const config_entry_t *entry)
+{
+	unsigned int size;
+
+	memset(record, 0, sizeof(*record));
+	record->header.type = type;
+
+	if(entry)
+	{
+		string_new(stack, value, config_entry_string_size);
+
+		config_entry_value(entry, &value);
+		record->header.id_length = entry->id_length;
+		record->header.value_length = string_length(&value);
+		memcpy(record->payload, config_entry_id(entry), record->header.id_length);
+		memcpy(record->payload + record->header.id_length, string_buffer(&value), record->header.value_length);
+	}
+
+	size = config_record_size(record->header.id_length, record->header.value_length);
+	config_crc(record->byte, size, &record->header.crc);
+
+	return(size);
+}
+
+irom static bool_t config_journal_compact(void)
+{
+	config_journal_t saved;
+	config_record_t record;
+	unsigned int ix, size, sector;
+
+	if((config_snapshot_sectors() + (config_journal.valid ? config_journal.live : 0)) > config_journal_sectors)
+		return(false);
+
+	saved = config_journal;
+	sector = config_journal.valid ? ((config_journal.head + 1) % config_journal_sectors) : 0;
+
+	config_journal.live = 0;
+	config_journal.used = 0;
 
-		if(current == '\0')
+	if(!config_sector_start(sector, config_journal.sequence + 1, config_journal_flag_snapshot))
+		goto error;
+
+	for(ix = 0; ix <= config_entries_length; ix++)
+	{
+		if(ix < config_entries_length)
 		{
-			rv = true;
-			goto done;
+			if(!config_entries[ix].id_length)
+				continue;
+
+			size = config_record_build(&record, config_record_set, &config_entries[ix]);
 		}
+		else
+			size = config_record_build(&record, config_record_commit, (const config_entry_t *)0);
 
-		if(current == '\r')
-			continue;
+		if((config_journal.offset + size) > SPI_FLASH_SEC_SIZE)
+		{
+			sector = (config_journal.head + 1) % config_journal_sectors;
+
+			if(!config_sector_start(sector, config_journal.sequence + 1, 0))
+				goto error;
+		}
+
+		if(!config_record_write(&record, size))
+			goto error;
+	}
+
+	config_journal.valid = 1;
+	config_journal.compact = 0;
+	return(true);
+
+error:
+	config_journal = saved;
+	config_journal.compact = 1;
+	return(false);
+}
+
+irom static bool_t config_journal_append(const config_entry_t *entry)
+{
+	config_record_t record;
+	unsigned int size, sector;
+
+	size = config_record_build(&record, entry ? config_record_set : config_record_commit, entry);
+
+	if((config_journal.offset + size) > SPI_FLASH_SEC_SIZE)
+	{
+		if((config_journal.live + config_snapshot_sectors_max) >= config_journal_sectors)
+			return(false);
+
+		sector = (config_journal.head + 1) % config_journal_sectors;
+
+		if(!config_sector_start(sector, config_journal.sequence + 1, 0))
+			return(false);
+	}
+
+	return(config_record_write(&record, size));
+}
+
+/*
+ * Walk the chain of sectors starting with the snapshot in sector start. The
+ * first apply records are applied to the config, the others are only
+ * counted. Returns the number of records up to and including the last
+ * commit record, with head and offset set to the end of the chain.
+ */
+
+irom static unsigned int config_journal_scan(unsigned int start, const config_sector_header_t *headers, const bool_t *headers_valid,
+		unsigned int apply, bool_t *torn)
+{
+	config_record_t record;
+	config_record_status_t status;
+	string_t id, value;
+	unsigned int sector, next, offset, size, records, committed;
+
+	config_journal.live = 0;
+	config_journal.used = 0;
+	records = 0;
+	committed = 0;
+	*torn = false;
+
+	for(sector = start;; sector = next)
+	{
+		config_journal.live++;
+		config_journal.used += sizeof(config_sector_header_t);
 
-		switch(parse_state)
+		for(offset = sizeof(config_sector_header_t);; offset += size)
 		{
-			case(state_parse_id):
+			if((status = config_record_read(sector, offset, &record, &size)) != config_record_ok)
+				break;
+
+			config_journal.used += size;
+			records++;
+
+			if(record.header.type == config_record_commit)
+				committed = records;
+			else if((record.header.type == config_record_set) && (record.header.id_length > 0) && (records <= apply))
 			{
-				if(current == '=')
-				{
-					id_length = current_index - id_index;
+				string_set(&id, record.payload, record.header.id_length, record.header.id_length);
+				string_set(&value, record.payload + record.header.id_length, record.header.value_length, record.header.value_length);
+				config_set_string(&id, -1, -1, &value, 0, record.header.value_length);
+			}
+		}
 
-					value_index = current_index + 1;
-					value_length = 0;
+		// skip the rest of a sector after a torn write, appends after it have gone into the next sector
 
-					parse_state = state_parse_value;
-					continue;
-				}
+		if(status == config_record_corrupt)
+		{
+			offset = SPI_FLASH_SEC_SIZE;
+			*torn = true;
+		}
 
-				if(current == '\n')
-				{
-					parse_state = state_parse_eol;
-					continue;
-				}
+		next = (sector + 1) % config_journal_sectors;
 
-				break;
+		if((next == start) || !headers_valid[next] ||
+				(headers[next].sequence != (headers[sector].sequence + 1)) ||
+				(headers[next].flags & config_journal_flag_snapshot))
+			break;
+	}
+
+	config_journal.head = sector;
+	config_journal.offset = offset;
+	config_journal.sequence = headers[sector].sequence;
+
+	if(records > committed)
+		*torn = true;
+
+	return(committed);
+}
+
+/*
+ * Every config_write() ends with a commit record, the records of a write
+ * that was interrupted before its commit record are left out. Appending
+ * after them would commit them along with the next write, so in that case
+ * the next write makes a fresh snapshot instead.
+ */
+
+irom static bool_t config_journal_replay(unsigned int start, const config_sector_header_t *headers, const bool_t *headers_valid)
+{
+	unsigned int committed;
+	bool_t torn;
+
+	config_entries_length = 0;
+	config_arena_used = 0;
+	config_index_rebuild();
+
+	if(!(committed = config_journal_scan(start, headers, headers_valid, 0, &torn)))
+		return(false);
+
+	config_journal_scan(start, headers, headers_valid, committed, &torn);
+
+	config_journal.valid = 1;
+	config_journal.compact = torn ? 1 : 0;
+
+	return(true);
+}
+
+irom static bool_t config_journal_read(void)
+{
+	config_sector_header_t headers[config_journal_sectors];
+	bool_t headers_valid[config_journal_sectors];
+	unsigned int sector, start = 0;
+	uint32_t sequence;
+	bool_t found;
+
+	string_crc32_init();
+
+	config_journal.valid = 0;
+	config_journal.sequence = 0;
+
+	for(sector = 0; sector < config_journal_sectors; sector++)
+		if((headers_valid[sector] = config_sector_header_read(sector, &headers[sector])) &&
+				(headers[sector].sequence > config_journal.sequence))
+			config_journal.sequence = headers[sector].sequence;
+
+	// try the snapshots from newest to oldest, a snapshot without commit record is skipped
+
+	for(sequence = config_journal.sequence + 1;;)
+	{
+		found = false;
+
+		for(sector = 0; sector < config_journal_sectors; sector++)
+		{
+			if(!headers_valid[sector] || !(headers[sector].flags & config_journal_flag_snapshot) || (headers[sector].sequence >= sequence))
+				continue;
+
+			if(!found || (headers[sector].sequence > headers[start].sequence))
+			{
+				found = true;
+				start = sector;
 			}
+		}
+
+		if(!found)
+			break;
+
+		if(config_journal_replay(start, headers, headers_valid))
+			return(true);
+
+		sequence = headers[start].sequence;
+	}
+
+	config_entries_length = 0;
+	config_arena_used = 0;
+	config_index_rebuild();
+
+	config_journal.live = 0;
+	config_journal.used = 0;
+
+	return(false);
+}
+
+irom static bool_t config_read_legacy(void)
+{
+	string_new(stack, magic, 16);
+	string_new(stack, id, 64);
+	string_new(stack, value, 64);
+	string_t chunk;
+	union
+	{
+		uint32_t	word[16];
+		char		byte[64];
+	} buffer;
+	unsigned int offset, ix;
+	char current;
+	state_parse_t parse_state;
 
-			case(state_parse_value):
+	string_append(&magic, CONFIG_MAGIC);
+	string_append(&magic, "\n");
+
+	parse_state = state_parse_id;
+
+	// stream the sector through a small buffer instead of reading it in one go
+
+	for(offset = 0; offset < SPI_FLASH_SEC_SIZE; offset += sizeof(buffer))
+	{
+		if(spi_flash_read((USER_CONFIG_SECTOR * SPI_FLASH_SEC_SIZE) + offset, buffer.word, sizeof(buffer)) != SPI_FLASH_RESULT_OK)
+			return(false);
+
+		ix = 0;
+
+		if(offset == 0)
+		{
+			string_set(&chunk, buffer.byte, sizeof(buffer.byte), sizeof(buffer.byte));
+
+			if(!string_nmatch_string(&chunk, &magic, string_length(&magic)))
+				return(false);
+
+			ix = string_length(&magic);
+
+			config_entries_length = 0;
+			config_arena_used = 0;
+			config_index_rebuild();
+		}
+
+		for(; ix < sizeof(buffer.byte); ix++)
+		{
+			current = buffer.byte[ix];
+
+			if(current == '\0')
+				return(true);
+
+			if(current == '\r')
+				continue;
+
+			switch(parse_state)
 			{
-				if(current == '\n')
+				case(state_parse_id):
 				{
-					if((id_index > 0) && (id_length > 0) && (value_index > 0))
+					if(current == '=')
 					{
-						value_length = current_index - value_index;
-
-						string_clear(&string);
-						string_splice(&string, &logbuffer, id_index, id_length);
+						string_clear(&value);
+						parse_state = state_parse_value;
+						continue;
+					}
 
-						config_set_string(&string, -1, -1, &logbuffer, value_index, value_length);
+					if(current == '\n')
+					{
+						parse_state = state_parse_eol;
+						continue;
 					}
 
-					parse_state = state_parse_eol;
-					continue;
-				}
+					string_append_char(&id, current);
 
-				break;
-			}
+					break;
+				}
 
-			case(state_parse_eol):
-			{
-				if(current == '\n')
+				case(state_parse_value):
 				{
-					rv = true;
-					goto done;
+					if(current == '\n')
+					{
+						if(string_length(&id) > 0)
+							config_set_string(&id, -1, -1, &value, 0, -1);
+
+						parse_state = state_parse_eol;
+						continue;
+					}
+
+					string_append_char(&value, current);
+
+					break;
 				}
 
-				id_index = current_index;
-				parse_state = state_parse_id;
+				case(state_parse_eol):
+				{
+					if(current == '\n')
+						return(true);
 
-				break;
-			}
+					string_clear(&id);
+					string_append_char(&id, current);
+					parse_state = state_parse_id;
 
-			default:
-			{
-				goto done;
+					break;
+				}
+
+				default:
+				{
+					return(false);
+				}
 			}
 		}
 	}
 
-done:
-	string_clear(&logbuffer);
-	config_options.using_logbuffer = 0;
+	return(false);
+}
+
+irom bool_t config_read(void)
+{
+	bool_t rv;
+
+	// fall back to the text format config from before the journal, it will be converted on the next write
+
+	if(!(rv = config_journal_read()))
+		rv = config_read_legacy();
+
+	memset(config_entries_dirty, 0, sizeof(config_entries_dirty));
 
 	string_init(varname, "flags");
 
@@ -452,88 +1285,93 @@ done:
 
 irom unsigned int config_write(void)
 {
-	config_entry_t *entry;
-	unsigned int ix, length = 0;
-	uint32_t crc1, crc2;
-	bool_t rv = false;
-
-	config_options.using_logbuffer = 1;
-	string_clear(&logbuffer);
+	unsigned int ix;
+	bool_t rv, appended;
 
 	if(ota_is_active())
-		goto error;
-
-	if(string_size(&logbuffer) < SPI_FLASH_SEC_SIZE)
-		goto error;
+		return(0);
 
-	string_clear(&logbuffer);
-	string_append(&logbuffer, CONFIG_MAGIC);
-	string_append(&logbuffer, "\n");
+	string_crc32_init();
 
-	for(ix = 0; ix < config_entries_length; ix++)
+	if(!config_journal.valid || config_journal.compact)
+		rv = config_journal_compact();
+	else
 	{
-		entry = &config_entries[ix];
-
-		if(!entry->id[0])
-			continue;
-
-		string_format(&logbuffer, "%s=%s\n", entry->id, entry->string_value);
-	}
+		for(ix = 0, appended = false, rv = true; rv && (ix < config_entries_length); ix++)
+			if((config_entries_dirty[ix / 32] & (1U << (ix % 32))) && config_entries[ix].id_length)
+				rv = appended = config_journal_append(&config_entries[ix]);
 
-	string_append(&logbuffer, "\n");
+		// the changes only count once the commit record is in
 
-	length = string_length(&logbuffer);
+		if(rv && appended)
+			rv = config_journal_append((const config_entry_t *)0);
 
-	if(length > (4096 - 32))
-		goto error;
-
-	while(string_length(&logbuffer) < SPI_FLASH_SEC_SIZE)
-		string_append_char(&logbuffer, '.');
-
-	string_crc32_init();
-	crc1 = string_crc32(&logbuffer, 0, SPI_FLASH_SEC_SIZE);
+		if(!rv)
+			rv = config_journal_compact();
+	}
 
-	if(spi_flash_erase_sector(USER_CONFIG_SECTOR) != SPI_FLASH_RESULT_OK)
-		goto error;
+	if(!rv)
+		return(0);
 
-	if(spi_flash_write(USER_CONFIG_SECTOR * SPI_FLASH_SEC_SIZE, string_buffer(&logbuffer), SPI_FLASH_SEC_SIZE) != SPI_FLASH_RESULT_OK)
-		goto error;
+	memset(config_entries_dirty, 0, sizeof(config_entries_dirty));
 
-	if(spi_flash_read(USER_CONFIG_SECTOR * SPI_FLASH_SEC_SIZE, string_buffer_nonconst(&logbuffer), SPI_FLASH_SEC_SIZE) != SPI_FLASH_RESULT_OK)
-		goto error;
+	return(config_journal.used);
+}
 
-	string_setlength(&logbuffer, SPI_FLASH_SEC_SIZE);
+irom bool_t config_dump(string_t *dst, unsigned int *cursor)
+{
+	config_entry_t *config_current;
+	unsigned int ix, in_use = 0, int_only = 0, live = 0;
+	int original_length = string_length(dst);
+	char id[config_entry_id_size];
 
-	crc2 = string_crc32(&logbuffer, 0, SPI_FLASH_SEC_SIZE);
+	for(ix = *cursor; ix < config_entries_length; ix++)
+	{
+		config_current = &config_entries[ix];
 
-	if(crc1 != crc2)
-		goto error;
+		if(!config_current->id_length)
+			continue;
 
-	rv = true;
+		if((string_length(dst) != original_length) && application_part_full(dst))
+		{
+			*cursor = ix;
+			return(false);
+		}
 
-error:
-	string_clear(&logbuffer);
-	config_options.using_logbuffer = 0;
+		memcpy(id, config_entry_id(config_current), config_current->id_length);
+		id[config_current->id_length] = '\0';
 
-	return(rv ? length : 0);
-}
+		string_format(dst, "%s=", id);
+		config_entry_value(config_current, dst);
+		string_format(dst, " (%d)\n", config_current->int_value);
+	}
 
-irom void config_dump(string_t *dst)
-{
-	config_entry_t *config_current;
-	unsigned int ix, in_use = 0;
+	if((string_length(dst) != original_length) && application_part_full(dst))
+	{
+		*cursor = config_entries_length;
+		return(false);
+	}
 
 	for(ix = 0; ix < config_entries_length; ix++)
 	{
 		config_current = &config_entries[ix];
 
-		if(!config_current->id[0])
+		if(!config_current->id_length)
 			continue;
 
 		in_use++;
 
-		string_format(dst, "%s=%s (%d)\n", config_current->id, config_current->string_value, config_current->int_value);
+		if(config_current->value_length == config_value_int_only)
+			int_only++;
+
+		live += config_entry_arena_size(config_current);
 	}
 
-	string_format(dst, "\nslots total: %u, config items: %u, free slots: %u\n", config_entries_size, in_use, config_entries_size - in_use);
+	string_format(dst, "\nslots total: %u, config items: %u, free slots: %u, integer only: %u\n", config_entries_size, in_use, config_entries_size - in_use, int_only);
+	string_format(dst, "arena: bytes used %u of %u, live %u\n", config_arena_used, config_arena_size, live);
+	string_format(dst, "journal sectors: %u, sector in use: %u, sequence: %u, sectors live: %u, bytes used: %u%s\n",
+			config_journal_sectors, config_journal.head, config_journal.sequence, config_journal.live, config_journal.used,
+			config_journal.valid ? "" : " (not written yet)");
+
+	return(true);
 }
@@ -30,10 +30,18 @@ typedef union
 	uint32_t intval;
 } config_flags_t;
 
+enum
+{
+	config_entry_id_size = 32,
+	config_entry_string_size = 64,
+};
+
 typedef struct
 {
-	unsigned int using_logbuffer:1;
-} config_options_t;
+	unsigned int	generation;
+	int				entry;
+	char			id[config_entry_id_size];
+} config_handle_t;
 
 void			config_flags_to_string(string_t *);
 bool_t			config_flags_change(const string_t *, bool_t add);
@@ -44,21 +52,29 @@ bool_t			config_set_string(const string_t *id, int index1, int index2, const str
 bool_t			config_set_int(const string_t *id, int index1, int index2, int value);
 unsigned int	config_delete(const string_t *id, int index1, int index2, bool_t wildcard);
 
+void			config_bind(config_handle_t *handle, const string_t *id, int index1, int index2);
+bool_t			config_handle_get_string(config_handle_t *handle, string_t *value);
+bool_t			config_handle_get_int(config_handle_t *handle, int *value);
+
 bool_t			config_read(void);
 unsigned int	config_write(void);
-void			config_dump(string_t *);
+bool_t			config_dump(string_t *, unsigned int *cursor);
 
 extern config_flags_t flags_cache;
-extern config_options_t config_options;
 
 always_inline static config_flags_t config_flags_get(void)
 {
 	return(flags_cache);
 }
 
-always_inline static attr_pure bool_t config_uses_logbuffer(void)
+always_inline static attr_pure bool_t config_handle_bound(const config_handle_t *handle)
+{
+	return(handle->id[0] != '\0');
+}
+
+always_inline static attr_const unsigned int config_size(void)
 {
-	return(config_options.using_logbuffer != 0);
+	return(USER_CONFIG_JOURNAL_SECTORS * SPI_FLASH_SEC_SIZE);
 }
 
 #endif
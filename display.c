@@ -517,10 +517,13 @@ irom app_action_t application_function_display_dump(const string_t *src, string_
 irom app_action_t application_function_display_default_message(const string_t *src, string_t *dst)
 {
 	int ix;
+	string_t trimmed = *src;
 	string_init(varname_defaultmsg, "display.defaultmsg");
 
-	if(((ix = string_sep(src, 0, 1, ' ')) > 0) &&
-			!config_set_string(&varname_defaultmsg, -1, -1, src, ix, string_length(src) - ix - 1))
+	string_trim_nl(&trimmed);
+
+	if(((ix = parse_offset(1, src, ' ')) > 0) &&
+			!config_set_string(&varname_defaultmsg, -1, -1, src, ix, string_length(&trimmed) - ix))
 	{
 		string_append(dst, "> cannot set config\n");
 		return(app_action_error);
@@ -30,11 +30,18 @@ roflash static const char roflash_http_header_ok[] =
 {
 	"200 OK\r\n"
 	"Content-Type: text/html; charset=UTF-8\r\n"
-	"Content-Length: @@@@\r\n"
+	"Content-Length: @@@@@\r\n"
 	"Connection: close\r\n"
 	"\r\n"
 };
 
+enum
+{
+	http_content_length_prefix = sizeof("Content-Length: ") - 1,
+	http_content_length_digits = sizeof("@@@@@") - 1,
+	http_content_length_eol = sizeof("\r\n") - 1,
+};
+
 roflash static const char roflash_http_header_error[] =
 {
 	"Content-Type: text/html; charset=UTF-8\r\n"
@@ -135,6 +142,60 @@ irom static void http_range_form(string_t *dst, int io, int pin, int low, int hi
 	string_append(dst,		"</form>\n");
 }
 
+irom static void http_frequency_info(string_t *dst, int io, int pin)
+{
+	unsigned int frequency, period, duty;
+
+	if(io_read_frequency((string_t *)0, io, pin, &frequency, &period, &duty) != io_ok)
+		frequency = period = duty = 0;
+
+	string_append(dst,		"<div class=\"div\">\n");
+	string_format(dst,	"	%d/%d frequency: %u.%03u Hz, period: %u us, duty: %u.%u %%\n", io, pin,
+			frequency / 1000, frequency % 1000, period, duty / 10, duty % 10);
+	string_append(dst,		"</div>\n");
+}
+
+/*
+ * Fill in the Content-Length placeholder of the header at the start of dst.
+ * If the page is sent in several parts, the length isn't known when the
+ * header goes out, so the field is left out instead; the end of the page is
+ * then marked by closing the connection ("Connection: close").
+ */
+
+irom static bool_t http_content_length(string_t *dst, int length)
+{
+	string_new(, digits, 16);
+	char *buffer = string_buffer_nonconst(dst);
+	int ix, offset, remove, tail;
+
+	if((ix = string_find(dst, 0, '@')) < http_content_length_prefix)
+		return(false);
+
+	if(length < 0)
+	{
+		offset = ix - http_content_length_prefix;
+		remove = http_content_length_prefix + http_content_length_digits + http_content_length_eol;
+	}
+	else
+	{
+		string_format(&digits, "%d", length);
+
+		if(string_length(&digits) > http_content_length_digits)
+			return(false);
+
+		memcpy(buffer + ix, string_buffer(&digits), string_length(&digits));
+		offset = ix + string_length(&digits);
+		remove = http_content_length_digits - string_length(&digits);
+	}
+
+	tail = string_length(dst) - offset - remove;
+
+	memmove(buffer + offset, buffer + offset + remove, tail);
+	string_setlength(dst, offset + tail);
+
+	return(true);
+}
+
 irom static app_action_t http_error(string_t *dst, const char *error_string, const char *info)
 {
 	static const char delim[] = ": ";
@@ -173,10 +234,13 @@ irom app_action_t application_function_http_get(const string_t *src, string_t *d
 	string_new(, url, 64);
 	string_new(, afterslash, 64);
 	string_new(, action, 64);
-	int ix, length;
+	int length;
+	unsigned int cursor;
 	const http_handler_t *handler;
 	app_action_t error;
 
+	cursor = application_cursor();
+
 	if((parse_string(1, src, &url, ' ')) != parse_ok)
 		return(http_error(dst, "400 Bad Request 1", "no url"));
 
@@ -199,30 +263,38 @@ irom app_action_t application_function_http_get(const string_t *src, string_t *d
 	if(!handler->action || !handler->handler)
 		return(http_error(dst, "404 Not Found", string_to_cstr(&action)));
 
-	string_clear(dst);
-	string_append_cstr_flash(dst, roflash_http_header_pre);
-	string_append_cstr_flash(dst, roflash_http_header_ok);
-	string_append_cstr_flash(dst, roflash_html_header);
+	// the header only goes out with the first part of the page
+
+	if(cursor == 0)
+	{
+		string_clear(dst);
+		string_append_cstr_flash(dst, roflash_http_header_pre);
+		string_append_cstr_flash(dst, roflash_http_header_ok);
+		string_append_cstr_flash(dst, roflash_html_header);
+	}
 
 	error = handler->handler(&afterslash, dst);
 
+	if(error == app_action_more)
+	{
+		if((cursor == 0) && !http_content_length(dst, -1))
+			return(http_error(dst, "501 Not Implemented", 0));
+
+		return(app_action_more);
+	}
+
 	string_append_cstr_flash(dst, roflash_html_link_home);
 	string_append_cstr_flash(dst, roflash_html_footer);
 
+	if(cursor != 0)
+		return(error);
+
 	if((length = string_length(dst) - (sizeof(roflash_http_header_pre) - 1) - (sizeof(roflash_http_header_ok) - 1)) <= 0)
 		return(http_error(dst, "500 Internal Server Error", 0));
 
-	if((ix = string_find(dst, 0, '@')) <= 0)
+	if(!http_content_length(dst, length))
 		return(http_error(dst, "501 Not Implemented", 0));
 
-	string_replace(dst, ix + 0, (length / 1000) + '0');
-	length %= 1000;
-	string_replace(dst, ix + 1, (length / 100) + '0');
-	length %= 100;
-	string_replace(dst, ix + 2, (length / 10) + '0');
-	length %= 10;
-	string_replace(dst, ix + 3, (length / 1) + '0');
-
 	return(error);
 }
 
@@ -247,12 +319,30 @@ irom static app_action_t handler_controls(const string_t *src, string_t *dst)
 	int				io, pin;
 	int				low, high, step, current;
 	io_pin_mode_t	mode;
+	unsigned int	cursor;
+	bool_t			emitted = false;
+
+	for(cursor = application_cursor(); cursor < (io_id_size * max_pins_per_io); cursor++)
+	{
+		io = cursor / max_pins_per_io;
+		pin = cursor % max_pins_per_io;
+
+		if((io_traits(0, io, pin, &mode, &low, &high, &step, &current) == io_ok) && ((high > 0) || (mode == io_pin_frequency)))
+		{
+			if(emitted && application_part_full(dst))
+			{
+				application_cursor_set(cursor);
+				return(app_action_more);
+			}
 
-	for(io = 0; io < io_id_size; io++)
-		for(pin = 0; pin < max_pins_per_io; pin++)
-			if(io_traits(0, io, pin, &mode, &low, &high, &step, &current) == io_ok)
-				if(high > 0)
-					http_range_form(dst, io, pin, low, high, step, current);
+			if(mode == io_pin_frequency)
+				http_frequency_info(dst, io, pin);
+			else
+				http_range_form(dst, io, pin, low, high, step, current);
+
+			emitted = true;
+		}
+	}
 
 	return(app_action_http_ok);
 }
@@ -366,6 +456,17 @@ irom static app_action_t handler_info_stats(const string_t *src, string_t *dst)
 	return(app_action_http_ok);
 }
 
+irom static app_action_t handler_info_commands(const string_t *src, string_t *dst)
+{
+	string_append_cstr_flash(dst, roflash_html_table_start);
+	string_append(dst, "<tr><td><pre>");
+	application_stats_commands(dst);
+	string_append(dst, "</pre></td></tr>");
+	string_append_cstr_flash(dst, roflash_html_table_end);
+
+	return(app_action_http_ok);
+}
+
 irom static app_action_t handler_info_wlan(const string_t *src, string_t *dst)
 {
 	string_append_cstr_flash(dst, roflash_html_table_start);
@@ -379,7 +480,13 @@ irom static app_action_t handler_info_wlan(const string_t *src, string_t *dst)
 
 irom static app_action_t handler_io(const string_t *src, string_t *dst)
 {
-	io_config_dump(dst, -1, -1, true);
+	unsigned int cursor = application_cursor();
+
+	if(!io_config_dump(dst, -1, -1, true, &cursor))
+	{
+		application_cursor_set(cursor);
+		return(app_action_more);
+	}
 
 	return(app_action_http_ok);
 }
@@ -389,21 +496,37 @@ irom static app_action_t handler_sensors(const string_t *src, string_t *dst)
 	i2c_sensor_t sensor;
 	int bus;
 	int detected = 0;
+	unsigned int cursor, first;
 
-	string_append_cstr_flash(dst, roflash_html_table_start);
-	string_append(dst, "<tr><th>bus</th><th>sensor</th><th>address</th><th>name</th><th>type</th><th>value</th></tr>\n");
+	first = application_cursor();
+
+	if(first == 0)
+	{
+		string_append_cstr_flash(dst, roflash_html_table_start);
+		string_append(dst, "<tr><th>bus</th><th>sensor</th><th>address</th><th>name</th><th>type</th><th>value</th></tr>\n");
+	}
+
+	for(cursor = first; cursor < (i2c_busses * i2c_sensor_size); cursor++)
+	{
+		bus = cursor / i2c_sensor_size;
+		sensor = cursor % i2c_sensor_size;
 
-	for(bus = 0; bus < i2c_busses; bus++)
-		for(sensor = 0; sensor < i2c_sensor_size; sensor++)
-			if(i2c_sensor_detected(bus, sensor))
+		if(i2c_sensor_detected(bus, sensor))
+		{
+			if((detected > 0) && application_part_full(dst))
 			{
-				string_append(dst, "<tr><td>");
-				i2c_sensor_read(dst, bus, sensor, false, true);
-				string_append(dst, "</td></tr>\n");
-				detected++;
+				application_cursor_set(cursor);
+				return(app_action_more);
 			}
 
-	if(detected < 1)
+			string_append(dst, "<tr><td>");
+			i2c_sensor_read(dst, bus, sensor, false, true);
+			string_append(dst, "</td></tr>\n");
+			detected++;
+		}
+	}
+
+	if((first == 0) && (detected < 1))
 		string_append(dst, "<tr><td colspan=\"6\">no sensors detected</td></tr>\n");
 
 	string_append_cstr_flash(dst, roflash_html_table_end);
@@ -526,6 +649,11 @@ static const http_handler_t handlers[] =
 		"info_stats",
 		handler_info_stats
 	},
+	{
+		"Command execution times",
+		"info_commands",
+		handler_info_commands
+	},
 	{
 		"List all I/O's",
 		"io",
@@ -2,11 +2,20 @@
 
 #include "util.h"
 #include "config.h"
+#include "user_main.h"
+
+#include <user_interface.h>
+
+/*
+ * All values are kept in integer fixed point, "cooked" is in 1/1000 of the
+ * unit (e.g. millidegrees or millilux), "raw" is the value as read from the
+ * sensor, the lx106 has no fpu and emulating doubles is very expensive.
+ */
 
 typedef struct
 {
-	double raw;
-	double cooked;
+	int32_t raw;
+	int32_t cooked;
 } value_t;
 
 typedef struct attr_packed
@@ -26,10 +35,71 @@ typedef struct device_table_entry_T
 	uint8_t precision;
 	i2c_error_t (* const init_fn)(int bus, const struct device_table_entry_T *);
 	i2c_error_t (* const read_fn)(int bus, const struct device_table_entry_T *, value_t *);
+	i2c_error_t (* const sample_fn)(int bus, const struct device_table_entry_T *, unsigned int *state, value_t *, unsigned int *delay);
 } device_table_entry_t;
 
+/*
+ * Sensors that need to wait for a conversion have a sample_fn instead of a
+ * read_fn. It's called with *state = 0 first, does one step and then either
+ * sets *delay to the number of milliseconds to wait before it's called again
+ * (with the *state it left) or leaves *delay at 0 when the value is complete.
+ */
+
 device_data_t device_data[i2c_sensor_size];
 
+enum
+{
+	sensor_cache_size = 16,
+	sensor_sample_gap = 10,			// ms between two sensors
+	sensor_sample_interval = 1000,	// ms between the start of two rounds
+};
+
+typedef struct
+{
+	i2c_sensor_t	sensor;		// i2c_sensor_error = unused
+	uint8_t			bus;
+	uint8_t			valid;
+	uint8_t			spare;
+	i2c_error_t		error;		// of the last attempt
+	uint32_t		timestamp;	// of the last valid value
+	value_t			value;
+} sensor_cache_t;
+
+static sensor_cache_t sensor_cache[sensor_cache_size];
+
+static struct
+{
+	unsigned int	running:1;
+	unsigned int	due:1;
+	unsigned int	active:1;
+	unsigned int	position;
+	unsigned int	bus;
+	i2c_sensor_t	sensor;
+	unsigned int	state;
+	uint32_t		round_start;
+	value_t			value;
+	ETSTimer		timer;
+} sampler;
+
+irom static i2c_error_t sensor_sample_sync(int bus, const device_table_entry_t *entry, value_t *value)
+{
+	i2c_error_t error;
+	unsigned int state, delay;
+
+	for(state = 0;;)
+	{
+		delay = 0;
+
+		if((error = entry->sample_fn(bus, entry, &state, value, &delay)) != i2c_error_ok)
+			return(error);
+
+		if(delay == 0)
+			return(i2c_error_ok);
+
+		msleep(delay);
+	}
+}
+
 irom static i2c_error_t sensor_digipicco_temp_init(int bus, const device_table_entry_t *entry)
 {
 	i2c_error_t error;
@@ -50,7 +120,7 @@ irom static i2c_error_t sensor_digipicco_temp_read(int bus, const device_table_e
 		return(error);
 
 	value->raw = ((uint16_t)i2cbuffer[2] << 8) | (uint16_t)i2cbuffer[3];
-	value->cooked = ((value->raw * 165.0) / 32767.0) - 40.5;
+	value->cooked = ((value->raw * 20625) / 4096) - 40500;	// raw * 165000 / 32768
 
 	return(i2c_error_ok);
 }
@@ -72,7 +142,7 @@ irom static i2c_error_t sensor_digipicco_hum_read(int bus, const device_table_en
 		return(error);
 
 	value->raw = ((uint16_t)i2cbuffer[0] << 8) | (uint16_t)i2cbuffer[1];
-	value->cooked = (value->raw * 100.0) / 32768.0;
+	value->cooked = (value->raw * 3125) / 1024;				// raw * 100000 / 32768
 
 	return(i2c_error_ok);
 }
@@ -114,10 +184,10 @@ irom static i2c_error_t sensor_ds1631_read(int bus, const device_table_entry_t *
 	if(raw & 0x8000)
 	{
 		raw &= ~(uint32_t)0x8000;
-		value->cooked = (double)raw / -256;
+		value->cooked = (raw * -1000) / 256;
 	}
 	else
-		value->cooked = (double)raw / 256;
+		value->cooked = (raw * 1000) / 256;
 
 	return(i2c_error_ok);
 }
@@ -182,10 +252,7 @@ irom static i2c_error_t sensor_lm75_read(int bus, const device_table_entry_t *en
 		return(error);
 
 	value->raw = (i2c_buffer[0] << 8) | (i2c_buffer[1] << 0);
-	value->cooked = value->raw / 256;
-
-	if(value->cooked > 127)
-		value->cooked -= 256;
+	value->cooked = ((int16_t)value->raw * 1000) / 256;
 
 	return(i2c_error_ok);
 }
@@ -202,6 +269,7 @@ static struct
 	int16_t		b2;
 	int16_t		mc;
 	int16_t		md;
+	int32_t		b5;
 } bmp085;
 
 irom static i2c_error_t bmp085_write_reg_1(int address, int reg, unsigned int value)
@@ -246,88 +314,134 @@ irom static i2c_error_t bmp085_read_reg_3(int address, int reg, uint32_t *value)
 	return(0);
 }
 
-irom static i2c_error_t bmp085_read(int address, value_t *rv_temperature, value_t *rv_airpressure)
+/*
+ * Integer compensation as in the datasheet (BST-BMP085-DS000 section 3.5),
+ * divisions by powers of two are arithmetic shifts like in the reference
+ * code, they round towards minus infinity where a division would truncate.
+ * Temperature is b5, in 1/16 of 0.1 C, pressure is in Pa.
+ */
+
+irom static bool_t bmp085_compensate_temperature(int32_t ut, int32_t *b5)
+{
+	int32_t x1, x2;
+
+	x1 = ((ut - bmp085.ac6) * bmp085.ac5) >> 15;
+
+	if((x1 + bmp085.md) == 0)
+		return(false);
+
+	x2 = (bmp085.mc * (1 << 11)) / (x1 + bmp085.md);
+
+	*b5 = x1 + x2;
+
+	return(true);
+}
+
+irom static bool_t bmp085_compensate_pressure(int32_t up, unsigned int oss, int32_t b5, int32_t *pressure)
+{
+	int32_t		x1, x2, x3, b3, b6, p;
+	uint32_t	b4, b7;
+
+	b6	= b5 - 4000;
+	x1	= (bmp085.b2 * ((b6 * b6) >> 12)) >> 11;
+	x2	= (bmp085.ac2 * b6) >> 11;
+	x3	= x1 + x2;
+	b3	= (((bmp085.ac1 * 4 + x3) << oss) + 2) >> 2;
+	x1	= (bmp085.ac3 * b6) >> 13;
+	x2	= (bmp085.b1 * ((b6 * b6) >> 12)) >> 16;
+	x3	= ((x1 + x2) + 2) >> 2;
+	b4	= (bmp085.ac4 * (uint32_t)(x3 + 32768)) >> 15;
+	b7	= ((uint32_t)up - b3) * (50000 >> oss);
+
+	if(b4 == 0)
+		return(false);
+
+	if(b7 < 0x80000000)
+		p = (b7 * 2) / b4;
+	else
+		p = (b7 / b4) * 2;
+
+	x1	= (p >> 8) * (p >> 8);
+	x1	= (x1 * 3038) >> 16;
+	x2	= (-7357 * p) >> 16;
+
+	*pressure = p + ((x1 + x2 + 3791) >> 4);
+
+	return(true);
+}
+
+irom static i2c_error_t bmp085_sample(int address, bool_t want_pressure, unsigned int *state, value_t *value, unsigned int *delay)
 {
 	uint16_t	ut;
 	uint32_t	up = 0;
 	int32_t		p;
-	int32_t		x1, x2, x3;
-	uint32_t	b4, b7;
-	int32_t		b3, b5, b6;
 	uint8_t		oss = 3;
 	i2c_error_t	error;
 
-	/* set cmd = 0x2e = start temperature measurement */
-
-	if((error = bmp085_write_reg_1(address, 0xf4, 0x2e)) != i2c_error_ok)
-		return(error);
+	switch(*state)
+	{
+		case(0):
+		{
+			/* set cmd = 0x2e = start temperature measurement */
 
-	msleep(5);
+			if((error = bmp085_write_reg_1(address, 0xf4, 0x2e)) != i2c_error_ok)
+				return(error);
 
-	/* fetch result from 0xf6,0xf7 */
+			*state = 1;
+			*delay = 5;
+			return(i2c_error_ok);
+		}
 
-	if((error = bmp085_read_reg_2(address, 0xf6, &ut)) != i2c_error_ok)
-		return(error);
+		case(1):
+		{
+			/* fetch result from 0xf6,0xf7 */
 
-	x1 = ((ut - bmp085.ac6) * bmp085.ac5) / (1 << 15);
+			if((error = bmp085_read_reg_2(address, 0xf6, &ut)) != i2c_error_ok)
+				return(error);
 
-	if((x1 + bmp085.md) == 0)
-		return(i2c_error_device_error_1);
+			if(!bmp085_compensate_temperature(ut, &bmp085.b5))
+				return(i2c_error_device_error_1);
 
-	x2 = (bmp085.mc * (1 << 11)) / (x1 + bmp085.md);
+			if(!want_pressure)
+			{
+				value->raw		= ut;
+				value->cooked	= ((bmp085.b5 + 8) * 100) / 16;
+				return(i2c_error_ok);
+			}
 
-	b5 = x1 + x2;
+			/* set cmd = 0x34 = start air pressure measurement */
 
-	if(rv_temperature)
-	{
-		rv_temperature->raw		= ut;
-		rv_temperature->cooked	= ((b5 + 8.0) / 16) / 10;
-	}
+			if((error = bmp085_write_reg_1(address, 0xf4, 0x34 | (oss << 6))) != i2c_error_ok)
+				return(error);
 
-	/* set cmd = 0x34 = start air pressure measurement */
+			*state = 2;
+			*delay = 25;
+			return(i2c_error_ok);
+		}
 
-	if((error = bmp085_write_reg_1(address, 0xf4, 0x34 | (oss << 6))) != i2c_error_ok)
-		return(error);
+		case(2):
+		{
+			/* fetch result from 0xf6,0xf7,0xf8 */
 
-	msleep(25);
+			if((error = bmp085_read_reg_3(address, 0xf6, &up)) != i2c_error_ok)
+				return(error);
 
-	/* fetch result from 0xf6,0xf7,0xf8 */
+			break;
+		}
 
-	if((error = bmp085_read_reg_3(address, 0xf6, &up)) != i2c_error_ok)
-		return(error);
+		default:
+		{
+			return(i2c_error_device_error_3);
+		}
+	}
 
 	up = up >> (8 - oss);
 
-	b6	= b5 - 4000;
-	x1	= (bmp085.b2 * ((b6 * b6) / (1 << 12))) / (1 << 11);
-	x2	= (bmp085.ac2 * b6) / (1 << 11);
-	x3	= x1 + x2;
-	b3	= (((bmp085.ac1 * 4 + x3) << oss) + 2) / 4;
-	x1	= (bmp085.ac3 * b6) / (1 << 13);
-	x2	= (bmp085.b1 * ((b6 * b6) / (1 << 12))) / (1 << 16);
-	x3	= (x1 + x2 + 2) / (1 << 2);
-	b4	= (bmp085.ac4 * (x3 + 32768)) / (1 << 15);
-	b7	= (up - b3) * (50000 >> oss);
-
-	if(b4 == 0)
+	if(!bmp085_compensate_pressure(up, oss, bmp085.b5, &p))
 		return(i2c_error_device_error_2);
 
-	if(b7 & 0x80000000)
-		p = ((b7 * 2) / b4) << 1;
-	else
-		p = (b7 / b4) * 2;
-
-	x1	= p / (1 << 8);
-	x1	= x1 * x1;
-	x1	= (x1 * 3038) / (1 << 16);
-	x2	= (-7357 * p) / (1 << 16);
-	p	= p + ((x1 + x2 + 3791) / (1 << 4));
-
-	if(rv_airpressure)
-	{
-		rv_airpressure->raw = up;
-		rv_airpressure->cooked = p / 100.0;
-	}
+	value->raw = up;
+	value->cooked = p * 10;
 
 	return(i2c_error_ok);
 }
@@ -335,6 +449,7 @@ irom static i2c_error_t bmp085_read(int address, value_t *rv_temperature, value_
 irom static i2c_error_t sensor_bmp085_init_temp(int bus, const device_table_entry_t *entry)
 {
 	i2c_error_t error;
+	value_t value;
 
 	if((error = bmp085_read_reg_2(entry->address, 0xaa, &bmp085.ac1)) != i2c_error_ok)
 		return(error);
@@ -366,15 +481,15 @@ irom static i2c_error_t sensor_bmp085_init_temp(int bus, const device_table_entr
 	if((error = bmp085_read_reg_2(entry->address, 0xbe, &bmp085.md)) != i2c_error_ok)
 		return(error);
 
-	if((error = bmp085_read(entry->address, 0, 0)) != i2c_error_ok)
+	if((error = sensor_sample_sync(bus, entry, &value)) != i2c_error_ok)
 		return(error);
 
 	return(i2c_error_ok);
 }
 
-irom static i2c_error_t sensor_bmp085_read_temp(int bus, const device_table_entry_t *entry, value_t *value)
+irom static i2c_error_t sensor_bmp085_sample_temp(int bus, const device_table_entry_t *entry, unsigned int *state, value_t *value, unsigned int *delay)
 {
-	return(bmp085_read(entry->address, value, 0));
+	return(bmp085_sample(entry->address, false, state, value, delay));
 }
 
 irom static i2c_error_t sensor_bmp085_init_pressure(int bus, const device_table_entry_t *entry)
@@ -385,30 +500,60 @@ irom static i2c_error_t sensor_bmp085_init_pressure(int bus, const device_table_
 	return(i2c_error_ok);
 }
 
-irom static i2c_error_t sensor_bmp085_read_pressure(int bus, const device_table_entry_t *entry, value_t *value)
+irom static i2c_error_t sensor_bmp085_sample_pressure(int bus, const device_table_entry_t *entry, unsigned int *state, value_t *value, unsigned int *delay)
 {
-	return(bmp085_read(entry->address, 0, value));
+	return(bmp085_sample(entry->address, true, state, value, delay));
 }
 
 typedef struct
 {
-	const double ratio_top;
-	const double ch0_factor;
-	const double ch1_factor;
+	const uint16_t ratio_top;	// ch1 / ch0 * 1000
+	const uint16_t ch0_factor;	// lux per count * 100000
+	const uint16_t ch1_factor;	// lux per count * 100000
 } tsl2560_lookup_t;
 
 static const tsl2560_lookup_t tsl2560_lookup[] =
 {
-	{ 0.125, 0.03040, 0.02720 },
-	{ 0.250, 0.03250, 0.04400 },
-	{ 0.375, 0.03510, 0.05440 },
-	{ 0.500, 0.03810, 0.06240 },
-	{ 0.610, 0.02240, 0.03100 },
-	{ 0.800, 0.01280, 0.01530 },
-	{ 1.300, 0.00146, 0.00112 },
-	{ 0.000, 0.00000, 0.00000 }
+	{	125,	3040,	2720 },
+	{	250,	3250,	4400 },
+	{	375,	3510,	5440 },
+	{	500,	3810,	6240 },
+	{	610,	2240,	3100 },
+	{	800,	1280,	1530 },
+	{	1300,	146,	112 },
+	{	0,		0,		0 }
 };
 
+// millilux from the two channel counts, for the 1x scaling factor
+
+irom static int tsl2560_lux(unsigned int ch0r, unsigned int ch1r)
+{
+	const tsl2560_lookup_t *tsl2560_entry;
+	int current, lux;
+
+	// ch1 / ch0 <= ratio_top / 1000 without rounding the ratio
+
+	for(current = 0;; current++)
+	{
+		tsl2560_entry = &tsl2560_lookup[current];
+
+		if((tsl2560_entry->ratio_top == 0) || (tsl2560_entry->ch0_factor == 0) || (tsl2560_entry->ch1_factor == 0))
+			break;
+
+		if((ch1r * 1000) <= (tsl2560_entry->ratio_top * ch0r))
+			break;
+	}
+
+	// counts * factor is in 1/100000 lux, both products fit in 32 bits
+
+	lux = (((int)ch0r * tsl2560_entry->ch0_factor) - ((int)ch1r * tsl2560_entry->ch1_factor)) / 100;
+
+	if(lux < 0)
+		lux = 0;
+
+	return(lux);
+}
+
 irom static i2c_error_t tsl2560_write(int address, int reg, int value)
 {
 	i2c_error_t error;
@@ -526,9 +671,6 @@ irom static i2c_error_t sensor_tsl2560_read(int bus, const device_table_entry_t
 	uint8_t	i2cbuffer[4];
 	i2c_error_t	error;
 	unsigned int ch0r, ch1r;
-	double ratio, ch0, ch1;
-	const tsl2560_lookup_t *tsl2560_entry;
-	int current;
 
 	if(i2c_sensor_detected(bus, i2c_sensor_tsl2550))
 		return(i2c_error_device_error_1);
@@ -543,51 +685,21 @@ irom static i2c_error_t sensor_tsl2560_read(int bus, const device_table_entry_t
 	ch0r = i2cbuffer[0] | (i2cbuffer[1] << 8);
 	ch1r = i2cbuffer[2] | (i2cbuffer[3] << 8);
 
-	value->raw = ((double)ch1r * 1000000) + (double)ch0r;
+	value->raw = (ch1r << 16) | ch0r;
 
 	if((ch0r == 65535) || (ch1r == 65535))
 	{
-		value->cooked = -1;
+		value->cooked = -1000;
 		return(i2c_error_ok);
 	}
 
-	if(config_flags_get().flag.tsl_high_sens)
-	{
-		// high sensitivity = 400 ms integration time, scaling factor = 1
-		// analogue amplification = 16x, scaling factor = 1
+	value->cooked = tsl2560_lux(ch0r, ch1r);
 
-		ch0 = (double)ch0r * 1.0;
-		ch1 = (double)ch1r * 1.0;
-	}
-	else
-	{
-		// low  sensitivity =  400 ms integration time, scaling factor = 1
-		// analogue amplification = 1x, scaling factor = 16
-
-		ch0 = (double)ch0r * 1.0 * 16.0;
-		ch1 = (double)ch1r * 1.0 * 16.0;
-	}
+	// high sensitivity = 400 ms integration time, analogue amplification = 16x, scaling factor = 1
+	// low  sensitivity = 400 ms integration time, analogue amplification = 1x, scaling factor = 16
 
-	if((unsigned int)ch0 != 0)
-		ratio = ch1 / ch0;
-	else
-		ratio = 0;
-
-	for(current = 0;; current++)
-	{
-		tsl2560_entry = &tsl2560_lookup[current];
-
-		if(((unsigned int)tsl2560_entry->ratio_top == 0) || ((unsigned int)tsl2560_entry->ch0_factor == 0) || ((unsigned int)tsl2560_entry->ch1_factor == 0))
-			break;
-
-		if(ratio <= tsl2560_entry->ratio_top)
-			break;
-	}
-
-	value->cooked = (ch0 * tsl2560_entry->ch0_factor) - (ch1 * tsl2560_entry->ch1_factor);
-
-	if(value->cooked < 0)
-		value->cooked = 0;
+	if(!config_flags_get().flag.tsl_high_sens)
+		value->cooked *= 16;
 
 	return(i2c_error_ok);
 }
@@ -683,42 +795,32 @@ irom static i2c_error_t sensor_tsl2550_init(int bus, const device_table_entry_t
 	return(i2c_error_ok);
 }
 
-irom static i2c_error_t sensor_tsl2550_read(int bus, const device_table_entry_t *entry, value_t *value)
+irom static i2c_error_t sensor_tsl2550_sample(int bus, const device_table_entry_t *entry, unsigned int *state, value_t *value, unsigned int *delay)
 {
 	i2c_error_t	error;
 	uint8_t		ch0, ch1;
-	int			attempt, ratio;
+	int			ratio;
 
 	if(i2c_sensor_detected(bus, i2c_sensor_tsl2560_0))
 		return(i2c_error_device_error_1);
 
-	error = i2c_error_ok;
+	// state = attempt, retry every 10 ms until both channels are valid
 
-	for(attempt = 16; attempt > 0; attempt--)
+	if(((error = sensor_tsl2550_rw(entry->address, 0x43, &ch0)) != i2c_error_ok) ||		// read from channel 0
+			((error = sensor_tsl2550_rw(entry->address, 0x83, &ch1)) != i2c_error_ok) ||	// read from channel 1
+			!(ch0 & 0x80) || !(ch1 & 0x80))
 	{
-		// read from channel 0
-
-		if((error = sensor_tsl2550_rw(entry->address, 0x43, &ch0)) != i2c_error_ok)
-			goto error;
+		if(++*state >= 16)
+			return((error != i2c_error_ok) ? error : i2c_error_device_error_3);
 
-		// read from channel 1
-
-		if((error = sensor_tsl2550_rw(entry->address, 0x83, &ch1)) != i2c_error_ok)
-			goto error;
-
-		if((ch0 & 0x80) && (ch1 & 0x80))
-			break;
-error:
-		msleep(10);
+		*delay = 10;
+		return(i2c_error_ok);
 	}
 
-	if(error != i2c_error_ok)
-		return(error);
-
 	ch0 &= 0x7f;
 	ch1 &= 0x7f;
 
-	value->raw = (ch0 * 10000.0) + ch1;
+	value->raw = (ch0 * 10000) + ch1;
 
 	if((tsl2550_count[ch1] <= tsl2550_count[ch0]) && (tsl2550_count[ch0] > 0))
 		ratio = (tsl2550_count[ch1] * 128) / tsl2550_count[ch0];
@@ -728,7 +830,7 @@ error:
 	if(ratio > 128)
 		ratio = 128;
 
-	value->cooked = ((tsl2550_count[ch0] - tsl2550_count[ch1]) * tsl2550_ratio[ratio]) / 2560.0;
+	value->cooked = ((tsl2550_count[ch0] - tsl2550_count[ch1]) * tsl2550_ratio[ratio] * 25) / 64;	// * 1000 / 2560
 
 	if(value->cooked < 0)
 		value->cooked = 0;
@@ -789,18 +891,18 @@ irom static i2c_error_t sensor_bh1750_read(int bus, const device_table_entry_t *
 {
 	i2c_error_t error;
 	uint8_t	i2cbuffer[2];
-	double luxpercount;
+	int millilux_per_count;
 
 	if((error = i2c_receive(entry->address, 2, i2cbuffer)) != i2c_error_ok)
 		return(error);
 
 	if(config_flags_get().flag.bh_high_sens)
-		luxpercount = 0.11;
+		millilux_per_count = 110;
 	else
-		luxpercount = 0.93;
+		millilux_per_count = 930;
 
-	value->raw		= (double)((i2cbuffer[0] << 8) | i2cbuffer[1]);
-	value->cooked	= value->raw * luxpercount;
+	value->raw		= (i2cbuffer[0] << 8) | i2cbuffer[1];
+	value->cooked	= value->raw * millilux_per_count;
 
 	return(i2c_error_ok);
 }
@@ -827,15 +929,12 @@ irom attr_pure static uint8_t htu21_crc(int length, const uint8_t *data)
 	return(crc);
 }
 
-irom static i2c_error_t sensor_htu21_read(const device_table_entry_t *entry, uint8_t command, uint16_t *result)
+irom static i2c_error_t sensor_htu21_fetch(const device_table_entry_t *entry, uint16_t *result)
 {
 	i2c_error_t error;
 	uint8_t	i2cbuffer[4];
 	uint8_t crc1, crc2;
 
-	if((error = i2c_send_1(entry->address, command)) != i2c_error_ok)
-		return(error);
-
 	if((error = i2c_receive(entry->address, sizeof(i2cbuffer), i2cbuffer)) != i2c_error_ok)
 		return(error);
 
@@ -851,44 +950,77 @@ irom static i2c_error_t sensor_htu21_read(const device_table_entry_t *entry, uin
 	return(i2c_error_ok);
 }
 
-irom static i2c_error_t sensor_htu21_temp_read(int bus, const device_table_entry_t *entry, value_t *value)
+static value_t sensor_htu21_temperature;
+
+irom static i2c_error_t sensor_htu21_temp_sample(int bus, const device_table_entry_t *entry, unsigned int *state, value_t *value, unsigned int *delay)
 {
 	i2c_error_t error;
 	uint16_t result;
 
-	// temperature measurement "hold master" mode -> 0xe3
+	switch(*state)
+	{
+		case(0):
+		{
+			// temperature measurement "no hold master" mode -> 0xf3, takes max 50 ms
+
+			if((error = i2c_send_1(entry->address, 0xf3)) != i2c_error_ok)
+				return(error);
 
-	if((error = sensor_htu21_read(entry, 0xe3, &result)) != i2c_error_ok)
-		return(error);
+			*state = 1;
+			*delay = 50;
+			return(i2c_error_ok);
+		}
 
-	value->raw = result;
-	value->cooked = ((value->raw * 175.72) / 65536) - 46.85;
+		case(1):
+		{
+			if((error = sensor_htu21_fetch(entry, &result)) != i2c_error_ok)
+				return(error);
 
-	return(i2c_error_ok);
+			value->raw = result;
+			value->cooked = ((value->raw * 21965) / 8192) - 46850;	// raw * 175720 / 65536
+
+			return(i2c_error_ok);
+		}
+	}
+
+	return(i2c_error_device_error_2);
 }
 
-irom static i2c_error_t sensor_htu21_hum_read(int bus, const device_table_entry_t *entry, value_t *value)
+irom static i2c_error_t sensor_htu21_hum_sample(int bus, const device_table_entry_t *entry, unsigned int *state, value_t *value, unsigned int *delay)
 {
 	i2c_error_t error;
 	uint16_t result;
-	value_t temperature;
 
-	if((error = sensor_htu21_temp_read(bus, entry, &temperature)) != i2c_error_ok)
-		return(error);
+	if(*state < 2)
+	{
+		if((error = sensor_htu21_temp_sample(bus, entry, state, &sensor_htu21_temperature, delay)) != i2c_error_ok)
+			return(error);
 
-	// humidity measurement "hold master" mode -> 0xe5
+		if(*delay != 0)
+			return(i2c_error_ok);
+
+		// humidity measurement "no hold master" mode -> 0xf5, takes max 16 ms
 
-	if((error = sensor_htu21_read(entry, 0xe5, &result)) != i2c_error_ok)
+		if((error = i2c_send_1(entry->address, 0xf5)) != i2c_error_ok)
+			return(error);
+
+		*state = 2;
+		*delay = 16;
+		return(i2c_error_ok);
+	}
+
+	if((error = sensor_htu21_fetch(entry, &result)) != i2c_error_ok)
 		return(error);
 
-	value->raw = (((double)result * 125) / 65536) - 6;
-	value->cooked = value->raw + ((25 - temperature.cooked) * -0.10); // FIXME, TempCoeff guessed
+	value->raw = result;
+	value->cooked = ((result * 15625) / 8192) - 6000;	// result * 125000 / 65536
+	value->cooked += (sensor_htu21_temperature.cooked - 25000) / 10; // FIXME, TempCoeff guessed
 
 	if(value->cooked < 0)
 		value->cooked = 0;
 
-	if(value->cooked > 100)
-		value->cooked = 100;
+	if(value->cooked > 100000)
+		value->cooked = 100000;
 
 	return(i2c_error_ok);
 }
@@ -898,7 +1030,7 @@ irom static i2c_error_t sensor_htu21_temp_init(int bus, const device_table_entry
 	value_t value;
 	i2c_error_t error;
 
-	if((error = sensor_htu21_temp_read(bus, entry, &value)) != i2c_error_ok)
+	if((error = sensor_sample_sync(bus, entry, &value)) != i2c_error_ok)
 		return(error);
 
 	return(i2c_error_ok);
@@ -935,12 +1067,29 @@ irom attr_pure static uint16_t am2321_crc(int length, const uint8_t *data)
 	return(crc);
 }
 
+irom static i2c_error_t am2321_check_reply(int length, const uint8_t *i2cbuffer, uint8_t *values)
+{
+	uint16_t crc1, crc2;
+
+	if((i2cbuffer[0] != 0x03) || (i2cbuffer[1] != length))
+		return(i2c_error_device_error_2);
+
+	crc1 = i2cbuffer[length + 2] | (i2cbuffer[length + 3] << 8);
+	crc2 = am2321_crc(length + 2, i2cbuffer);
+
+	if(crc1 != crc2)
+		return(i2c_error_device_error_3);
+
+	memcpy(values, &i2cbuffer[2], length);
+
+	return(i2c_error_ok);
+}
+
 irom static i2c_error_t sensor_am2321_read_registers(int address, int offset, int length, uint8_t *values)
 {
 	unsigned int attempt;
 	i2c_error_t	error;
 	uint8_t		i2cbuffer[32];
-	uint16_t	crc1, crc2;
 
 	// wake the device
 
@@ -968,40 +1117,86 @@ irom static i2c_error_t sensor_am2321_read_registers(int address, int offset, in
 	if(attempt == 0)
 		return(error);
 
-	if((i2cbuffer[0] != 0x03) || (i2cbuffer[1] != length))
-		return(i2c_error_device_error_2);
-
-	crc1 = i2cbuffer[length + 2] | (i2cbuffer[length + 3] << 8);
-	crc2 = am2321_crc(length + 2, i2cbuffer);
-
-	if(crc1 != crc2)
-		return(i2c_error_device_error_3);
-
-	memcpy(values, &i2cbuffer[2], length);
-
-	return(i2c_error_ok);
+	return(am2321_check_reply(length, i2cbuffer, values));
 }
 
-static value_t sensor_am2321_cached_temperature;
-static value_t sensor_am2321_cached_humidity;
+enum
+{
+	am2321_state_wake = 0,
+	am2321_state_request = 0x100,
+	am2321_state_receive = 0x200,
+	am2321_state_phase = 0xff00,
+	am2321_attempts = 32,
+};
 
-irom static i2c_error_t sensor_am2321_read(int address, value_t *value, bool_t request_humidity)
+irom static i2c_error_t sensor_am2321_sample(int bus, const device_table_entry_t *entry, unsigned int *state, value_t *value, unsigned int *delay)
 {
 	i2c_error_t	error;
+	uint8_t		i2cbuffer[8];
 	uint8_t		values[4];
 	int32_t		raw_temp;
 
-	//	0x00	start address: humidity (16 bits), temperature (16 bits)
-	//	0x04	length
+	// low byte of state = attempt, retry every ms
 
-	if((error = sensor_am2321_read_registers(address, 0x00, 0x04, values)) == i2c_error_ok)
+	switch(*state & am2321_state_phase)
 	{
-		sensor_am2321_cached_humidity.raw = (values[0] << 8) | values[1];
-		sensor_am2321_cached_humidity.cooked = sensor_am2321_cached_humidity.raw / 10.0;
+		case(am2321_state_wake):
+		{
+			i2c_send_1(entry->address, 0);
+
+			*state = am2321_state_request;
+			*delay = 1;
+			return(i2c_error_ok);
+		}
+
+		case(am2321_state_request):
+		{
+			//	0x00	start address: humidity (16 bits), temperature (16 bits)
+			//	0x04	length
+
+			if((error = i2c_send_3(entry->address, 0x03, 0x00, 0x04)) == i2c_error_ok)
+				*state = am2321_state_receive;
+			else
+				if((++*state & ~am2321_state_phase) >= am2321_attempts)
+					return(error);
+
+			*delay = 1;
+			return(i2c_error_ok);
+		}
+
+		case(am2321_state_receive):
+		{
+			if((error = i2c_receive(entry->address, sizeof(i2cbuffer), i2cbuffer)) != i2c_error_ok)
+			{
+				if((++*state & ~am2321_state_phase) >= am2321_attempts)
+					return(error);
+
+				*delay = 1;
+				return(i2c_error_ok);
+			}
+
+			if((error = am2321_check_reply(4, i2cbuffer, values)) != i2c_error_ok)
+				return(error);
 
-		if(sensor_am2321_cached_humidity.cooked > 100)
-			sensor_am2321_cached_humidity.cooked = 100;
+			break;
+		}
+
+		default:
+		{
+			return(i2c_error_device_error_4);
+		}
+	}
 
+	if(entry->id == i2c_sensor_am2321_humidity)
+	{
+		value->raw = (values[0] << 8) | values[1];
+		value->cooked = value->raw * 100;
+
+		if(value->cooked > 100000)
+			value->cooked = 100000;
+	}
+	else
+	{
 		raw_temp = (values[2] << 8) | values[3];
 
 		if(raw_temp & 0x8000)
@@ -1010,28 +1205,13 @@ irom static i2c_error_t sensor_am2321_read(int address, value_t *value, bool_t r
 			raw_temp = 0 - raw_temp;
 		}
 
-		sensor_am2321_cached_temperature.raw = raw_temp;
-		sensor_am2321_cached_temperature.cooked = sensor_am2321_cached_temperature.raw / 10.0;
+		value->raw = raw_temp;
+		value->cooked = value->raw * 100;
 	}
 
-	if(request_humidity)
-		*value = sensor_am2321_cached_humidity;
-	else
-		*value = sensor_am2321_cached_temperature;
-
 	return(i2c_error_ok);
 }
 
-irom static i2c_error_t sensor_am2321_temp_read(int bus, const device_table_entry_t *entry, value_t *value)
-{
-	return(sensor_am2321_read(entry->address, value, false));
-}
-
-irom static i2c_error_t sensor_am2321_hum_read(int bus, const device_table_entry_t *entry, value_t *value)
-{
-	return(sensor_am2321_read(entry->address, value, true));
-}
-
 irom static i2c_error_t sensor_am2321_temp_init(int bus, const device_table_entry_t *entry)
 {
 	i2c_error_t	error;
@@ -1109,7 +1289,7 @@ irom static i2c_error_t sensor_veml6070_read(int bus, const device_table_entry_t
 		return(error);
 
 	value->raw = rv;
-	value->cooked = rv / 17.6; // FIXME
+	value->cooked = (rv * 625) / 11; // rv * 1000 / 17.6, FIXME
 
 	return(i2c_error_ok);
 }
@@ -1489,7 +1669,8 @@ irom static i2c_error_t sensor_si114x_visible_light_read(int bus, const device_t
 	if((error = si114x_read_register(si114x_als_vis_data_high, &high)) != i2c_error_ok)
 		return(error);
 
-	value->raw = value->cooked = (high << 8) | low;
+	value->raw = (high << 8) | low;
+	value->cooked = value->raw * 1000;
 
 	return(i2c_error_ok);
 }
@@ -1513,7 +1694,8 @@ irom static i2c_error_t sensor_si114x_infrared_read(int bus, const device_table_
 	if((error = si114x_read_register(si114x_als_ir_data_high, &high)) != i2c_error_ok)
 		return(error);
 
-	value->raw = value->cooked = (high << 8) | low;
+	value->raw = (high << 8) | low;
+	value->cooked = value->raw * 1000;
 
 	return(i2c_error_ok);
 }
@@ -1537,8 +1719,8 @@ irom static i2c_error_t sensor_si114x_ultraviolet_read(int bus, const device_tab
 	if((error = si114x_read_register(si114x_aux_data_high, &high)) != i2c_error_ok)
 		return(error);
 
-	value->raw = value->cooked = (high << 8) | low;
-	value->cooked /= 100;
+	value->raw = (high << 8) | low;
+	value->cooked = value->raw * 10;
 
 	return(i2c_error_ok);
 }
@@ -1591,14 +1773,61 @@ irom static i2c_error_t bme280_read_register_2(int address, int reg, uint16_t *v
 	return(i2c_error_ok);
 }
 
+// integer compensation formulas from the datasheet (BST-BME280-DS001 section 8.2), temperature in 1/100 C,
+// pressure in 1/256 Pa from the 64 bit version, the 32 bit version is up to 5 Pa off, humidity in 1/1024 %
+
+irom static void bme280_compensate(int32_t adc_T, int32_t adc_P, int32_t adc_H, int32_t *temperature, uint32_t *pressure, int32_t *humidity)
+{
+	int32_t t_fine, t1, t2, h;
+	int64_t var1, var2, p;
+
+	t1 = ((((adc_T >> 3) - ((int32_t)bme280.dig_T1 << 1))) * ((int32_t)bme280.dig_T2)) >> 11;
+	t2 = (((((adc_T >> 4) - ((int32_t)bme280.dig_T1)) * ((adc_T >> 4) - ((int32_t)bme280.dig_T1))) >> 12) * ((int32_t)bme280.dig_T3)) >> 14;
+
+	t_fine = t1 + t2;
+
+	*temperature = (t_fine * 5 + 128) >> 8;
+
+	var1 = (int64_t)t_fine - 128000;
+	var2 = var1 * var1 * bme280.dig_P6;
+	var2 = var2 + ((var1 * bme280.dig_P5) << 17);
+	var2 = var2 + ((int64_t)bme280.dig_P4 << 35);
+	var1 = ((var1 * var1 * bme280.dig_P3) >> 8) + ((var1 * bme280.dig_P2) << 12);
+	var1 = ((((int64_t)1 << 47) + var1) * bme280.dig_P1) >> 33;
+
+	if(var1 == 0)
+		*pressure = 0;
+	else
+	{
+		p = 1048576 - adc_P;
+		p = (((p << 31) - var2) * 3125) / var1;
+		var1 = (bme280.dig_P9 * (p >> 13) * (p >> 13)) >> 25;
+		var2 = (bme280.dig_P8 * p) >> 19;
+		*pressure = (uint32_t)(((p + var1 + var2) >> 8) + ((int64_t)bme280.dig_P7 << 4));
+	}
+
+	h = t_fine - 76800;
+	h = (((((adc_H << 14) - (((int32_t)bme280.dig_H4) << 20) - (((int32_t)bme280.dig_H5) * h)) + 16384) >> 15) *
+			(((((((h * ((int32_t)bme280.dig_H6)) >> 10) * (((h * ((int32_t)bme280.dig_H3)) >> 11) + 32768)) >> 10) + 2097152) *
+			((int32_t)bme280.dig_H2) + 8192) >> 14));
+	h = h - (((((h >> 15) * (h >> 15)) >> 7) * ((int32_t)bme280.dig_H1)) >> 4);
+
+	if(h < 0)
+		h = 0;
+
+	if(h > 419430400)
+		h = 419430400;
+
+	*humidity = h >> 12;
+}
+
 irom static i2c_error_t bme280_read(int address, value_t *rv_temperature, value_t *rv_pressure, value_t *rv_humidity)
 {
 	i2c_error_t		error;
 	uint8_t 		i2c_buffer[8];
-	int32_t			t_fine;
-	uint32_t		adc_T, adc_P, adc_H;
-	double			var1, var2;
-	double			temperature, pressure, humidity;
+	int32_t			adc_T, adc_P, adc_H;
+	int32_t			temperature, humidity;
+	uint32_t		pressure;
 
 	// retrieve all ADC values in one go to make use of the register shadowing feature
 
@@ -1612,58 +1841,24 @@ irom static i2c_error_t bme280_read(int address, value_t *rv_temperature, value_
 	adc_T	= ((i2c_buffer[3] << 16) |	(i2c_buffer[4] << 8) | (i2c_buffer[5] << 0)) >> 4;
 	adc_H	= (							(i2c_buffer[6] << 8) | (i2c_buffer[7] << 0)) >> 0;
 
-	var1 = (adc_T / 16384.0 - bme280.dig_T1 / 1024.0) * bme280.dig_T2;
-	var2 = ((adc_T / 131072.0 - bme280.dig_T1 / 8192.0) * (adc_T / 131072.0 - bme280.dig_T1 / 8192.0)) * bme280.dig_T3;
-
-	t_fine = (int32_t)(var1 + var2);
-
-	temperature = (var1 + var2) / 5120.0;
-
-	var1 = (t_fine / 2.0) - 64000.0;
-	var2 = var1 * var1 * bme280.dig_P6 / 32768.0;
-	var2 = var2 + var1 * bme280.dig_P5 * 2.0;
-	var2 = (var2 / 4.0) + (bme280.dig_P4 * 65536.0);
-	var1 = (bme280.dig_P3 * var1 * var1 / 524288.0 + bme280.dig_P2 * var1) / 524288.0;
-	var1 = (1.0 + var1 / 32768.0) * bme280.dig_P1;
-
-	if(var1 < 0.0001)
-		pressure = 0;
-	else
-	{
-		pressure = 1048576.0 - adc_P;
-		pressure = (pressure - (var2 / 4096.0)) * 6250.0 / var1;
-		var1 = bme280.dig_P9 * pressure * pressure / 2147483648.0;
-		var2 = pressure * bme280.dig_P8 / 32768.0;
-		pressure = pressure + (var1 + var2 + bme280.dig_P7) / 16.0;
-		pressure /= 100.0;
-	}
-
-	humidity = (t_fine - 76800.0);
-	humidity = (adc_H - (bme280.dig_H4 * 64.0 + bme280.dig_H5 / 16384.0 * humidity)) * (bme280.dig_H2 / 65536.0 * (1.0 + bme280.dig_H6 / 67108864.0 * humidity * (1.0 + bme280.dig_H3 / 67108864.0 * humidity)));
-	humidity = humidity * (1.0 - bme280.dig_H1 * humidity / 524288.0);
-
-	if (humidity > 100.0)
-		humidity = 100.0;
-
-	if (humidity < 0.0)
-		humidity = 0.0;
+	bme280_compensate(adc_T, adc_P, adc_H, &temperature, &pressure, &humidity);
 
 	if(rv_temperature)
 	{
 		rv_temperature->raw = adc_T;
-		rv_temperature->cooked = temperature;
+		rv_temperature->cooked = temperature * 10;
 	}
 
 	if(rv_pressure)
 	{
 		rv_pressure->raw = adc_P;
-		rv_pressure->cooked = pressure;
+		rv_pressure->cooked = (pressure * 10) >> 8;
 	}
 
 	if(rv_humidity)
 	{
 		rv_humidity->raw = adc_H;
-		rv_humidity->cooked = humidity;
+		rv_humidity->cooked = (humidity * 1000) >> 10;
 	}
 
 	return(i2c_error_ok);
@@ -1900,7 +2095,7 @@ irom static i2c_error_t sensor_max44009_read(int bus, const device_table_entry_t
 	if(exponent == 0b1111)
 		return(i2c_error_device_error_2);
 
-	value->cooked = (1 << exponent) * mantissa * 0.045;
+	value->cooked = (1 << exponent) * mantissa * 45;
 
 	return(i2c_error_ok);
 }
@@ -1927,23 +2122,25 @@ irom static i2c_error_t sensor_veml6075_init(int bus, const device_table_entry_t
 
 irom static i2c_error_t sensor_veml6075_read(int bus, const device_table_entry_t *entry, value_t *value)
 {
-	static const double a = 2.22;
-	static const double b = 1.33;
-	static const double c = 2.95;
-	static const double d = 1.74;
-	static const double k1 = 1;
-	static const double k2 = 1;
-	static const double uvar = 0.001461;
-	static const double uvbr = 0.002591;
+	// coefficients * 1000
+
+	static const int a = 2220;
+	static const int b = 1330;
+	static const int c = 2950;
+	static const int d = 1740;
+	static const int k1 = 1000;
+	static const int k2 = 1000;
+	static const int uvar = 1461;	// * 1000000
+	static const int uvbr = 2591;	// * 1000000
 
 	i2c_error_t	error;
 	uint8_t		i2c_buffer[2];
 	int			uva_data;
 	int 		uvb_data;
-	double		uv_comp1_data;
-	double		uv_comp2_data;
-	double		uva, uvb;
-	double		uvia, uvib, uvi;
+	int			uv_comp1_data;
+	int			uv_comp2_data;
+	int			uva, uvb;
+	int			uvia, uvib, uvi;
 
 	if((error = i2c_send_receive(entry->address, 0x07, sizeof(i2c_buffer), i2c_buffer)) != i2c_error_ok)
 		return(error);
@@ -1965,8 +2162,8 @@ irom static i2c_error_t sensor_veml6075_read(int bus, const device_table_entry_t
 
 	uv_comp2_data = (i2c_buffer[0] << 0) | (i2c_buffer[1] << 8);
 
-	uva	= uva_data - (a * uv_comp1_data) - (b * uv_comp2_data);
-	uvb	= uvb_data - (c * uv_comp1_data) - (d * uv_comp2_data);
+	uva	= ((uva_data * 1000) - (a * uv_comp1_data) - (b * uv_comp2_data)) / 1000;
+	uvb	= ((uvb_data * 1000) - (c * uv_comp1_data) - (d * uv_comp2_data)) / 1000;
 
 	if(uva < 0)
 		uva = 0;
@@ -1974,11 +2171,13 @@ irom static i2c_error_t sensor_veml6075_read(int bus, const device_table_entry_t
 	if(uvb < 0)
 		uvb = 0;
 
-	uvia	= uva * k1 * uvar;
-	uvib	= uvb * k2 * uvbr;
+	// uva and uvb are in counts, so uvia and uvib come out in 1/1000 uv index
+
+	uvia	= (((uva * k1) / 1000) * uvar) / 1000;
+	uvib	= (((uvb * k2) / 1000) * uvbr) / 1000;
 	uvi		= (uvia + uvib) / 2;
 
-	value->raw = (unsigned int)uva * 10000 + (unsigned int)uvb;
+	value->raw = (uva * 10000) + uvb;
 	value->cooked = uvi;
 
 	return(i2c_error_ok);
@@ -2043,7 +2242,7 @@ irom static i2c_error_t sensor_mpl3115a2_temperature_read(int bus, const device_
 		return(error);
 
 	value->raw = (i2c_buffer[0] << 8) | (i2c_buffer[1] << 0);
-	value->cooked = value->raw / 256;
+	value->cooked = ((int16_t)value->raw * 1000) / 256;
 
 	return(i2c_error_ok);
 }
@@ -2063,7 +2262,7 @@ irom static i2c_error_t sensor_mpl3115a2_airpressure_read(int bus, const device_
 		return(error);
 
 	value->raw = (i2c_buffer[0] << 16 ) | (i2c_buffer[1] << 8) | (i2c_buffer[2] << 0);
-	value->cooked = value->raw / 64 / 100;
+	value->cooked = (value->raw * 5) / 32;	// raw / 64 = Pa
 
 	return(i2c_error_ok);
 }
@@ -2074,178 +2273,419 @@ static const device_table_entry_t device_table[] =
 		i2c_sensor_digipicco_temperature, 0x78,
 		"digipicco", "temperature", "C", 2,
 		sensor_digipicco_temp_init,
-		sensor_digipicco_temp_read
+		sensor_digipicco_temp_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_digipicco_humidity, 0x78,
 		"digipicco", "humidity", "%", 0,
 		sensor_digipicco_hum_init,
-		sensor_digipicco_hum_read
+		sensor_digipicco_hum_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_lm75_0, 0x48,
 		"lm75 compatible #0", "temperature", "C", 2,
 		sensor_lm75_init,
-		sensor_lm75_read
+		sensor_lm75_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_lm75_1, 0x49,
 		"lm75 compatible #1", "temperature", "C", 2,
 		sensor_lm75_init,
-		sensor_lm75_read
+		sensor_lm75_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_lm75_2, 0x4a,
 		"lm75 compatible #2", "temperature", "C", 2,
 		sensor_lm75_init,
-		sensor_lm75_read
+		sensor_lm75_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_lm75_3, 0x4b,
 		"lm75 compatible #3", "temperature", "C", 2,
 		sensor_lm75_init,
-		sensor_lm75_read
+		sensor_lm75_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_ds1631_6, 0x4e,
 		"ds1621/ds1631/ds1731", "temperature", "C", 2,
 		sensor_ds1631_init,
-		sensor_ds1631_read
+		sensor_ds1631_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_lm75_7, 0x4f,
 		"lm75 compatible #7", "temperature", "C", 2,
 		sensor_lm75_init,
-		sensor_lm75_read
+		sensor_lm75_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_bmp085_temperature, 0x77,
 		"bmp085/bmp180", "temperature", "C", 2,
 		sensor_bmp085_init_temp,
-		sensor_bmp085_read_temp
+		(void *)0,
+		sensor_bmp085_sample_temp,
 	},
 	{
 		i2c_sensor_bmp085_airpressure, 0x77,
 		"bmp085/bmp180", "pressure", "hPa", 2,
 		sensor_bmp085_init_pressure,
-		sensor_bmp085_read_pressure
+		(void *)0,
+		sensor_bmp085_sample_pressure,
 	},
 	{
 		i2c_sensor_tsl2560_0, 0x39,
 		"tsl2560/tsl2561 #0", "visible light", "", 2,
 		sensor_tsl2560_init,
 		sensor_tsl2560_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_tsl2550, 0x39,
 		"tsl2550", "visible light", "", 2,
 		sensor_tsl2550_init,
-		sensor_tsl2550_read
+		(void *)0,
+		sensor_tsl2550_sample,
 	},
 	{
 		i2c_sensor_bh1750, 0x23,
 		"bh1750", "light", "", 2,
 		sensor_bh1750_init,
-		sensor_bh1750_read
+		sensor_bh1750_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_htu21_temperature, 0x40,
 		"htu21", "temperature", "C", 2,
 		sensor_htu21_temp_init,
-		sensor_htu21_temp_read
+		(void *)0,
+		sensor_htu21_temp_sample,
 	},
 	{
 		i2c_sensor_htu21_humidity, 0x40,
 		"htu21", "humidity", "%", 0,
 		sensor_htu21_hum_init,
-		sensor_htu21_hum_read
+		(void *)0,
+		sensor_htu21_hum_sample,
 	},
 	{
 		i2c_sensor_am2321_temperature, 0x5c,
 		"am2321", "temperature", "C", 2,
 		sensor_am2321_temp_init,
-		sensor_am2321_temp_read
+		(void *)0,
+		sensor_am2321_sample,
 	},
 	{
 		i2c_sensor_am2321_humidity, 0x5c,
 		"am2321", "humidity", "%", 0,
 		sensor_am2321_hum_init,
-		sensor_am2321_hum_read
+		(void *)0,
+		sensor_am2321_sample,
 	},
 	{
 		i2c_sensor_veml6070, 0x38,
 		"veml6070", "ultraviolet light", "", 1,
 		sensor_veml6070_init,
-		sensor_veml6070_read
+		sensor_veml6070_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_si114x_visible_light, 0x60,
 		"si114x", "visible light", "", 1,
 		sensor_si114x_visible_light_init,
 		sensor_si114x_visible_light_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_si114x_infrared, 0x60,
 		"si114x", "infrared light", "", 1,
 		sensor_si114x_infrared_init,
 		sensor_si114x_infrared_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_si114x_ultraviolet, 0x60,
 		"si114x", "ultraviolet light", "", 1,
 		sensor_si114x_ultraviolet_init,
 		sensor_si114x_ultraviolet_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_bme280_temperature, 0x76,
 		"bmp280/bme280", "temperature", "C", 2,
 		sensor_bme280_temperature_init,
 		sensor_bme280_temperature_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_bme280_humidity, 0x76,
 		"bmp280/bme280", "humidity", "%", 1,
 		sensor_bme280_humidity_init,
 		sensor_bme280_humidity_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_bme280_airpressure, 0x76,
 		"bmp280/bme280", "pressure", "hPa", 2,
 		sensor_bme280_airpressure_init,
 		sensor_bme280_airpressure_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_tsl2560_1, 0x29,
 		"tsl2560/tsl2561 #1", "visible light", "", 2,
 		sensor_tsl2560_init,
 		sensor_tsl2560_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_max44009_0, 0x4a,
 		"max44009 #0", "visible light", "", 2,
 		sensor_max44009_init,
 		sensor_max44009_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_veml6075, 0x10,
 		"veml6075", "uv light", "", 2,
 		sensor_veml6075_init,
 		sensor_veml6075_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_mpl3115a2_temperature, 0x60,
 		"mpl3115a2", "temperature", "C", 2,
 		sensor_mpl3115a2_temperature_init,
 		sensor_mpl3115a2_temperature_read,
+		(void *)0,
 	},
 	{
 		i2c_sensor_mpl3115a2_airpressure, 0x60,
 		"mpl3115a2", "pressure", "hPa", 2,
 		sensor_mpl3115a2_airpressure_init,
 		sensor_mpl3115a2_airpressure_read,
+		(void *)0,
 	},
 };
 
+irom static sensor_cache_t *sensor_cache_find(int bus, i2c_sensor_t sensor, bool_t allocate)
+{
+	sensor_cache_t *cache, *free_slot;
+
+	for(cache = sensor_cache, free_slot = (sensor_cache_t *)0; cache < &sensor_cache[sensor_cache_size]; cache++)
+	{
+		if((cache->sensor == sensor) && (cache->bus == bus))
+			return(cache);
+
+		if(!free_slot && (cache->sensor == i2c_sensor_error))
+			free_slot = cache;
+	}
+
+	if(!allocate || !free_slot)
+		return((sensor_cache_t *)0);
+
+	free_slot->sensor = sensor;
+	free_slot->bus = bus;
+	free_slot->valid = 0;
+	free_slot->error = i2c_error_ok;
+
+	return(free_slot);
+}
+
+irom static void sensor_cache_reset(int bus, i2c_sensor_t sensor)
+{
+	sensor_cache_t *cache;
+
+	if((cache = sensor_cache_find(bus, sensor, false)))
+	{
+		cache->sensor = i2c_sensor_error;
+		cache->valid = 0;
+	}
+}
+
+/*
+ * One step of the sampler's current sensor, returns the delay before the
+ * next step, or 0 when the sensor is done and its value (or error) is in
+ * the cache.
+ */
+
+irom static unsigned int sampler_step(void)
+{
+	const device_table_entry_t *entry;
+	sensor_cache_t *cache;
+	i2c_error_t error;
+	unsigned int delay;
+
+	entry = &device_table[sampler.sensor];
+	delay = 0;
+
+	if((error = i2c_select_bus(sampler.bus)) == i2c_error_ok)
+	{
+		if(entry->sample_fn)
+			error = entry->sample_fn(sampler.bus, entry, &sampler.state, &sampler.value, &delay);
+		else
+			error = entry->read_fn(sampler.bus, entry, &sampler.value);
+	}
+
+	i2c_select_bus(0);
+
+	if((error == i2c_error_ok) && (delay > 0))
+		return(delay);
+
+	if((cache = sensor_cache_find(sampler.bus, sampler.sensor, true)))
+	{
+		cache->error = error;
+
+		if(error == i2c_error_ok)
+		{
+			cache->value = sampler.value;
+			cache->timestamp = system_get_time();
+			cache->valid = 1;
+		}
+	}
+
+	sampler.active = 0;
+
+	return(0);
+}
+
+/*
+ * Direct reads and inits must not talk to a chip while the sampler has a
+ * conversion running on it, they would restart it or, like the bmp085
+ * temperature and pressure, clobber state shared between the steps. Such a
+ * conversion is finished synchronously first, the sampler then continues
+ * with the next sensor.
+ */
+
+irom static void sampler_finish(int bus, unsigned int address)
+{
+	unsigned int delay;
+
+	while(sampler.active && (sampler.bus == (unsigned int)bus) && (device_table[sampler.sensor].address == address))
+		if((delay = sampler_step()) > 0)
+			msleep(delay);
+}
+
+irom static i2c_error_t sensor_read_sync(int bus, const device_table_entry_t *entry, value_t *value)
+{
+	i2c_error_t error;
+
+	sampler_finish(bus, entry->address);
+
+	if((error = i2c_select_bus(bus)) == i2c_error_ok)
+	{
+		if(entry->sample_fn)
+			error = sensor_sample_sync(bus, entry, value);
+		else
+			error = entry->read_fn(bus, entry, value);
+	}
+
+	i2c_select_bus(0);
+
+	return(error);
+}
+
+/*
+ * Use the value the background sampler collected (last valid one, also
+ * when the last attempt failed), only read the sensor directly when it's
+ * not sampled (not detected or no value yet). Age is -1 for a direct read.
+ */
+
+irom static i2c_error_t sensor_read_value(int bus, const device_table_entry_t *entry, value_t *value, int *age)
+{
+	const sensor_cache_t *cache;
+
+	// the sampler may have this very sensor's value half way
+
+	sampler_finish(bus, entry->address);
+
+	if((cache = sensor_cache_find(bus, entry->id, false)) && cache->valid)
+	{
+		*value = cache->value;
+		*age = (system_get_time() - cache->timestamp) / 1000;
+		return(i2c_error_ok);
+	}
+
+	*age = -1;
+
+	return(sensor_read_sync(bus, entry, value));
+}
+
+/*
+ * Background sampler, runs one step at a time from the background task,
+ * the timer marks when the next step is due.
+ */
+
+iram static void sampler_timer_callback(void *arg)
+{
+	sampler.due = 1;
+	background_task_wake(background_source_sensor);
+}
+
+irom static void sampler_arm(unsigned int delay)
+{
+	os_timer_disarm(&sampler.timer);
+	os_timer_arm(&sampler.timer, delay, 0);
+}
+
+irom static bool_t sampler_next(void)
+{
+	unsigned int total = i2c_busses * i2c_sensor_size;
+
+	while(sampler.position < total)
+	{
+		sampler.bus = sampler.position / i2c_sensor_size;
+		sampler.sensor = sampler.position % i2c_sensor_size;
+		sampler.position++;
+
+		if(i2c_sensor_detected(sampler.bus, sampler.sensor) &&
+				(device_table[sampler.sensor].read_fn || device_table[sampler.sensor].sample_fn))
+			return(true);
+	}
+
+	return(false);
+}
+
+irom bool_t i2c_sensor_sample(void)
+{
+	unsigned int delay, elapsed;
+
+	if(!sampler.running || !sampler.due)
+		return(false);
+
+	sampler.due = 0;
+
+	if(!sampler.active)
+	{
+		if(sampler.position == 0)
+			sampler.round_start = system_get_time();
+
+		if(!sampler_next())
+		{
+			sampler.position = 0;
+			elapsed = (system_get_time() - sampler.round_start) / 1000;
+			sampler_arm((elapsed < (sensor_sample_interval - sensor_sample_gap)) ? (sensor_sample_interval - elapsed) : sensor_sample_gap);
+			return(false);
+		}
+
+		sampler.state = 0;
+		sampler.active = 1;
+	}
+
+	if((delay = sampler_step()) == 0)
+		delay = sensor_sample_gap;
+
+	sampler_arm(delay);
+
+	return(true);
+}
+
 irom i2c_error_t i2c_sensor_init(int bus, i2c_sensor_t sensor)
 {
 	const device_table_entry_t *entry;
@@ -2256,6 +2696,11 @@ irom i2c_error_t i2c_sensor_init(int bus, i2c_sensor_t sensor)
 
 	entry = &device_table[sensor];
 
+	// a value from before the (re)init may be from a sensor that's gone by now
+
+	sampler_finish(bus, entry->address);
+	sensor_cache_reset(bus, sensor);
+
 	if(!entry->init_fn)
 	{
 		device_data[entry->id].detected &= ~(1 << bus);
@@ -2283,13 +2728,41 @@ irom i2c_error_t i2c_sensor_init(int bus, i2c_sensor_t sensor)
 
 irom void i2c_sensor_init_all(void)
 {
-	int bus;
+	int bus, ix;
 	i2c_sensor_t current;
 
 	for(bus = 0; bus < i2c_busses; bus++)
 		for(current = 0; current < i2c_sensor_size; current++)
 			if((bus == 0) || !(device_data[current].detected & (1 << 0)))
 				i2c_sensor_init(bus, current);
+
+	// not every sensor is initialised again, drop all values so none of a sensor that's gone is served
+
+	for(ix = 0; ix < sensor_cache_size; ix++)
+	{
+		sensor_cache[ix].sensor = i2c_sensor_error;
+		sensor_cache[ix].valid = 0;
+	}
+
+	if(!sampler.running)
+	{
+		os_timer_setfn(&sampler.timer, sampler_timer_callback, (void *)0);
+		sampler.running = 1;
+	}
+
+	sampler.position = 0;
+	sampler.active = 0;
+	sampler_arm(sensor_sample_gap);
+}
+
+/*
+ * factor and offset are in 1/1000, like the value, split the multiplication
+ * so it doesn't overflow 32 bits for any sane factor.
+ */
+
+irom attr_const static int sensor_calibrate(int value, int factor, int offset)
+{
+	return(((value / 1000) * factor) + (((value % 1000) * factor) / 1000) + offset);
 }
 
 irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t verbose, bool_t html)
@@ -2297,9 +2770,9 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 	const device_table_entry_t *entry;
 	i2c_error_t error;
 	value_t value;
-	int current;
+	int current, age;
 	int int_factor, int_offset;
-	double extracooked;
+	int extracooked;
 	string_init(varname_i2s_factor, "i2s.%u.%u.factor");
 	string_init(varname_i2s_offset, "i2s.%u.%u.offset");
 
@@ -2317,22 +2790,12 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 		return(false);
 	}
 
-	if((error = i2c_select_bus(bus)) != i2c_error_ok)
-	{
-		string_format(dst, "i2c sensor read: select bus #%u error", bus);
-		i2c_error_format_string(dst, error);
-		i2c_select_bus(0);
-		return(false);
-	}
-
-	error = i2c_error_ok;
-
 	if(html)
 		string_format(dst, "%u</td><td align=\"right\">%u</td><td align=\"right\">0x%02x</td><td>%s</td><td>%s</td>", bus, sensor, entry->address, entry->name, entry->type);
 	else
 		string_format(dst, "%s sensor %u/%02u@%02x: %s, %s: ", device_data[sensor].detected ? "+" : " ", bus, sensor, entry->address, entry->name, entry->type);
 
-	if((error = entry->read_fn(bus, entry, &value)) == i2c_error_ok)
+	if((error = sensor_read_value(bus, entry, &value, &age)) == i2c_error_ok)
 	{
 		if(!config_get_int(&varname_i2s_factor, bus, sensor, &int_factor))
 			int_factor = 1000;
@@ -2340,19 +2803,19 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 		if(!config_get_int(&varname_i2s_offset, bus, sensor, &int_offset))
 			int_offset = 0;
 
-		extracooked = (value.cooked * int_factor / 1000.0) + (int_offset / 1000.0);
+		extracooked = sensor_calibrate(value.cooked, int_factor, int_offset);
 
 		if(html)
 		{
 			string_append(dst, "<td align=\"right\">");
-			string_double(dst, extracooked, entry->precision, 1e10);
+			string_milli(dst, extracooked, entry->precision, 1000000);
 			string_append(dst, " ");
 			string_format(dst, "%s", entry->unity);
 		}
 		else
 		{
 			string_append(dst, "[");
-			string_double(dst, extracooked, entry->precision, 1e10);
+			string_milli(dst, extracooked, entry->precision, 1000000);
 			string_append(dst, "]");
 			string_format(dst, " %s", entry->unity);
 		}
@@ -2360,10 +2823,11 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 		if(verbose)
 		{
 			string_append(dst, " (uncalibrated: ");
-			string_double(dst, value.cooked, entry->precision, 1e10);
-			string_append(dst, ", raw: ");
-			string_double(dst, value.raw, 0, 1e10);
-			string_append(dst, ")");
+			string_milli(dst, value.cooked, entry->precision, 1000000);
+			string_format(dst, ", raw: %d)", (int)value.raw);
+
+			if(age >= 0)
+				string_format(dst, ", age: %d ms", age);
 		}
 	}
 	else
@@ -2386,12 +2850,38 @@ irom bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t
 			int_offset = 0;
 
 		string_append(dst, ", calibration: factor=");
-		string_double(dst, int_factor / 1000.0, 4, 1e10);
+		string_milli(dst, int_factor, 3, 1000000);
 		string_append(dst, ", offset=");
-		string_double(dst, int_offset / 1000.0, 4, 1e10);
+		string_milli(dst, int_offset, 3, 1000000);
 	}
 
-	i2c_select_bus(0);
+	return(true);
+}
+
+/*
+ * Calibrated value (1/1000 unit) from the background sampler's cache,
+ * never touches the bus.
+ */
+
+irom bool_t i2c_sensor_cached(int bus, i2c_sensor_t sensor, int *value, int *age)
+{
+	const sensor_cache_t *cache;
+	int int_factor, int_offset;
+	string_init(varname_i2s_factor, "i2s.%u.%u.factor");
+	string_init(varname_i2s_offset, "i2s.%u.%u.offset");
+
+	if(!(cache = sensor_cache_find(bus, sensor, false)) || !cache->valid)
+		return(false);
+
+	if(!config_get_int(&varname_i2s_factor, bus, sensor, &int_factor))
+		int_factor = 1000;
+
+	if(!config_get_int(&varname_i2s_offset, bus, sensor, &int_offset))
+		int_offset = 0;
+
+	*value = sensor_calibrate(cache->value.cooked, int_factor, int_offset);
+	*age = (system_get_time() - cache->timestamp) / 1000;
+
 	return(true);
 }
 
@@ -48,5 +48,7 @@ i2c_error_t	i2c_sensor_init(int bus, i2c_sensor_t);
 void		i2c_sensor_init_all(void);
 bool_t		i2c_sensor_read(string_t *, int bus, i2c_sensor_t, bool_t verbose, bool_t html);
 bool_t		i2c_sensor_detected(int bus, i2c_sensor_t);
+bool_t		i2c_sensor_sample(void);
+bool_t		i2c_sensor_cached(int bus, i2c_sensor_t, int *value, int *age);
 
 #endif
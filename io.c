@@ -5,8 +5,12 @@
 #include "io.h"
 #include "i2c.h"
 #include "config.h"
+#include "stats.h"
 #include "util.h"
 
+#include <user_interface.h>
+#include <osapi.h>
+
 io_config_pin_entry_t io_config[io_id_size][max_pins_per_io];
 
 io_info_t io_info =
@@ -25,6 +29,7 @@ io_info_t io_info =
 			.i2c = 1,
 			.uart = 1,
 			.pullup = 1,
+			.frequency = 1,
 		},
 		"Internal GPIO",
 		io_gpio_init,
@@ -150,6 +155,7 @@ static io_mode_trait_t io_mode_traits[io_pin_size] =
 	{ io_pin_uart,				"uart",			"uart"					},
 	{ io_pin_lcd,				"lcd",			"lcd"					},
 	{ io_pin_trigger,			"trigger",		"trigger"				},
+	{ io_pin_frequency,			"frequency",	"frequency"				},
 };
 
 irom static io_pin_mode_t io_mode_from_string(const string_t *src)
@@ -226,6 +232,7 @@ static io_ll_mode_trait_t io_ll_mode_traits[io_pin_ll_size] =
 	{ io_pin_ll_output_analog,		"analog output"		},
 	{ io_pin_ll_i2c,				"i2c"				},
 	{ io_pin_ll_uart,				"uart"				},
+	{ io_pin_ll_frequency,			"frequency"			},
 };
 
 irom void io_string_from_ll_mode(string_t *name, io_pin_ll_mode_t mode, int pad)
@@ -496,6 +503,7 @@ irom static io_error_t io_read_pin_x(string_t *errormsg, const io_info_entry_t *
 		case(io_pin_uart):
 		case(io_pin_lcd):
 		case(io_pin_trigger):
+		case(io_pin_frequency):
 		{
 			if((error = info->read_pin_fn(errormsg, info, pin_data, pin_config, pin, value)) != io_ok)
 				return(error);
@@ -507,6 +515,185 @@ irom static io_error_t io_read_pin_x(string_t *errormsg, const io_info_entry_t *
 	return(io_ok);
 }
 
+// analog fades
+
+/*
+ * A fade moves an analog output from its current value to a target value in
+ * a given time. The value is derived from the elapsed time on every tick,
+ * either linearly or with a gamma of 2 (a linear ramp of the square roots,
+ * squared), which looks even for leds. The io tick writes all fading gpio
+ * pins in one pwm batch.
+ */
+
+enum
+{
+	io_fade_slots = 8,
+};
+
+typedef enum
+{
+	io_fade_linear,
+	io_fade_gamma,
+} io_fade_curve_t;
+
+typedef struct
+{
+	unsigned int	active:1;
+	unsigned int	curve:1;
+	uint8_t			io;
+	uint8_t			pin;
+	int				from;
+	int				to;
+	uint32_t		start;
+	uint32_t		duration;	// us
+} io_fade_t;
+
+static io_fade_t io_fade[io_fade_slots];
+static unsigned int io_fades_active;
+
+irom static unsigned int io_fade_sqrt(uint32_t value)
+{
+	uint32_t root, bit;
+
+	bit = 1UL << 30;
+
+	while(bit > value)
+		bit >>= 2;
+
+	for(root = 0; bit != 0; bit >>= 2)
+	{
+		if(value >= (root + bit))
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+			root >>= 1;
+	}
+
+	return(root);
+}
+
+irom static int io_fade_value(const io_fade_t *fade, uint32_t elapsed)
+{
+	int from, to, value;
+
+	if(elapsed >= fade->duration)
+		return(fade->to);
+
+	if(fade->curve == io_fade_linear)
+		return(fade->from + (int)((int64_t)(fade->to - fade->from) * elapsed / fade->duration));
+
+	// 8 fractional bits in the square root domain
+
+	from = io_fade_sqrt((uint32_t)fade->from << 8);
+	to = io_fade_sqrt((uint32_t)fade->to << 8);
+	value = from + (int)((int64_t)(to - from) * elapsed / fade->duration);
+
+	return((value * value) >> 8);
+}
+
+irom static void io_fade_cancel(const io_data_pin_entry_t *pin_data)
+{
+	unsigned int slot;
+
+	for(slot = 0; slot < io_fade_slots; slot++)
+	{
+		if(io_fade[slot].active && (&io_data[io_fade[slot].io].pin[io_fade[slot].pin] == pin_data))
+		{
+			io_fade[slot].active = 0;
+			io_fades_active--;
+		}
+	}
+}
+
+irom static io_error_t io_fade_start(string_t *errormsg, int io, int pin, int to, unsigned int duration, io_fade_curve_t curve)
+{
+	const io_info_entry_t *info = &io_info[io];
+	io_config_pin_entry_t *pin_config = &io_config[io][pin];
+	io_data_pin_entry_t *pin_data = &io_data[io].pin[pin];
+	io_error_t error;
+	unsigned int slot;
+	int from;
+
+	if(pin_config->mode != io_pin_output_analog)
+	{
+		if(errormsg)
+			string_append(errormsg, "can only fade analog outputs");
+
+		return(io_error);
+	}
+
+	if((error = info->read_pin_fn(errormsg, info, pin_data, pin_config, pin, &from)) != io_ok)
+		return(error);
+
+	io_fade_cancel(pin_data);
+
+	pin_data->direction = io_dir_none;
+	pin_data->speed = 0;
+
+	if(to < 0)
+		to = 0;
+
+	if((pin_config->shared.output_analog.upper_bound > 0) && (to > pin_config->shared.output_analog.upper_bound))
+		to = pin_config->shared.output_analog.upper_bound;
+
+	if(duration == 0)
+		return(info->write_pin_fn(errormsg, info, pin_data, pin_config, pin, to));
+
+	for(slot = 0; slot < io_fade_slots; slot++)
+		if(!io_fade[slot].active)
+			break;
+
+	if(slot >= io_fade_slots)
+	{
+		if(errormsg)
+			string_append(errormsg, "too many fades running");
+
+		return(io_error);
+	}
+
+	io_fade[slot].io = io;
+	io_fade[slot].pin = pin;
+	io_fade[slot].curve = curve;
+	io_fade[slot].from = from;
+	io_fade[slot].to = to;
+	io_fade[slot].start = system_get_time();
+	io_fade[slot].duration = duration * 1000;
+	io_fade[slot].active = 1;
+	io_fades_active++;
+
+	return(io_ok);
+}
+
+irom static void io_fade_periodic(void)
+{
+	const io_info_entry_t *info;
+	io_fade_t *fade;
+	unsigned int slot;
+	uint32_t elapsed;
+
+	for(slot = 0; slot < io_fade_slots; slot++)
+	{
+		fade = &io_fade[slot];
+
+		if(!fade->active)
+			continue;
+
+		info = &io_info[fade->io];
+		elapsed = system_get_time() - fade->start;
+
+		info->write_pin_fn((string_t *)0, info, &io_data[fade->io].pin[fade->pin], &io_config[fade->io][fade->pin], fade->pin,
+				io_fade_value(fade, elapsed));
+
+		if(elapsed >= fade->duration)
+		{
+			fade->active = 0;
+			io_fades_active--;
+		}
+	}
+}
+
 irom static io_error_t io_write_pin_x(string_t *errormsg, const io_info_entry_t *info, io_data_pin_entry_t *pin_data, io_config_pin_entry_t *pin_config, int pin, int value)
 {
 	io_error_t error;
@@ -520,6 +707,7 @@ irom static io_error_t io_write_pin_x(string_t *errormsg, const io_info_entry_t
 		case(io_pin_uart):
 		case(io_pin_error):
 		case(io_pin_trigger):
+		case(io_pin_frequency):
 		{
 			if(errormsg)
 				string_append(errormsg, "cannot write to this pin");
@@ -533,6 +721,9 @@ irom static io_error_t io_write_pin_x(string_t *errormsg, const io_info_entry_t
 		case(io_pin_timer):
 		case(io_pin_output_analog):
 		{
+			if(pin_config->mode == io_pin_output_analog)
+				io_fade_cancel(pin_data);
+
 			if((error = info->write_pin_fn(errormsg, info, pin_data, pin_config, pin, value)) != io_ok)
 				return(error);
 
@@ -543,7 +734,193 @@ irom static io_error_t io_write_pin_x(string_t *errormsg, const io_info_entry_t
 	return(io_ok);
 }
 
-irom static io_error_t io_trigger_pin_x(string_t *errormsg, const io_info_entry_t *info, io_data_pin_entry_t *pin_data, io_config_pin_entry_t *pin_config, int pin, io_trigger_t trigger_type)
+// timer pins
+
+/*
+ * Timer pins aren't counted down by the 10 ms tick. A running timer pin has
+ * a deadline in us and the running pins are kept in a list sorted by
+ * deadline, with one os timer (in us mode) armed for the first one. The next
+ * deadline of a repeating pin follows from the previous deadline, not from
+ * when the callback ran, so the latency doesn't accumulate.
+ */
+
+enum
+{
+	io_timer_queue_size = io_id_size * max_pins_per_io,
+	io_timer_arm_min = 100,			// us
+	io_timer_arm_max = 60000000,	// us, far deadlines are reached in steps
+	io_timer_speed_min = 100,		// us
+	io_timer_speed_max = 1800000000,	// us, deadlines are compared as signed 32 bit us
+};
+
+typedef struct
+{
+	uint8_t io;
+	uint8_t pin;
+} io_timer_entry_t;
+
+static struct
+{
+	ETSTimer			timer;
+	unsigned int		size;
+	io_timer_entry_t	entry[io_timer_queue_size];
+} io_timer;
+
+always_inline static uint32_t io_timer_deadline(unsigned int index)
+{
+	return(io_data[io_timer.entry[index].io].pin[io_timer.entry[index].pin].deadline);
+}
+
+// us left until the deadline, 0 once it has passed
+
+always_inline static uint32_t io_timer_left(uint32_t deadline)
+{
+	int32_t left = (int32_t)(deadline - system_get_time());
+
+	return((left > 0) ? (uint32_t)left : 0);
+}
+
+irom static void io_timer_remove(int io, int pin)
+{
+	unsigned int index;
+
+	for(index = 0; index < io_timer.size; index++)
+		if((io_timer.entry[index].io == io) && (io_timer.entry[index].pin == pin))
+			break;
+
+	if(index >= io_timer.size)
+		return;
+
+	for(io_timer.size--; index < io_timer.size; index++)
+		io_timer.entry[index] = io_timer.entry[index + 1];
+}
+
+irom static void io_timer_insert(int io, int pin, uint32_t deadline)
+{
+	unsigned int index, slot;
+
+	io_timer_remove(io, pin);
+
+	if(io_timer.size >= io_timer_queue_size)
+		return;
+
+	io_data[io].pin[pin].deadline = deadline;
+
+	for(slot = 0; slot < io_timer.size; slot++)
+		if((int32_t)(deadline - io_timer_deadline(slot)) < 0)
+			break;
+
+	for(index = io_timer.size; index > slot; index--)
+		io_timer.entry[index] = io_timer.entry[index - 1];
+
+	io_timer.entry[slot].io = io;
+	io_timer.entry[slot].pin = pin;
+	io_timer.size++;
+}
+
+irom static void io_timer_arm(void)
+{
+	int32_t delay;
+
+	os_timer_disarm(&io_timer.timer);
+
+	if(io_timer.size == 0)
+		return;
+
+	delay = io_timer_deadline(0) - system_get_time();
+
+	if(delay < io_timer_arm_min)
+		delay = io_timer_arm_min;
+
+	if(delay > io_timer_arm_max)
+		delay = io_timer_arm_max;
+
+	os_timer_arm_us(&io_timer.timer, delay, 0);
+}
+
+irom static void io_timer_expire(int io, int pin, uint32_t now)
+{
+	const io_info_entry_t *info = &io_info[io];
+	io_config_pin_entry_t *pin_config = &io_config[io][pin];
+	io_data_pin_entry_t *pin_data = &io_data[io].pin[pin];
+	uint32_t deadline;
+
+	switch(pin_data->direction)
+	{
+		case(io_dir_none):
+		{
+			return;
+		}
+
+		case(io_dir_up):
+		{
+			info->write_pin_fn((string_t *)0, info, pin_data, pin_config, pin, 1);
+			pin_data->direction = io_dir_down;
+			break;
+		}
+
+		case(io_dir_down):
+		{
+			info->write_pin_fn((string_t *)0, info, pin_data, pin_config, pin, 0);
+			pin_data->direction = io_dir_up;
+			break;
+		}
+	}
+
+	if(!pin_config->flags.repeat)
+	{
+		pin_data->direction = io_dir_none;
+		return;
+	}
+
+	deadline = pin_data->deadline + pin_config->speed;
+
+	// more than a period behind, skip the missed transitions instead of catching up in a burst
+
+	if((int32_t)(deadline - now) < 0)
+	{
+		stat_timer_overrun++;
+		deadline = now + pin_config->speed;
+	}
+
+	io_timer_insert(io, pin, deadline);
+}
+
+attr_speed iram static void io_timer_callback(void *arg)
+{
+	io_timer_entry_t entry;
+	uint32_t now, deadline;
+
+	while(io_timer.size > 0)
+	{
+		now = system_get_time();
+		deadline = io_timer_deadline(0);
+
+		if((int32_t)(deadline - now) > 0)
+			break;
+
+		entry = io_timer.entry[0];
+		io_timer_remove(entry.io, entry.pin);
+		stat_latency_record(&stat_timer_jitter, now - deadline, 10);
+		io_timer_expire(entry.io, entry.pin, now);
+	}
+
+	io_timer_arm();
+}
+
+irom static void io_timer_start(int io, int pin)
+{
+	io_timer_insert(io, pin, system_get_time() + io_config[io][pin].speed);
+	io_timer_arm();
+}
+
+irom static void io_timer_stop(int io, int pin)
+{
+	io_timer_remove(io, pin);
+	io_timer_arm();
+}
+
+irom static io_error_t io_trigger_pin_x(string_t *errormsg, int io, const io_info_entry_t *info, io_data_pin_entry_t *pin_data, io_config_pin_entry_t *pin_config, int pin, io_trigger_t trigger_type)
 {
 	io_error_t error;
 	int value = 0, old_value, trigger;
@@ -556,6 +933,7 @@ irom static io_error_t io_trigger_pin_x(string_t *errormsg, const io_info_entry_
 		case(io_pin_i2c):
 		case(io_pin_uart):
 		case(io_pin_error):
+		case(io_pin_frequency):
 		{
 			if(errormsg)
 				string_append(errormsg, "cannot trigger this pin");
@@ -649,8 +1027,8 @@ irom static io_error_t io_trigger_pin_x(string_t *errormsg, const io_info_entry_
 					if((error = info->write_pin_fn(errormsg, info, pin_data, pin_config, pin, value)) != io_ok)
 						return(error);
 
-					pin_data->speed = 0;
 					pin_data->direction = io_dir_none;
+					io_timer_stop(io, pin);
 
 					break;
 				}
@@ -662,8 +1040,8 @@ irom static io_error_t io_trigger_pin_x(string_t *errormsg, const io_info_entry_
 					if((error = info->write_pin_fn(errormsg, info, pin_data, pin_config, pin, value)) != io_ok)
 						return(error);
 
-					pin_data->speed = pin_config->speed;
 					pin_data->direction = pin_config->direction;
+					io_timer_start(io, pin);
 
 					break;
 				}
@@ -685,6 +1063,8 @@ irom static io_error_t io_trigger_pin_x(string_t *errormsg, const io_info_entry_
 			if((error = info->read_pin_fn(errormsg, info, pin_data, pin_config, pin, &value)) != io_ok)
 				return(error);
 
+			io_fade_cancel(pin_data);
+
 			if(trigger_type == io_trigger_toggle)
 			{
 				if(value == 0)
@@ -864,6 +1244,22 @@ irom io_error_t io_read_pin(string_t *error_msg, int io, int pin, int *value)
 	return(error);
 }
 
+// frequency, period and duty cycle of a pin in frequency mode, io_read_pin() only returns the frequency
+
+irom io_error_t io_read_frequency(string_t *error_msg, int io, int pin, unsigned int *frequency, unsigned int *period, unsigned int *duty)
+{
+	if((io != io_id_gpio) || (pin < 0) || (pin >= io_info[io].pins) || (io_config[io][pin].mode != io_pin_frequency))
+	{
+		if(error_msg)
+			string_append(error_msg, "not a frequency pin\n");
+		return(io_error);
+	}
+
+	io_gpio_read_frequency(pin, frequency, period, duty);
+
+	return(io_ok);
+}
+
 irom io_error_t io_write_pin(string_t *error, int io, int pin, int value)
 {
 	const io_info_entry_t *info;
@@ -921,7 +1317,7 @@ irom io_error_t io_trigger_pin(string_t *error, int io, int pin, io_trigger_t tr
 	pin_config = &io_config[io][pin];
 	pin_data = &data->pin[pin];
 
-	return(io_trigger_pin_x(error, info, pin_data, pin_config, pin, trigger_type));
+	return(io_trigger_pin_x(error, io, info, pin_data, pin_config, pin, trigger_type));
 }
 
 irom io_error_t io_traits(string_t *errormsg, int io, int pin, io_pin_mode_t *pinmode, int *low, int *high, int *step, int *current)
@@ -970,6 +1366,18 @@ irom io_error_t io_traits(string_t *errormsg, int io, int pin, io_pin_mode_t *pi
 			return(io_error);
 		}
 
+		case(io_pin_frequency):
+		{
+			*low		= 0;
+			*high		= 0;
+			*step		= 0;
+
+			if((error = io_read_pin_x(errormsg, info, pin_data, pin_config, pin, current)) != io_ok)
+				return(error);
+
+			break;
+		}
+
 		case(io_pin_output_analog):
 		{
 			*low		= pin_config->shared.output_analog.lower_bound;
@@ -999,6 +1407,34 @@ irom io_error_t io_traits(string_t *errormsg, int io, int pin, io_pin_mode_t *pi
 	return(io_ok);
 }
 
+/*
+ * Most pins need no work from the 10 ms tick. Only the pins in service_pins
+ * are visited by io_periodic() and the periodic handler of an io is only
+ * called when it has pins in poll_pins. Update both whenever a pin's mode
+ * changes. Timer pins have their own queue.
+ */
+
+irom static void io_pin_schedule(int io, int pin)
+{
+	io_data_entry_t *data = &io_data[io];
+	const io_config_pin_entry_t *pin_config = &io_config[io][pin];
+	uint32_t mask = 1 << pin;
+
+	data->service_pins &= ~mask;
+	data->poll_pins &= ~mask;
+
+	if(pin_config->mode != io_pin_timer)
+		io_timer_stop(io, pin);
+
+	io_fade_cancel(&data->pin[pin]);
+
+	if((pin_config->mode == io_pin_trigger) || (pin_config->mode == io_pin_output_analog))
+		data->service_pins |= mask;
+
+	if((pin_config->llmode == io_pin_ll_counter) || (pin_config->llmode == io_pin_ll_frequency))
+		data->poll_pins |= mask;
+}
+
 irom void io_init(void)
 {
 	const io_info_entry_t *info;
@@ -1014,6 +1450,7 @@ irom void io_init(void)
 	string_init(varname_llmode, "io.%u.%u.llmode");
 	string_init(varname_flags, "io.%u.%u.flags");
 	string_init(varname_iocounter_debounce, "io.%u.%u.counter.debounce");
+	string_init(varname_iofrequency_gate, "io.%u.%u.frequency.gate");
 	string_init(varname_iotrigger_debounce, "io.%u.%u.trigger.debounce");
 	string_init(varname_iotrigger_io, "io.%u.%u.trigger.io");
 	string_init(varname_iotrigger_pin, "io.%u.%u.trigger.pin");
@@ -1025,6 +1462,7 @@ irom void io_init(void)
 	string_init(varname_iotrigger_1_pin, "io.%u.%u.trigger.1.pin");
 	string_init(varname_iotrigger_1_type, "io.%u.%u.trigger.1.type");
 	string_init(varname_iotimer_delay, "io.%u.%u.timer.delay");
+	string_init(varname_iotimer_delay_us, "io.%u.%u.timer.delay.us");
 	string_init(varname_iotimer_direction, "io.%u.%u.timer.direction");
 	string_init(varname_iooutputa_speed, "io.%u.%u.outputa.speed");
 	string_init(varname_iooutputa_lower, "io.%u.%u.outputa.lower");
@@ -1032,6 +1470,9 @@ irom void io_init(void)
 	string_init(varname_i2c_pinmode, "io.%u.%u.i2c.pinmode");
 	string_init(varname_lcd_pin, "io.%u.%u.lcd.pin");
 
+	io_timer.size = 0;
+	os_timer_setfn(&io_timer.timer, io_timer_callback, (void *)0);
+
 	for(io = 0; io < io_id_size; io++)
 	{
 		info = &io_info[io];
@@ -1096,6 +1537,22 @@ irom void io_init(void)
 					break;
 				}
 
+				case(io_pin_frequency):
+				{
+					int gate;
+
+					if(!info->caps.frequency || !config_get_int(&varname_iofrequency_gate, io, pin, &gate))
+					{
+						pin_config->mode = io_pin_disabled;
+						pin_config->llmode = io_pin_ll_disabled;
+						continue;
+					}
+
+					pin_config->speed = gate;
+
+					break;
+				}
+
 				case(io_pin_trigger):
 				{
 					int debounce, trigger_io, trigger_pin, trigger_type;
@@ -1164,7 +1621,26 @@ irom void io_init(void)
 						continue;
 					}
 
-					if(!config_get_int(&varname_iotimer_delay, io, pin, &speed))
+					// older configs have the delay in ms
+
+					if(config_get_int(&varname_iotimer_delay, io, pin, &speed))
+					{
+						if((speed < 0) || (speed > (io_timer_speed_max / 1000)))
+							speed = -1;
+						else
+							speed *= 1000;
+					}
+					else
+						if(!config_get_int(&varname_iotimer_delay_us, io, pin, &speed))
+						{
+							pin_config->mode = io_pin_disabled;
+							pin_config->llmode = io_pin_ll_disabled;
+							continue;
+						}
+
+					// same range as io-mode accepts, beyond it the signed deadline comparisons break
+
+					if((speed < io_timer_speed_min) || (speed > io_timer_speed_max))
 					{
 						pin_config->mode = io_pin_disabled;
 						pin_config->llmode = io_pin_ll_disabled;
@@ -1267,6 +1743,9 @@ irom void io_init(void)
 			}
 		}
 
+		data->service_pins = 0;
+		data->poll_pins = 0;
+
 		if(info->init_fn(info) == io_ok)
 		{
 			data->detected = true;
@@ -1278,6 +1757,8 @@ irom void io_init(void)
 
 				if(info->init_pin_mode_fn((string_t *)0, info, pin_data, pin_config, pin) == io_ok)
 				{
+					io_pin_schedule(io, pin);
+
 					switch(pin_config->mode)
 					{
 						case(io_pin_disabled):
@@ -1286,6 +1767,7 @@ irom void io_init(void)
 						case(io_pin_input_analog):
 						case(io_pin_uart):
 						case(io_pin_trigger):
+						case(io_pin_frequency):
 						case(io_pin_error):
 						{
 							break;
@@ -1296,7 +1778,7 @@ irom void io_init(void)
 						case(io_pin_timer):
 						{
 							// FIXME: add auto-on flag
-							io_trigger_pin_x((string_t *)0, info, pin_data, pin_config, pin,
+							io_trigger_pin_x((string_t *)0, io, info, pin_data, pin_config, pin,
 									pin_config->flags.autostart ? io_trigger_on : io_trigger_off);
 
 							break;
@@ -1305,7 +1787,7 @@ irom void io_init(void)
 						case(io_pin_output_analog):
 						{
 							// FIXME: add auto-on flag
-							io_trigger_pin_x((string_t *)0, info, pin_data, pin_config, pin,
+							io_trigger_pin_x((string_t *)0, io, info, pin_data, pin_config, pin,
 									pin_config->flags.autostart ? io_trigger_start : io_trigger_stop);
 							break;
 						}
@@ -1337,12 +1819,26 @@ attr_speed iram void io_periodic(void)
 	io_config_pin_entry_t *pin_config;
 	io_data_pin_entry_t *pin_data;
 	int io, pin;
+	uint32_t pins;
 	int trigger_status_io, trigger_status_pin;
 	io_flags_t flags = { .counter_triggered = 0 };
 	int value;
 	int trigger;
-	string_init(varname_trigger_io, "trigger.status.io");
-	string_init(varname_trigger_pin, "trigger.status.pin");
+	static config_handle_t handle_trigger_io, handle_trigger_pin;
+
+	if(!config_handle_bound(&handle_trigger_io))
+	{
+		string_init(varname_trigger_io, "trigger.status.io");
+		string_init(varname_trigger_pin, "trigger.status.pin");
+
+		config_bind(&handle_trigger_io, &varname_trigger_io, -1, -1);
+		config_bind(&handle_trigger_pin, &varname_trigger_pin, -1, -1);
+	}
+
+	io_gpio_pwm_batch(true);
+
+	if(io_fades_active)
+		io_fade_periodic();
 
 	for(io = 0; io < io_id_size; io++)
 	{
@@ -1352,11 +1848,14 @@ attr_speed iram void io_periodic(void)
 		if(!data->detected)
 			continue;
 
-		if(info->periodic_fn)
+		if(info->periodic_fn && data->poll_pins)
 			info->periodic_fn(io, info, data, &flags);
 
-		for(pin = 0; pin < info->pins; pin++)
+		for(pin = 0, pins = data->service_pins; pins != 0; pin++, pins >>= 1)
 		{
+			if(!(pins & 0x01))
+				continue;
+
 			pin_config = &io_config[io][pin];
 			pin_data = &data->pin[pin];
 
@@ -1370,46 +1869,10 @@ attr_speed iram void io_periodic(void)
 				case(io_pin_i2c):
 				case(io_pin_uart):
 				case(io_pin_lcd):
-				case(io_pin_error):
-				{
-					break;
-				}
-
+				case(io_pin_frequency):
 				case(io_pin_timer):
+				case(io_pin_error):
 				{
-					if((pin_data->direction != io_dir_none) && (pin_data->speed >= 10) && ((pin_data->speed -= 10) <= 0))
-					{
-						switch(pin_data->direction)
-						{
-							case(io_dir_none):
-							{
-								break;
-							}
-
-							case(io_dir_up):
-							{
-								info->write_pin_fn((string_t *)0, info, pin_data, pin_config, pin, 1);
-								pin_data->direction = io_dir_down;
-								break;
-							}
-
-							case(io_dir_down):
-							{
-								info->write_pin_fn((string_t *)0, info, pin_data, pin_config, pin, 0);
-								pin_data->direction = io_dir_up;
-								break;
-							}
-						}
-
-						if(pin_config->flags.repeat)
-							pin_data->speed = pin_config->speed;
-						else
-						{
-							pin_data->speed = 0;
-							pin_data->direction = io_dir_none;
-						}
-					}
-
 					break;
 				}
 
@@ -1438,7 +1901,7 @@ attr_speed iram void io_periodic(void)
 				{
 					if((pin_config->shared.output_analog.upper_bound > pin_config->shared.output_analog.lower_bound) &&
 							(pin_config->speed > 0) && (pin_data->direction != io_dir_none))
-						io_trigger_pin_x((string_t *)0, info, pin_data, pin_config, pin,
+						io_trigger_pin_x((string_t *)0, io, info, pin_data, pin_config, pin,
 								(pin_data->direction == io_dir_up) ? io_trigger_up : io_trigger_down);
 
 					break;
@@ -1448,12 +1911,14 @@ attr_speed iram void io_periodic(void)
 	}
 
 	if(flags.counter_triggered &&
-			config_get_int(&varname_trigger_io, -1, -1, &trigger_status_io) &&
-			config_get_int(&varname_trigger_pin, -1, -1, &trigger_status_pin) &&
+			config_handle_get_int(&handle_trigger_io, &trigger_status_io) &&
+			config_handle_get_int(&handle_trigger_pin, &trigger_status_pin) &&
 			(trigger_status_io >= 0) && (trigger_status_pin >= 0))
 	{
 		io_trigger_pin((string_t *)0, trigger_status_io, trigger_status_pin, io_trigger_on);
 	}
+
+	io_gpio_pwm_batch(false);
 }
 
 /* app commands */
@@ -1467,11 +1932,13 @@ irom app_action_t application_function_io_mode(const string_t *src, string_t *ds
 	io_pin_mode_t			mode;
 	io_pin_ll_mode_t		llmode;
 	int io, pin;
+	unsigned int cursor;
 	string_init(varname_io, "io.%u.%u.");
 	string_init(varname_io_mode, "io.%u.%u.mode");
 	string_init(varname_io_llmode, "io.%u.%u.llmode");
 	string_init(varname_io_counter_debounce, "io.%u.%u.counter.debounce");
 	string_init(varname_io_trigger_debounce, "io.%u.%u.trigger.debounce");
+	string_init(varname_io_frequency_gate, "io.%u.%u.frequency.gate");
 	string_init(varname_io_trigger_0_io, "io.%u.%u.trigger.0.io");
 	string_init(varname_io_trigger_0_pin, "io.%u.%u.trigger.0.pin");
 	string_init(varname_io_trigger_0_type, "io.%u.%u.trigger.0.type");
@@ -1479,7 +1946,7 @@ irom app_action_t application_function_io_mode(const string_t *src, string_t *ds
 	string_init(varname_io_trigger_1_pin, "io.%u.%u.trigger.1.pin");
 	string_init(varname_io_trigger_1_type, "io.%u.%u.trigger.1.type");
 	string_init(varname_io_timer_direction, "io.%u.%u.timer.direction");
-	string_init(varname_io_timer_delay, "io.%u.%u.timer.delay");
+	string_init(varname_io_timer_delay_us, "io.%u.%u.timer.delay.us");
 	string_init(varname_io_outputa_lower, "io.%u.%u.outputa.lower");
 	string_init(varname_io_outputa_upper, "io.%u.%u.outputa.upper");
 	string_init(varname_io_outputa_speed, "io.%u.%u.outputa.speed");
@@ -1488,7 +1955,14 @@ irom app_action_t application_function_io_mode(const string_t *src, string_t *ds
 
 	if(parse_int(1, src, &io, 0, ' ') != parse_ok)
 	{
-		io_config_dump(dst, -1, -1, false);
+		cursor = application_cursor();
+
+		if(!io_config_dump(dst, -1, -1, false, &cursor))
+		{
+			application_cursor_set(cursor);
+			return(app_action_more);
+		}
+
 		return(app_action_normal);
 	}
 
@@ -1509,7 +1983,14 @@ irom app_action_t application_function_io_mode(const string_t *src, string_t *ds
 
 	if(parse_int(2, src, &pin, 0, ' ') != parse_ok)
 	{
-		io_config_dump(dst, io, -1, false);
+		cursor = application_cursor();
+
+		if(!io_config_dump(dst, io, -1, false, &cursor))
+		{
+			application_cursor_set(cursor);
+			return(app_action_more);
+		}
+
 		return(app_action_normal);
 	}
 
@@ -1525,7 +2006,7 @@ irom app_action_t application_function_io_mode(const string_t *src, string_t *ds
 	if(parse_string(3, src, dst, ' ') != parse_ok)
 	{
 		string_clear(dst);
-		io_config_dump(dst, io, pin, false);
+		io_config_dump(dst, io, pin, false, (unsigned int *)0);
 		return(app_action_normal);
 	}
 
@@ -1689,6 +2170,35 @@ skip:
 			break;
 		}
 
+		case(io_pin_frequency):
+		{
+			int gate;
+
+			if(!info->caps.frequency)
+			{
+				string_append(dst, "frequency mode invalid for this io\n");
+				return(app_action_error);
+			}
+
+			// the edges are timestamped with the cpu cycle counter, which wraps after 26 seconds at 160 MHz
+
+			if((parse_int(4, src, &gate, 0, ' ') != parse_ok) || (gate < 10) || (gate > 10000))
+			{
+				string_append(dst, "frequency: <gate time ms, 10 - 10000>\n");
+				return(app_action_error);
+			}
+
+			pin_config->speed = gate;
+			llmode = io_pin_ll_frequency;
+
+			config_delete(&varname_io, io, pin, true);
+			config_set_int(&varname_io_mode, io, pin, mode);
+			config_set_int(&varname_io_llmode, io, pin, io_pin_ll_frequency);
+			config_set_int(&varname_io_frequency_gate, io, pin, gate);
+
+			break;
+		}
+
 		case(io_pin_output_digital):
 		{
 			if(!info->caps.output_digital)
@@ -1720,7 +2230,7 @@ skip:
 			if(parse_string(4, src, dst, ' ') != parse_ok)
 			{
 				string_clear(dst);
-				string_append(dst, "timer: <direction>:up/down <speed>:ms\n");
+				string_append(dst, "timer: <direction>:up/down <speed> [ms/us]\n");
 				return(app_action_error);
 			}
 
@@ -1739,13 +2249,29 @@ skip:
 			if((parse_int(5, src, &speed, 0, ' ') != parse_ok))
 			{
 				string_clear(dst);
-				string_append(dst, "timer: <direction>:up/down <speed>:ms\n");
+				string_append(dst, "timer: <direction>:up/down <speed> [ms/us]\n");
 				return(app_action_error);
 			}
 
-			if(speed < 10)
+			if((parse_string(6, src, dst, ' ') != parse_ok) || string_match_cstr(dst, "ms"))
 			{
-				string_append(dst, "timer: speed too small: must be >= 10 ms\n");
+				if((speed < 0) || (speed > (io_timer_speed_max / 1000)))
+					speed = -1;
+				else
+					speed *= 1000;
+			}
+			else
+				if(!string_match_cstr(dst, "us"))
+				{
+					string_append(dst, ": timer unit invalid\n");
+					return(app_action_error);
+				}
+
+			string_clear(dst);
+
+			if((speed < io_timer_speed_min) || (speed > io_timer_speed_max))
+			{
+				string_format(dst, "timer: speed must be between %u us and %u s\n", io_timer_speed_min, io_timer_speed_max / 1000000);
 				return(app_action_error);
 			}
 
@@ -1758,7 +2284,7 @@ skip:
 			config_set_int(&varname_io_mode, io, pin, mode);
 			config_set_int(&varname_io_llmode, io, pin, io_pin_ll_output_digital);
 			config_set_int(&varname_io_timer_direction, io, pin, direction);
-			config_set_int(&varname_io_timer_delay, io, pin, speed);
+			config_set_int(&varname_io_timer_delay_us, io, pin, speed);
 
 			break;
 		}
@@ -1979,19 +2505,25 @@ skip:
 	{
 		pin_config->mode = io_pin_disabled;
 		pin_config->llmode = io_pin_ll_disabled;
+		io_pin_schedule(io, pin);
 		return(app_action_error);
 	}
 
-	io_config_dump(dst, io, pin, false);
+	io_pin_schedule(io, pin);
+
+	io_config_dump(dst, io, pin, false, (unsigned int *)0);
 
 	return(app_action_normal);
 }
 
 irom app_action_t application_function_io_read(const string_t *src, string_t *dst)
 {
+	string_new(stack, selector, 16);
 	const io_info_entry_t *info;
 	io_config_pin_entry_t *pin_config;
+	unsigned int frequency, period, duty;
 	int io, pin, value;
+	bool_t select;
 
 	if(parse_int(1, src, &io, 0, ' ') != parse_ok)
 	{
@@ -2021,6 +2553,16 @@ irom app_action_t application_function_io_read(const string_t *src, string_t *ds
 
 	pin_config = &io_config[io][pin];
 
+	// a frequency pin also has its period (us) and duty cycle (1/1000) measured, selected by a third argument
+
+	select = (pin_config->mode == io_pin_frequency) && (parse_string(3, src, &selector, ' ') == parse_ok);
+
+	if(select && !string_match_cstr(&selector, "frequency") && !string_match_cstr(&selector, "period") && !string_match_cstr(&selector, "duty"))
+	{
+		string_append(dst, "io-read: <io> <pin> [frequency|period|duty]\n");
+		return(app_action_error);
+	}
+
 	io_string_from_mode(dst, pin_config->mode, 0);
 
 	if(pin_config->mode == io_pin_i2c)
@@ -2035,10 +2577,29 @@ irom app_action_t application_function_io_read(const string_t *src, string_t *ds
 		io_string_from_lcd_mode(dst, pin_config->shared.lcd.pin_use);
 	}
 
+	if(select)
+	{
+		string_append(dst, "/");
+		string_append_string(dst, &selector);
+	}
+
 	string_append(dst, ": ");
 
-	if(io_read_pin(dst, io, pin, &value) != io_ok)
-		return(app_action_error);
+	if(select)
+	{
+		if(io_read_frequency(dst, io, pin, &frequency, &period, &duty) != io_ok)
+			return(app_action_error);
+
+		if(string_match_cstr(&selector, "period"))
+			value = period;
+		else if(string_match_cstr(&selector, "duty"))
+			value = duty;
+		else
+			value = frequency;
+	}
+	else
+		if(io_read_pin(dst, io, pin, &value) != io_ok)
+			return(app_action_error);
 
 	string_format(dst, "[%d]\n", value);
 
@@ -2109,6 +2670,67 @@ irom app_action_t application_function_io_write(const string_t *src, string_t *d
 	return(app_action_normal);
 }
 
+irom app_action_t application_function_io_fade(const string_t *src, string_t *dst)
+{
+	int io, pin, value, duration;
+	io_fade_curve_t curve;
+
+	if((parse_int(1, src, &io, 0, ' ') != parse_ok) ||
+			(parse_int(2, src, &pin, 0, ' ') != parse_ok) ||
+			(parse_int(3, src, &value, 0, ' ') != parse_ok) ||
+			(parse_int(4, src, &duration, 0, ' ') != parse_ok))
+	{
+		string_append(dst, "io-fade <io> <pin> <value> <duration ms> [linear/gamma]\n");
+		return(app_action_error);
+	}
+
+	if((io < 0) || (io >= io_id_size))
+	{
+		string_format(dst, "invalid io %d\n", io);
+		return(app_action_error);
+	}
+
+	if((pin < 0) || (pin >= io_info[io].pins))
+	{
+		string_append(dst, "invalid pin\n");
+		return(app_action_error);
+	}
+
+	if((duration < 0) || (duration > 1800000))
+	{
+		string_append(dst, "duration must be between 0 and 1800000 ms\n");
+		return(app_action_error);
+	}
+
+	curve = io_fade_linear;
+
+	if(parse_string(5, src, dst, ' ') == parse_ok)
+	{
+		if(string_match_cstr(dst, "gamma"))
+			curve = io_fade_gamma;
+		else
+			if(!string_match_cstr(dst, "linear"))
+			{
+				string_append(dst, ": invalid curve, use linear or gamma\n");
+				return(app_action_error);
+			}
+	}
+
+	string_clear(dst);
+	string_format(dst, "fade %d/%d to %d in %d ms, %s: ", io, pin, value, duration,
+			(curve == io_fade_gamma) ? "gamma" : "linear");
+
+	if(io_fade_start(dst, io, pin, value, duration, curve) != io_ok)
+	{
+		string_append(dst, "\n");
+		return(app_action_error);
+	}
+
+	string_append(dst, "ok\n");
+
+	return(app_action_normal);
+}
+
 irom app_action_t application_function_io_trigger(const string_t *src, string_t *dst)
 {
 	const io_info_entry_t *info;
@@ -2280,6 +2902,7 @@ typedef enum
 	ds_id_trigger_1,
 	ds_id_trigger_2,
 	ds_id_trigger_3,
+	ds_id_frequency,
 	ds_id_output,
 	ds_id_timer,
 	ds_id_analog_output,
@@ -2326,8 +2949,9 @@ static const roflash dump_string_t roflash_dump_strings =
 		/* ds_id_trigger_1 */		"trigger, counter: %d, debounce: %d\n",
 		/* ds_id_trigger_2 */		"             action #%d: io: %d, pin: %d, action: ",
 		/* ds_id_trigger_3 */		"",
+		/* ds_id_frequency */		"frequency: %u.%03u Hz, gate: %d ms",
 		/* ds_id_output */			"output, state: %s",
-		/* ds_id_timer */			"config direction: %s, speed: %d ms, current direction: %s, delay: %d ms, state: %s",
+		/* ds_id_timer */			"config direction: %s, speed: %u us, current direction: %s, delay: %u us, state: %s",
 		/* ds_id_analog_output */	"analog output, min/static: %d, max: %d, current speed: %d, direction: %s, value: %d, saved value: %d",
 		/* ds_id_i2c_sda */			"sda",
 		/* ds_id_i2c_scl */			"scl",
@@ -2360,8 +2984,9 @@ static const roflash dump_string_t roflash_dump_strings =
 		/* ds_id_trigger_1 */		"<td>counter: %d, debounce: %d, ",
 		/* ds_id_trigger_2 */		"action: #%d, io: %d, pin: %d, trigger action: ",
 		/* ds_id_trigger_3 */		"</td>",
+		/* ds_id_frequency */		"<td>frequency: %u.%03u Hz</td><td>gate: %d ms</td>",
 		/* ds_id_output */			"<td>output</td><td>state: %s</td>",
-		/* ds_id_timer */			"<td>config direction: %s, speed: %d ms, current direction %s, delay: %d ms, state: %s</td>",
+		/* ds_id_timer */			"<td>config direction: %s, speed: %u us, current direction %s, delay: %u us, state: %s</td>",
 		/* ds_analog_output */		"<td>min/static: %d, max: %d, speed: %d, current direction: %s, value: %d, saved value: %d",
 		/* ds_id_i2c_sda */			"<td>sda</td>",
 		/* ds_id_i2c_scl */			"<td>scl</td>",
@@ -2380,7 +3005,12 @@ static const roflash dump_string_t roflash_dump_strings =
 	}
 };
 
-irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
+/*
+ * With a cursor, the dump stops when dst runs short of space and returns
+ * false; *cursor is then 1 + the position (io header or pin) to resume at.
+ */
+
+irom bool io_config_dump(string_t *dst, int io_id, int pin_id, bool html, unsigned int *cursor)
 {
 	const io_info_entry_t *info;
 	io_data_entry_t *data;
@@ -2388,6 +3018,8 @@ irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
 	const io_config_pin_entry_t *pin_config;
 	const string_array_t *roflash_strings;
 	int io, pin, value;
+	unsigned int start, position;
+	bool emitted;
 	io_error_t error;
 
 	if(html)
@@ -2395,31 +3027,59 @@ irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
 	else
 		roflash_strings = &roflash_dump_strings.plain;
 
-	string_append_cstr_flash(dst, (*roflash_strings)[ds_id_table_start]);
+	start = (cursor && *cursor) ? *cursor - 1 : 0;
+	emitted = false;
 
-	for(io = 0; io < io_id_size; io++)
+	if(start == 0)
+		string_append_cstr_flash(dst, (*roflash_strings)[ds_id_table_start]);
+
+	for(io = start / (max_pins_per_io + 1); io < io_id_size; io++)
 	{
 		if((io_id >= 0) && (io_id != io))
 			continue;
 
 		info = &io_info[io];
 		data = &io_data[io];
+		position = io * (max_pins_per_io + 1);
 
-		string_format_flash_ptr(dst, (*roflash_strings)[ds_id_io], io, info->name, info->address);
-
-		if(!data->detected)
+		if(position >= start)
 		{
-			string_append_cstr_flash(dst, (*roflash_strings)[ds_id_not_detected]);
-			continue;
-		}
+			if(cursor && emitted && application_part_full(dst))
+			{
+				*cursor = position + 1;
+				return(false);
+			}
 
-		string_append_cstr_flash(dst, (*roflash_strings)[ds_id_pins_header]);
+			string_format_flash_ptr(dst, (*roflash_strings)[ds_id_io], io, info->name, info->address);
+			emitted = true;
+
+			if(!data->detected)
+			{
+				string_append_cstr_flash(dst, (*roflash_strings)[ds_id_not_detected]);
+				continue;
+			}
+
+			string_append_cstr_flash(dst, (*roflash_strings)[ds_id_pins_header]);
+		}
 
 		for(pin = 0; pin < info->pins; pin++)
 		{
 			if((pin_id >= 0) && (pin_id != pin))
 				continue;
 
+			position = (io * (max_pins_per_io + 1)) + 1 + pin;
+
+			if(position < start)
+				continue;
+
+			if(cursor && emitted && application_part_full(dst))
+			{
+				*cursor = position + 1;
+				return(false);
+			}
+
+			emitted = true;
+
 			pin_config = &io_config[io][pin];
 			pin_data = &data->pin[pin];
 
@@ -2500,6 +3160,17 @@ irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
 					break;
 				}
 
+				case(io_pin_frequency):
+				{
+					if(error == io_ok)
+						string_format_flash_ptr(dst, (*roflash_strings)[ds_id_frequency],
+								(unsigned int)value / 1000, (unsigned int)value % 1000, pin_config->speed);
+					else
+						string_append_cstr_flash(dst, (*roflash_strings)[ds_id_error]);
+
+					break;
+				}
+
 				case(io_pin_output_digital):
 				{
 					if(error == io_ok)
@@ -2517,7 +3188,7 @@ irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
 								pin_config->direction == io_dir_up ? "up" : (pin_config->direction == io_dir_down ? "down" : "none"),
 								pin_config->speed,
 								pin_data->direction == io_dir_up ? "up" : (pin_data->direction == io_dir_down ? "down" : "none"),
-								pin_data->speed,
+								(pin_data->direction == io_dir_none) ? 0 : io_timer_left(pin_data->deadline),
 								onoff(value));
 					else
 						string_append_cstr_flash(dst, (*roflash_strings)[ds_id_error]);
@@ -2584,4 +3255,6 @@ irom void io_config_dump(string_t *dst, int io_id, int pin_id, bool html)
 	}
 
 	string_append_cstr_flash(dst, (*roflash_strings)[ds_id_table_end]);
+
+	return(true);
 }
@@ -75,6 +75,7 @@ typedef enum attr_packed
 	io_pin_uart,
 	io_pin_lcd,
 	io_pin_trigger,
+	io_pin_frequency,
 	io_pin_error,
 	io_pin_size = io_pin_error,
 } io_pin_mode_t;
@@ -119,6 +120,7 @@ typedef enum attr_packed
 	io_pin_ll_output_analog,
 	io_pin_ll_i2c,
 	io_pin_ll_uart,
+	io_pin_ll_frequency,
 	io_pin_ll_error,
 	io_pin_ll_size = io_pin_ll_error
 } io_pin_ll_mode_t;
@@ -155,6 +157,7 @@ typedef struct
 	unsigned int i2c:1;
 	unsigned int uart:1;
 	unsigned int pullup:1;
+	unsigned int frequency:1;
 } io_caps_t;
 
 assert_size(io_caps_t, 4);
@@ -171,11 +174,14 @@ typedef struct
 	uint16_t		speed;
 	io_direction_t	direction;
 	int				saved_value;
+	uint32_t		deadline;		// timer pins: system_get_time() of the next transition
 } io_data_pin_entry_t;
 
 typedef struct
 {
 	unsigned int detected:1;
+	uint32_t service_pins;	// pins io_periodic() has to visit: trigger and analog output
+	uint32_t poll_pins;		// pins that need the periodic handler of the io: counter and frequency
 	io_data_pin_entry_t pin[max_pins_per_io];
 
 } io_data_entry_t;
@@ -240,16 +246,18 @@ assert_size(io_error_t, 4);
 void		io_init(void);
 void		io_periodic(void);
 io_error_t	io_read_pin(string_t *, int, int, int *);
+io_error_t	io_read_frequency(string_t *, int io, int pin, unsigned int *frequency, unsigned int *period, unsigned int *duty);
 io_error_t	io_write_pin(string_t *, int, int, int);
 io_error_t	io_trigger_pin(string_t *, int, int, io_trigger_t);
 io_error_t	io_traits(string_t *, int io, int pin, io_pin_mode_t *mode, int *low, int *high, int *step, int *current);
-void		io_config_dump(string_t *dst, int io_id, int pin_id, bool html);
+bool		io_config_dump(string_t *dst, int io_id, int pin_id, bool html, unsigned int *cursor);
 void		io_string_from_ll_mode(string_t *, io_pin_ll_mode_t, int pad);
 
 app_action_t application_function_io_mode(const string_t *src, string_t *dst);
 app_action_t application_function_io_read(const string_t *src, string_t *dst);
 app_action_t application_function_io_write(const string_t *src, string_t *dst);
 app_action_t application_function_io_trigger(const string_t *src, string_t *dst);
+app_action_t application_function_io_fade(const string_t *src, string_t *dst);
 app_action_t application_function_io_set_flag(const string_t *src, string_t *dst);
 app_action_t application_function_io_clear_flag(const string_t *src, string_t *dst);
 
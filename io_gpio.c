@@ -80,9 +80,23 @@ typedef union
 	struct
 	{
 		unsigned int counter;
-		unsigned int debounce;
+		unsigned int debounce;	// us
+		uint32_t last;			// system_get_time() of the last counted edge
 	} counter;
 
+	struct
+	{
+		unsigned int edges;		// rising edges in this gate
+		uint32_t first;			// ccount of the first rising edge
+		uint32_t last;			// ccount of the latest rising edge
+		uint32_t pending;		// cycles high since the latest rising edge
+		uint32_t high;			// cycles high in completed periods
+		int gate;				// ms left in this gate
+		unsigned int frequency;	// mHz
+		unsigned int period;	// us
+		unsigned int duty;		// 1/1000
+	} frequency;
+
 	struct
 	{
 		int this;
@@ -231,6 +245,8 @@ typedef struct
 	unsigned int	pwm_next_phase_set:1;
 	unsigned int	pwm_cpu_high_speed:1;
 	unsigned int	pwm_int_enabled:1;
+	unsigned int	pwm_batch:1;
+	unsigned int	pwm_batch_changed:1;
 } io_gpio_flags_t;
 
 static unsigned int		pwm_current_phase_set;
@@ -533,6 +549,117 @@ irom static void pwm_go(void)
 	}
 }
 
+/*
+ * Between io_gpio_pwm_batch(true) and io_gpio_pwm_batch(false) duty changes
+ * are only recorded, the phase table is rebuilt once at the end. Used by the
+ * io tick, which may change many analog outputs at once.
+ */
+
+irom void io_gpio_pwm_batch(bool_t start)
+{
+	if(start)
+	{
+		io_gpio_flags.pwm_batch = 1;
+		return;
+	}
+
+	io_gpio_flags.pwm_batch = 0;
+
+	if(io_gpio_flags.pwm_batch_changed)
+	{
+		io_gpio_flags.pwm_batch_changed = 0;
+		pwm_go();
+	}
+}
+
+// counters
+
+/*
+ * Counter pins are counted on the falling edge by the gpio interrupt, instead
+ * of by comparing snapshots every 10 ms tick, so pulses in the kHz range
+ * aren't merged or lost. After an edge has been counted, further edges are
+ * ignored for "debounce" us. The periodic handler only passes on that
+ * something was counted, for the status trigger.
+ */
+
+/*
+ * Frequency pins interrupt on both edges. Each edge is timestamped with the
+ * cpu cycle counter, the period is taken from the first and the latest rising
+ * edge in a gate, so the resolution doesn't depend on the gate time or on
+ * the jitter of the 10 ms tick. The time spent high between those edges gives
+ * the duty cycle. The results are computed in the periodic handler, once per
+ * gate.
+ */
+
+static volatile bool_t gpio_counter_triggered;
+static uint32_t gpio_frequency_pins;
+
+attr_speed iram always_inline static uint32_t gpio_ccount(void)
+{
+	uint32_t ccount;
+
+	asm volatile("rsr %0, ccount" : "=r"(ccount));
+
+	return(ccount);
+}
+
+attr_speed iram static void gpio_isr(void *arg)
+{
+	gpio_data_pin_t *gpio_pin_data;
+	uint32_t status, now, cycles, level;
+	int pin;
+
+	cycles = gpio_ccount();
+	level = gpio_get_all();
+
+	status = gpio_reg_read(GPIO_STATUS_ADDRESS);
+	gpio_reg_write(GPIO_STATUS_W1TC_ADDRESS, status);
+
+	now = system_get_time();
+
+	for(pin = 0; (pin < io_gpio_pin_size) && (status != 0); pin++, status >>= 1, level >>= 1)
+	{
+		if(!(status & 0x01))
+			continue;
+
+		gpio_pin_data = &gpio_data[pin];
+
+		if(gpio_frequency_pins & (1 << pin))
+		{
+			if(level & 0x01)
+			{
+				if(gpio_pin_data->frequency.edges == 0)
+					gpio_pin_data->frequency.first = cycles;
+				else
+					gpio_pin_data->frequency.high += gpio_pin_data->frequency.pending;
+
+				gpio_pin_data->frequency.pending = 0;
+				gpio_pin_data->frequency.last = cycles;
+				gpio_pin_data->frequency.edges++;
+			}
+			else
+				if(gpio_pin_data->frequency.edges > 0)
+					gpio_pin_data->frequency.pending = cycles - gpio_pin_data->frequency.last;
+
+			continue;
+		}
+
+		if((now - gpio_pin_data->counter.last) >= gpio_pin_data->counter.debounce)
+		{
+			gpio_pin_data->counter.counter++;
+			gpio_pin_data->counter.last = now;
+			gpio_counter_triggered = true;
+			stat_pc_counts++;
+		}
+	}
+}
+
+irom static void gpio_isr_setup(void)
+{
+	ETS_GPIO_INTR_ATTACH(gpio_isr, (void *)0);
+	ETS_GPIO_INTR_ENABLE();
+}
+
 // other
 
 irom io_error_t io_gpio_init(const struct io_info_entry_T *info)
@@ -540,62 +667,73 @@ irom io_error_t io_gpio_init(const struct io_info_entry_T *info)
 	pwm_current_phase_set = 0;
 	io_gpio_flags.pwm_reset_phase_set = 0;
 	io_gpio_flags.pwm_next_phase_set = 0;
+	io_gpio_flags.pwm_batch = 0;
+	io_gpio_flags.pwm_batch_changed = 0;
 
 	pwm_phase[0].size = 0;
 	pwm_phase[1].size = 0;
 
 	gpio_init();
 	pwm_isr_setup();
+	gpio_isr_setup();
 
 	return(io_ok);
 }
 
-iram void io_gpio_periodic(int io, const struct io_info_entry_T *info, io_data_entry_t *data, io_flags_t *flags)
+irom static void gpio_frequency_gate(gpio_data_pin_t *gpio_pin_data)
 {
-	static uint32_t gpio_pc_pins_previous;
-	static bool_t first_call = true;
+	unsigned int edges;
+	uint32_t cycles, high, cpu_hz;
+
+	ETS_GPIO_INTR_DISABLE();
+	edges = gpio_pin_data->frequency.edges;
+	cycles = gpio_pin_data->frequency.last - gpio_pin_data->frequency.first;
+	high = gpio_pin_data->frequency.high;
+	gpio_pin_data->frequency.edges = 0;
+	gpio_pin_data->frequency.pending = 0;
+	gpio_pin_data->frequency.high = 0;
+	ETS_GPIO_INTR_ENABLE();
+
+	if((edges < 2) || (cycles == 0))
+	{
+		gpio_pin_data->frequency.frequency = 0;
+		gpio_pin_data->frequency.period = 0;
+		gpio_pin_data->frequency.duty = 0;
+		return;
+	}
 
-	int pin;
-	uint32_t gpio_pc_pins_current;
+	cpu_hz = system_get_cpu_freq() * 1000000;
 
-	gpio_pc_pins_current = gpio_get_all();
+	gpio_pin_data->frequency.frequency = (uint64_t)(edges - 1) * cpu_hz * 1000 / cycles;
+	gpio_pin_data->frequency.period = (uint64_t)cycles * 1000000 / cpu_hz / (edges - 1);
+	gpio_pin_data->frequency.duty = (uint64_t)high * 1000 / cycles;
+}
 
-	if(first_call)
+iram void io_gpio_periodic(int io, const struct io_info_entry_T *info, io_data_entry_t *data, io_flags_t *flags)
+{
+	gpio_data_pin_t *gpio_pin_data;
+	uint32_t pins;
+	int pin;
+
+	if(gpio_counter_triggered)
 	{
-		first_call = false;
-		goto end;
+		gpio_counter_triggered = false;
+		flags->counter_triggered = 1;
 	}
 
-	for(pin = 0; pin < io_gpio_pin_size; pin++)
+	for(pin = 0, pins = gpio_frequency_pins; (pin < io_gpio_pin_size) && (pins != 0); pin++, pins >>= 1)
 	{
-		io_config_pin_entry_t *pin_config = &io_config[io][pin];
+		if(!(pins & 0x01))
+			continue;
 
-		if(pin_config->llmode == io_pin_ll_counter)
-		{
-			gpio_data_pin_t *gpio_pin_data = &gpio_data[pin];
+		gpio_pin_data = &gpio_data[pin];
 
-			if(gpio_pin_data->counter.debounce == 0)
-			{
-				if((gpio_pc_pins_previous & (1 << pin)) && !(gpio_pc_pins_current & (1 << pin)))
-				{
-					gpio_pin_data->counter.counter++;
-					gpio_pin_data->counter.debounce = pin_config->speed;
-					flags->counter_triggered = 1;
-					stat_pc_counts++;
-				}
-			}
-			else
-			{
-				if(gpio_pin_data->counter.debounce >= 10)
-					gpio_pin_data->counter.debounce -= 10; // 10 ms per tick
-				else
-					gpio_pin_data->counter.debounce = 0;
-			}
-		}
-	}
+		if((gpio_pin_data->frequency.gate -= 10) > 0)
+			continue;
 
-end:
-	gpio_pc_pins_previous = gpio_pc_pins_current;
+		gpio_pin_data->frequency.gate = io_config[io][pin].speed;
+		gpio_frequency_gate(gpio_pin_data);
+	}
 }
 
 irom io_error_t io_gpio_init_pin_mode(string_t *error_message, const struct io_info_entry_T *info, io_data_pin_entry_t *pin_data, const io_config_pin_entry_t *pin_config, int pin)
@@ -628,6 +766,8 @@ irom io_error_t io_gpio_init_pin_mode(string_t *error_message, const struct io_i
 
 	gpio_func_select(pin, gpio_info->func);
 	gpio_pin_intr_state_set(pin, GPIO_PIN_INTR_DISABLE);
+	gpio_reg_write(GPIO_STATUS_W1TC_ADDRESS, 1 << pin);
+	gpio_frequency_pins &= ~(1 << pin);
 
 	gpio_pin_data = &gpio_data[pin];
 
@@ -641,13 +781,37 @@ irom io_error_t io_gpio_init_pin_mode(string_t *error_message, const struct io_i
 
 			if(pin_config->llmode == io_pin_ll_counter)
 			{
+				ETS_GPIO_INTR_DISABLE();
 				gpio_pin_data->counter.counter = 0;
-				gpio_pin_data->counter.debounce = 0;
+				gpio_pin_data->counter.debounce = pin_config->speed * 1000;
+				gpio_pin_data->counter.last = system_get_time() - gpio_pin_data->counter.debounce;
+				gpio_pin_intr_state_set(pin, GPIO_PIN_INTR_NEGEDGE);
+				ETS_GPIO_INTR_ENABLE();
 			}
 
 			break;
 		}
 
+		case(io_pin_ll_frequency):
+		{
+			gpio_direction(pin, 0);
+			gpio_pullup(pin, pin_config->flags.pullup);
+
+			ETS_GPIO_INTR_DISABLE();
+			gpio_pin_data->frequency.edges = 0;
+			gpio_pin_data->frequency.pending = 0;
+			gpio_pin_data->frequency.high = 0;
+			gpio_pin_data->frequency.gate = pin_config->speed;
+			gpio_pin_data->frequency.frequency = 0;
+			gpio_pin_data->frequency.period = 0;
+			gpio_pin_data->frequency.duty = 0;
+			gpio_frequency_pins |= 1 << pin;
+			gpio_pin_intr_state_set(pin, GPIO_PIN_INTR_ANYEDGE);
+			ETS_GPIO_INTR_ENABLE();
+
+			break;
+		}
+
 		case(io_pin_ll_output_digital):
 		{
 			gpio_direction(pin, 1);
@@ -726,8 +890,20 @@ irom io_error_t io_gpio_get_pin_info(string_t *dst, const struct io_info_entry_T
 		{
 			case(io_pin_ll_counter):
 			{
-				string_format(dst, "current state: %s, debounce delay: %d",
-						onoff(gpio_get(pin)), gpio_pin_data->counter.debounce);
+				string_format(dst, "current state: %s, debounce: %u us, last count: %u ms ago",
+						onoff(gpio_get(pin)), gpio_pin_data->counter.debounce,
+						(system_get_time() - gpio_pin_data->counter.last) / 1000);
+
+				break;
+			}
+
+			case(io_pin_ll_frequency):
+			{
+				string_format(dst, "frequency: %u.%03u Hz, period: %u us, duty: %u.%u %%, gate: %d ms",
+						gpio_pin_data->frequency.frequency / 1000, gpio_pin_data->frequency.frequency % 1000,
+						gpio_pin_data->frequency.period,
+						gpio_pin_data->frequency.duty / 10, gpio_pin_data->frequency.duty % 10,
+						pin_config->speed);
 
 				break;
 			}
@@ -808,6 +984,13 @@ irom io_error_t io_gpio_read_pin(string_t *error_message, const struct io_info_e
 			break;
 		}
 
+		case(io_pin_ll_frequency):
+		{
+			*value = gpio_pin_data->frequency.frequency;
+
+			break;
+		}
+
 		case(io_pin_ll_output_analog):
 		{
 			*value = gpio_pin_data->pwm.duty;
@@ -843,7 +1026,9 @@ irom io_error_t io_gpio_write_pin(string_t *error_message, const struct io_info_
 	{
 		case(io_pin_ll_counter):
 		{
+			ETS_GPIO_INTR_DISABLE();
 			gpio_pin_data->counter.counter = value;
+			ETS_GPIO_INTR_ENABLE();
 			break;
 		}
 
@@ -863,7 +1048,11 @@ irom io_error_t io_gpio_write_pin(string_t *error_message, const struct io_info_
 			if(gpio_pin_data->pwm.duty != (unsigned int)value)
 			{
 				gpio_pin_data->pwm.duty = value;
-				pwm_go();
+
+				if(io_gpio_flags.pwm_batch)
+					io_gpio_flags.pwm_batch_changed = 1;
+				else
+					pwm_go();
 			}
 
 			break;
@@ -881,6 +1070,17 @@ irom io_error_t io_gpio_write_pin(string_t *error_message, const struct io_info_
 	return(io_ok);
 }
 
+// the results of the latest gate of a pin in frequency mode: mHz, us and 1/1000
+
+irom void io_gpio_read_frequency(int pin, unsigned int *frequency, unsigned int *period, unsigned int *duty)
+{
+	const gpio_data_pin_t *gpio_pin_data = &gpio_data[pin];
+
+	*frequency = gpio_pin_data->frequency.frequency;
+	*period = gpio_pin_data->frequency.period;
+	*duty = gpio_pin_data->frequency.duty;
+}
+
 irom app_action_t application_function_pwm_period(const string_t *src, string_t *dst)
 {
 	int new_pwm_period;
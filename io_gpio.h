@@ -13,6 +13,8 @@ io_error_t	io_gpio_init_pin_mode(string_t *, const struct io_info_entry_T *, io_
 io_error_t	io_gpio_get_pin_info(string_t *, const struct io_info_entry_T *, io_data_pin_entry_t *, const io_config_pin_entry_t *, int);
 io_error_t	io_gpio_read_pin(string_t *, const struct io_info_entry_T *, io_data_pin_entry_t *, const io_config_pin_entry_t *, int, int *);
 io_error_t	io_gpio_write_pin(string_t *, const struct io_info_entry_T *, io_data_pin_entry_t *, const io_config_pin_entry_t *, int, int);
+void		io_gpio_read_frequency(int pin, unsigned int *frequency, unsigned int *period, unsigned int *duty);
+void		io_gpio_pwm_batch(bool_t start);
 
 app_action_t application_function_pwm_period(const string_t *src, string_t *dst);
 
@@ -37,12 +37,6 @@ irom app_action_t application_function_ota_read(const string_t *src, string_t *d
 		return(app_action_error);
 	}
 
-	if(config_uses_logbuffer())
-	{
-		string_append(dst, "ota-read: string read buffer in use\n");
-		return(app_action_error);
-	}
-
 	ota_state = ota_reading;
 	data_transferred = 0;
 
@@ -105,12 +99,6 @@ irom static app_action_t application_function_ota_write_or_dummy(const string_t
 		return(app_action_error);
 	}
 
-	if(config_uses_logbuffer())
-	{
-		string_append(dst, "ota-write: string write buffer in use\n");
-		return(app_action_error);
-	}
-
 	if(parse_int(1, src, &remote_file_length, 0, ' ') != parse_ok)
 	{
 		string_append(dst, "ota-write: invalid/missing file length\n");
@@ -4,8 +4,14 @@
 
 irom void queue_new(queue_t *queue, int size, char *buffer)
 {
+	// round down to a power of two
+
+	while(size & (size - 1))
+		size &= size - 1;
+
 	queue->data = buffer;
 	queue->size = size;
+	queue->mask = size - 1;
 	queue->in = 0;
 	queue->out = 0;
 	queue->lf = 0;
@@ -18,7 +24,17 @@ attr_speed iram attr_pure char queue_empty(const queue_t *queue)
 
 attr_speed iram attr_pure char queue_full(const queue_t *queue)
 {
-	return(((queue->in + 1) % queue->size) == queue->out);
+	return((queue->in - queue->out) >= queue->size);
+}
+
+attr_speed iram attr_pure int queue_length(const queue_t *queue)
+{
+	return(queue->in - queue->out);
+}
+
+attr_speed iram attr_pure int queue_space(const queue_t *queue)
+{
+	return(queue->size - (queue->in - queue->out));
 }
 
 attr_speed iram attr_pure int queue_lf(const queue_t *queue)
@@ -38,19 +54,118 @@ attr_speed iram void queue_push(queue_t *queue, char data)
 	if(data == '\n')
 		queue->lf++;
 
-	queue->data[queue->in] = data;
-	queue->in = (queue->in + 1) % queue->size;
+	queue->data[queue->in & queue->mask] = data;
+	queue->in++;
 }
 
 attr_speed iram char queue_pop(queue_t *queue)
 {
 	char data;
 
-	data = queue->data[queue->out];
-	queue->out = (queue->out + 1) % queue->size;
+	data = queue->data[queue->out & queue->mask];
+	queue->out++;
 
 	if(data == '\n')
 		queue->lf--;
 
 	return(data);
 }
+
+attr_speed iram attr_pure static int queue_count_lf(const char *data, int length)
+{
+	int lf;
+
+	for(lf = 0; length > 0; length--)
+		if(*data++ == '\n')
+			lf++;
+
+	return(lf);
+}
+
+attr_speed iram int queue_push_n(queue_t *queue, const char *data, int length)
+{
+	unsigned int offset, chunk;
+
+	if(length > queue_space(queue))
+		length = queue_space(queue);
+
+	if(length <= 0)
+		return(0);
+
+	offset = queue->in & queue->mask;
+	chunk = queue->size - offset;
+
+	if(chunk > (unsigned int)length)
+		chunk = length;
+
+	memcpy(&queue->data[offset], data, chunk);
+	memcpy(&queue->data[0], data + chunk, length - chunk);
+
+	queue->lf += queue_count_lf(data, length);
+	queue->in += length;
+
+	return(length);
+}
+
+attr_speed iram int queue_pop_n(queue_t *queue, char *data, int length)
+{
+	unsigned int offset, chunk;
+
+	if(length > queue_length(queue))
+		length = queue_length(queue);
+
+	if(length <= 0)
+		return(0);
+
+	offset = queue->out & queue->mask;
+	chunk = queue->size - offset;
+
+	if(chunk > (unsigned int)length)
+		chunk = length;
+
+	memcpy(data, &queue->data[offset], chunk);
+	memcpy(data + chunk, &queue->data[0], length - chunk);
+
+	queue->lf -= queue_count_lf(data, length);
+	queue->out += length;
+
+	return(length);
+}
+
+// return the part of the queued data that can be read without wrapping, consume it with queue_advance()
+
+attr_speed iram int queue_span(const queue_t *queue, char **data)
+{
+	unsigned int offset, length;
+
+	offset = queue->out & queue->mask;
+	length = queue->in - queue->out;
+
+	if(length > (queue->size - offset))
+		length = queue->size - offset;
+
+	*data = &queue->data[offset];
+
+	return(length);
+}
+
+attr_speed iram void queue_advance(queue_t *queue, int length)
+{
+	char *data;
+	int chunk;
+
+	if(length > queue_length(queue))
+		length = queue_length(queue);
+
+	while(length > 0)
+	{
+		chunk = queue_span(queue, &data);
+
+		if(chunk > length)
+			chunk = length;
+
+		queue->lf -= queue_count_lf(data, chunk);
+		queue->out += chunk;
+		length -= chunk;
+	}
+}
@@ -3,21 +3,35 @@
 
 #include <stdint.h>
 
+/*
+ * Single producer / single consumer ring buffer. The size must be a power
+ * of two, in and out are free running and only masked when indexing, so
+ * the full buffer size is usable and the producer only ever writes "in"
+ * and the consumer only ever writes "out".
+ */
+
 typedef struct
 {
 	char *data;
-	int size;
-	int in;
-	int out;
+	unsigned int size;
+	unsigned int mask;
+	unsigned int in;
+	unsigned int out;
 	int lf;
 } queue_t;
 
 void queue_new(queue_t *queue, int size, char *buffer);
 char queue_empty(const queue_t *queue);
 char queue_full(const queue_t *queue);
+int queue_length(const queue_t *queue);
+int queue_space(const queue_t *queue);
 int queue_lf(const queue_t *queue);
 void queue_flush(queue_t *queue);
 void queue_push(queue_t *queue, char data);
 char queue_pop(queue_t *queue);
+int queue_push_n(queue_t *queue, const char *data, int length);
+int queue_pop_n(queue_t *queue, char *data, int length);
+int queue_span(const queue_t *queue, char **data);
+void queue_advance(queue_t *queue, int length);
 
 #endif
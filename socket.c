@@ -33,6 +33,32 @@ iram static socket_t *find_socket(struct espconn *esp_socket)
 	return((socket_t *)0);
 }
 
+iram static int find_child(struct espconn *esp_socket, const socket_t *socket)
+{
+	const esp_tcp *tcp;
+	unsigned int ix;
+
+	for(ix = 0; ix < socket->tcp.children; ix++)
+		if(socket->tcp.child[ix].socket == esp_socket)
+			return(ix);
+
+	// some callbacks get a copy of the connection instead of the original
+
+	for(ix = 0; ix < socket->tcp.children; ix++)
+	{
+		if(!socket->tcp.child[ix].socket)
+			continue;
+
+		tcp = socket->tcp.child[ix].socket->proto.tcp;
+
+		if((tcp->remote_port == esp_socket->proto.tcp->remote_port) &&
+				!memcmp(tcp->remote_ip, esp_socket->proto.tcp->remote_ip, sizeof(tcp->remote_ip)))
+			return(ix);
+	}
+
+	return(-1);
+}
+
 iram static void set_remote(struct espconn *esp_socket, socket_t *socket)
 {
 	switch(esp_socket->type)
@@ -40,11 +66,13 @@ iram static void set_remote(struct espconn *esp_socket, socket_t *socket)
 		case(ESPCONN_TCP):
 		{
 			socket->remote.proto			= proto_tcp;
-			socket->remote.port				= 0;
-			socket->remote.address.byte[0]	= 0;
-			socket->remote.address.byte[1]	= 0;
-			socket->remote.address.byte[2]	= 0;
-			socket->remote.address.byte[3]	= 0;
+			socket->remote.port				= esp_socket->proto.tcp->remote_port;
+			socket->remote.address.byte[0]	= esp_socket->proto.tcp->remote_ip[0];
+			socket->remote.address.byte[1]	= esp_socket->proto.tcp->remote_ip[1];
+			socket->remote.address.byte[2]	= esp_socket->proto.tcp->remote_ip[2];
+			socket->remote.address.byte[3]	= esp_socket->proto.tcp->remote_ip[3];
+			socket->remote.child			= find_child(esp_socket, socket);
+			socket->remote.serial			= (socket->remote.child >= 0) ? socket->tcp.child[socket->remote.child].serial : 0;
 
 			break;
 		}
@@ -61,6 +89,8 @@ iram static void set_remote(struct espconn *esp_socket, socket_t *socket)
 			socket->remote.address.byte[1]	= remote->remote_ip[1];
 			socket->remote.address.byte[2]	= remote->remote_ip[2];
 			socket->remote.address.byte[3]	= remote->remote_ip[3];
+			socket->remote.child			= -1;
+			socket->remote.serial			= 0;
 
 			break;
 		}
@@ -73,10 +103,42 @@ iram static void set_remote(struct espconn *esp_socket, socket_t *socket)
 			socket->remote.address.byte[1]	= 0;
 			socket->remote.address.byte[2]	= 0;
 			socket->remote.address.byte[3]	= 0;
+			socket->remote.child			= -1;
+			socket->remote.serial			= 0;
+
+			break;
+		}
+	}
+}
+
+iram static struct espconn *remote_socket(socket_t *socket, const socket_remote_t *remote, bool_t **send_busy)
+{
+	switch(remote->proto)
+	{
+		case(proto_tcp):
+		{
+			if((remote->child < 0) || (remote->child >= (int)socket->tcp.children) ||
+					!socket->tcp.child[remote->child].socket ||
+					(socket->tcp.child[remote->child].serial != remote->serial))
+				break;
+
+			*send_busy = &socket->tcp.child[remote->child].send_busy;
+			return(socket->tcp.child[remote->child].socket);
+		}
+
+		case(proto_udp):
+		{
+			*send_busy = &socket->udp.send_busy;
+			return(&socket->udp.socket);
+		}
 
+		default:
+		{
 			break;
 		}
 	}
+
+	return((struct espconn *)0);
 }
 
 static void socket_callback_sent(void *arg);
@@ -88,27 +150,37 @@ irom static void socket_callback_accept(void *arg)
 {
 	struct espconn *new_esp_socket = (struct espconn *)arg;
 	socket_t *socket;
+	unsigned int ix;
 
 	if(!(socket = find_socket(new_esp_socket)))
 		goto disconnect;
 
-	if(socket->tcp.child_socket)
+	for(ix = 0; ix < socket->tcp.children; ix++)
+		if(!socket->tcp.child[ix].socket)
+			break;
+
+	if(ix >= socket->tcp.children)
+	{
+		stat_tcp_refused++;
 		goto disconnect;
+	}
 
-	socket->tcp.child_socket = new_esp_socket;
+	socket->tcp.child[ix].socket = new_esp_socket;
+	socket->tcp.child[ix].serial = ++socket->tcp.serial;
+	socket->tcp.child[ix].send_busy = false;
 
 	set_remote(new_esp_socket, socket);
 
-	espconn_regist_recvcb(socket->tcp.child_socket,		socket_callback_received);
-	espconn_regist_sentcb(socket->tcp.child_socket,		socket_callback_sent);
-	espconn_regist_disconcb(socket->tcp.child_socket,	socket_callback_disconnect);
-	espconn_regist_reconcb(socket->tcp.child_socket,	socket_callback_error);
+	espconn_regist_recvcb(new_esp_socket,		socket_callback_received);
+	espconn_regist_sentcb(new_esp_socket,		socket_callback_sent);
+	espconn_regist_disconcb(new_esp_socket,		socket_callback_disconnect);
+	espconn_regist_reconcb(new_esp_socket,		socket_callback_error);
 
-	//espconn_set_opt(socket->tcp.child_socket, ESPCONN_REUSEADDR | ESPCONN_NODELAY);
-	espconn_set_opt(socket->tcp.child_socket, ESPCONN_REUSEADDR);
+	//espconn_set_opt(new_esp_socket, ESPCONN_REUSEADDR | ESPCONN_NODELAY);
+	espconn_set_opt(new_esp_socket, ESPCONN_REUSEADDR);
 
 	if(socket->callback_accept)
-		socket->callback_accept(socket, socket->tcp.child_socket);
+		socket->callback_accept(socket, socket->userdata);
 
 	return;
 
@@ -139,13 +211,23 @@ iram static void socket_callback_sent(void *arg)
 	struct espconn *esp_socket = (struct espconn *)arg;
 	socket_t *socket;
 
+	socket_remote_t remote;
+	struct espconn *send_socket;
+	bool_t *send_busy;
+
 	if(!(socket = find_socket(esp_socket)))
 		return;
 
+	if(esp_socket->type == ESPCONN_TCP)
+		set_remote(esp_socket, socket);
+
+	remote = socket->remote;
+
 	if(socket->callback_sent)
 		socket->callback_sent(socket, socket->userdata);
 
-	socket->send_busy = false;
+	if((send_socket = remote_socket(socket, &remote, &send_busy)))
+		*send_busy = false;
 }
 
 irom static void socket_callback_error(void *arg, int8_t error)
@@ -153,13 +235,23 @@ irom static void socket_callback_error(void *arg, int8_t error)
 	struct espconn *esp_socket = (struct espconn *)arg;
 	socket_t *socket;
 
+	int child;
+
 	if(!(socket = find_socket(esp_socket)))
 		return;
 
+	set_remote(esp_socket, socket);
+
 	if(socket->callback_error)
 		socket->callback_error(socket, error, socket->userdata);
 
-	socket->send_busy = false;
+	// a tcp error ("reconnect" callback) means the connection is gone
+
+	if((child = find_child(esp_socket, socket)) >= 0)
+	{
+		socket->tcp.child[child].socket = (struct espconn *)0;
+		socket->tcp.child[child].send_busy = false;
+	}
 }
 
 irom static void socket_callback_disconnect(void *arg)
@@ -167,63 +259,85 @@ irom static void socket_callback_disconnect(void *arg)
 	struct espconn *esp_socket = (struct espconn *)arg;
 	socket_t *socket;
 
+	int child;
+
 	if(!(socket = find_socket(esp_socket)))
 		return;
 
+	set_remote(esp_socket, socket);
+
 	if(socket->callback_disconnect)
 		socket->callback_disconnect(socket, socket->userdata);
 
-	socket->tcp.child_socket	= (struct espconn *)0;
-	socket->remote.proto		= proto_none;
+	if((child = find_child(esp_socket, socket)) >= 0)
+	{
+		socket->tcp.child[child].socket = (struct espconn *)0;
+		socket->tcp.child[child].send_busy = false;
+	}
 
-	socket->send_busy = false;
+	socket->remote.proto = proto_none;
 }
 
-iram bool_t socket_send(socket_t *socket, string_t *buffer)
+iram bool_t socket_send_to(socket_t *socket, const socket_remote_t *remote, string_t *buffer)
 {
 	struct espconn *esp_socket;
+	bool_t *send_busy;
 
-	if(socket->send_busy)
-		goto error;
+	if(!(esp_socket = remote_socket(socket, remote, &send_busy)) || *send_busy)
+		return(false);
 
-	switch(socket->remote.proto)
+	if(remote->proto == proto_udp)
 	{
-		case(proto_tcp):
-		{
-			esp_socket = socket->tcp.child_socket;
-			break;
-		}
-
-		case(proto_udp):
-		{
-
-			esp_socket = &socket->udp.socket;
-			esp_socket->proto.udp->remote_port	= socket->remote.port;
-			esp_socket->proto.udp->remote_ip[0]	= socket->remote.address.byte[0];
-			esp_socket->proto.udp->remote_ip[1]	= socket->remote.address.byte[1];
-			esp_socket->proto.udp->remote_ip[2]	= socket->remote.address.byte[2];
-			esp_socket->proto.udp->remote_ip[3]	= socket->remote.address.byte[3];
-			break;
-		}
-
-		default:
-		{
-			goto error;
-		}
+		esp_socket->proto.udp->remote_port	= remote->port;
+		esp_socket->proto.udp->remote_ip[0]	= remote->address.byte[0];
+		esp_socket->proto.udp->remote_ip[1]	= remote->address.byte[1];
+		esp_socket->proto.udp->remote_ip[2]	= remote->address.byte[2];
+		esp_socket->proto.udp->remote_ip[3]	= remote->address.byte[3];
 	}
 
-	socket->send_busy = true;
+	*send_busy = true;
 
 	if(espconn_send(esp_socket, string_buffer_nonconst(buffer), string_length(buffer)) == 0)
 		return(true);
 
-error:
-	socket->send_busy = false;
+	*send_busy = false;
 	return(false);
 }
 
+irom void socket_receive_hold(socket_t *socket, const socket_remote_t *remote, bool_t hold)
+{
+	struct espconn *esp_socket;
+	bool_t *send_busy;
+
+	if((remote->proto != proto_tcp) || !(esp_socket = remote_socket(socket, remote, &send_busy)))
+		return;
+
+	if(hold)
+		espconn_recv_hold(esp_socket);
+	else
+		espconn_recv_unhold(esp_socket);
+}
+
+irom void socket_disconnect(socket_t *socket, const socket_remote_t *remote)
+{
+	struct espconn *esp_socket;
+	bool_t *send_busy;
+
+	if((remote->proto == proto_tcp) && (esp_socket = remote_socket(socket, remote, &send_busy)))
+		espconn_disconnect(esp_socket);
+}
+
+irom void socket_disconnect_accepted(socket_t *socket)
+{
+	unsigned int ix;
+
+	for(ix = 0; ix < socket->tcp.children; ix++)
+		if(socket->tcp.child[ix].socket)
+			espconn_disconnect(socket->tcp.child[ix].socket);
+}
+
 irom void socket_create(bool tcp, bool udp, socket_t *socket,
-		int port, int timeout,
+		int port, int timeout, int children,
 		void (*callback_received)(socket_t *, const string_t *, void *userdata),
 		void (*callback_sent)(socket_t *, void *userdata),
 		void (*callback_error)(socket_t *, int, void *userdata),
@@ -231,16 +345,35 @@ irom void socket_create(bool tcp, bool udp, socket_t *socket,
 		void (*callback_accept)(socket_t *, void *userdata),
 		void *userdata)
 {
+	unsigned int ix;
+
 	if(sockets_length >= (sizeof(sockets) / sizeof(*sockets)))
 		return;
 
 	sockets[sockets_length++] = socket;
 
+	if(children < 1)
+		children = 1;
+
+	if(children > socket_tcp_children_max)
+		children = socket_tcp_children_max;
+
+	socket->tcp.children = tcp ? children : 0;
+	socket->tcp.serial = 0;
+
+	for(ix = 0; ix < socket_tcp_children_max; ix++)
+	{
+		socket->tcp.child[ix].socket = (struct espconn *)0;
+		socket->tcp.child[ix].serial = 0;
+		socket->tcp.child[ix].send_busy = false;
+	}
+
+	socket->udp.send_busy = false;
+
 	if(tcp)
 	{
 		memset(&socket->tcp.config, 0, sizeof(socket->tcp.config));
 		memset(&socket->tcp.listen_socket, 0, sizeof(socket->tcp.listen_socket));
-		socket->tcp.child_socket = (struct espconn *)0;
 
 		socket->tcp.config.local_port		= port;
 		socket->tcp.listen_socket.proto.tcp	= &socket->tcp.config;
@@ -248,7 +381,7 @@ irom void socket_create(bool tcp, bool udp, socket_t *socket,
 		socket->tcp.listen_socket.state		= ESPCONN_NONE;
 
 		espconn_regist_connectcb(&socket->tcp.listen_socket, socket_callback_accept);
-		espconn_tcp_set_max_con_allow(&socket->tcp.listen_socket, 1);
+		espconn_tcp_set_max_con_allow(&socket->tcp.listen_socket, children);
 
 		espconn_accept(&socket->tcp.listen_socket);
 		espconn_regist_time(&socket->tcp.listen_socket, timeout, 0); // this must come after accept()
@@ -270,19 +403,19 @@ irom void socket_create(bool tcp, bool udp, socket_t *socket,
 		espconn_create(&socket->udp.socket);
 	}
 
-	socket->remote.proto	= proto_none;
-	socket->send_busy		= false;
-
 	socket->remote.proto			= proto_none;
 	socket->remote.port				= 0;
 	socket->remote.address.byte[0]	= 0;
 	socket->remote.address.byte[1]	= 0;
 	socket->remote.address.byte[2]	= 0;
 	socket->remote.address.byte[3]	= 0;
+	socket->remote.child			= -1;
+	socket->remote.serial			= 0;
 
 	socket->callback_received	= callback_received;
 	socket->callback_sent		= callback_sent;
 	socket->callback_error		= callback_error;
 	socket->callback_disconnect	= callback_disconnect;
 	socket->callback_accept		= callback_accept;
+	socket->userdata			= userdata;
 }
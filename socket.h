@@ -13,29 +13,53 @@ typedef enum
 	proto_both,
 } socket_proto_t;
 
+/*
+ * A tcp listener accepts up to "children" concurrent connections (at most
+ * socket_tcp_children_max). Before a callback is called, "remote" is set to
+ * the peer the event is about; a copy of it can be used later to send to or
+ * disconnect that same peer. The serial is bumped on every accept, so a
+ * stale copy doesn't match a new connection that reuses the child slot.
+ */
+
+enum
+{
+	socket_tcp_children_max = 4,
+};
+
+typedef struct
+{
+	socket_proto_t		proto;
+	int					port;
+	ip_addr_to_bytes_t	address;
+	int					child;
+	unsigned int		serial;
+} socket_remote_t;
+
 typedef struct _socket_t
 {
 	struct
 	{
 		esp_udp			config;
 		struct espconn	socket;
+		bool_t			send_busy;
 	} udp;
 
 	struct
 	{
 		esp_tcp			config;
 		struct espconn	listen_socket;
-		struct espconn	*child_socket;
-	} tcp;
+		unsigned int	children;
+		unsigned int	serial;
 
-	bool_t			send_busy;
+		struct
+		{
+			struct espconn	*socket;
+			unsigned int	serial;
+			bool_t			send_busy;
+		} child[socket_tcp_children_max];
+	} tcp;
 
-	struct
-	{
-		socket_proto_t		proto;
-		int					port;
-		ip_addr_to_bytes_t	address;
-	} remote;
+	socket_remote_t	remote;
 
 	void (*callback_received)(struct _socket_t *, const string_t *, void *userdata);
 	void (*callback_sent)(struct _socket_t *, void *userdata);
@@ -45,10 +69,13 @@ typedef struct _socket_t
 	void *userdata;
 } socket_t;
 
-bool_t socket_send(socket_t *socket, string_t *);
+bool_t socket_send_to(socket_t *socket, const socket_remote_t *remote, string_t *);
+void socket_receive_hold(socket_t *socket, const socket_remote_t *remote, bool_t hold);
+void socket_disconnect(socket_t *socket, const socket_remote_t *remote);
+void socket_disconnect_accepted(socket_t *socket);
 
 void socket_create(bool tcp, bool udp, socket_t *socket,
-		int port, int timeout,
+		int port, int timeout, int children,
 		void (*callback_received)(socket_t *, const string_t *, void *userdata),
 		void (*callback_sent)(socket_t *, void *userdata),
 		void (*callback_error)(socket_t *, int, void *userdata),
@@ -66,10 +93,20 @@ always_inline static void *socket_userdata(socket_t *socket)
 	return(socket->userdata);
 }
 
-always_inline static void socket_disconnect_accepted(socket_t *socket)
+always_inline static bool_t socket_send(socket_t *socket, string_t *buffer)
 {
-	if(socket->tcp.child_socket != (struct espconn *)0)
-		espconn_disconnect(socket->tcp.child_socket);
+	return(socket_send_to(socket, &socket->remote, buffer));
+}
+
+always_inline static bool_t socket_remote_match(const socket_remote_t *a, const socket_remote_t *b)
+{
+	if(a->proto != b->proto)
+		return(false);
+
+	if(a->proto == proto_tcp)
+		return((a->child == b->child) && (a->serial == b->serial));
+
+	return((a->port == b->port) && (a->address.ip_addr.addr == b->address.ip_addr.addr));
 }
 
 #endif
@@ -20,6 +20,8 @@ stat_called_t stat_called =
 
 int stat_uart_rx_interrupts;
 int stat_uart_tx_interrupts;
+int stat_uart_rx_bytes;
+int stat_uart_rx_threshold;
 int stat_fast_timer;
 int stat_slow_timer;
 int stat_timer_interrupts;
@@ -30,17 +32,35 @@ int stat_i2c_init_time_us;
 int stat_display_init_time_us;
 int stat_cmd_receive_buffer_overflow;
 int stat_cmd_send_buffer_overflow;
+int stat_cmd_pipelined;
+int stat_cmd_reply_split;
+int stat_cmd_reply_parts;
+int stat_cmd_binary;
+int stat_cmd_binary_errors;
+int stat_cmd_binary_split;
+int stat_cmd_udp_duplicates;
+int stat_cmd_queued;
+int stat_tcp_refused;
 int stat_uart_receive_buffer_overflow;
 int stat_uart_send_buffer_overflow;
+int stat_uart_rx_dropped;
+int stat_uart_bridge_packets;
+int stat_uart_bridge_bytes;
 
 int stat_update_uart;
 int stat_update_longop;
 int stat_update_command_udp;
 int stat_update_command_tcp;
 int stat_update_display;
+int stat_update_sensor;
 int stat_update_ntp;
 int stat_update_idle;
 
+stat_latency_t stat_background_latency[background_source_size];
+stat_latency_t stat_fast_timer_duration;
+stat_latency_t stat_timer_jitter;
+int stat_timer_overrun;
+
 volatile uint32_t	*stat_stack_sp_initial;
 int					stat_stack_painted;
 
@@ -227,6 +247,7 @@ irom void stats_counters(string_t *dst)
 			"> user_rf_pre_init called: %s\n"
 			"> int uart rx: %u\n"
 			"> int uart tx: %u\n"
+			"> uart rx bytes: %u, int/kb: %u, fifo threshold: %u\n"
 			"> fast timer fired: %u\n"
 			"> slow timer fired: %u\n"
 			"> pwm timer int fired: %u\n"
@@ -236,17 +257,26 @@ irom void stats_counters(string_t *dst)
 			"> longops processed: %u\n"
 			"> commands/udp processed: %u\n"
 			"> commands/tcp processed: %u\n"
+			"> commands pipelined: %u, replies split: %u, output parts: %u\n"
+			"> binary requests: %u, errors: %u, split over packets: %u, udp retransmits replayed: %u\n"
+			"> commands queued behind other clients: %u, tcp connections refused: %u\n"
 			"> display updated: %u\n"
+			"> sensor samples: %u\n"
 			"> ntp updated: %u\n"
 			"> background idle: %u\n"
 			"> cmd receive buffer overflow events: %u\n"
 			"> cmd send buffer overflow events: %u\n"
 			"> uart receive buffer overflow events: %u\n"
-			"> uart send buffer overflow events: %u\n",
+			"> uart send buffer overflow events: %u\n"
+			"> uart rx bytes dropped: %u\n"
+			"> uart bridge packets sent: %u, bytes: %u\n",
 				yesno(stat_called.user_rf_cal_sector_set),
 				yesno(stat_called.user_rf_pre_init),
 				stat_uart_rx_interrupts,
 				stat_uart_tx_interrupts,
+				stat_uart_rx_bytes,
+				(stat_uart_rx_bytes >= 1024) ? stat_uart_rx_interrupts / (stat_uart_rx_bytes / 1024) : 0,
+				stat_uart_rx_threshold,
 				stat_fast_timer,
 				stat_slow_timer,
 				stat_pwm_timer_interrupts,
@@ -256,13 +286,26 @@ irom void stats_counters(string_t *dst)
 				stat_update_longop,
 				stat_update_command_udp,
 				stat_update_command_tcp,
+				stat_cmd_pipelined,
+				stat_cmd_reply_split,
+				stat_cmd_reply_parts,
+				stat_cmd_binary,
+				stat_cmd_binary_errors,
+				stat_cmd_binary_split,
+				stat_cmd_udp_duplicates,
+				stat_cmd_queued,
+				stat_tcp_refused,
 				stat_update_display,
+				stat_update_sensor,
 				stat_update_ntp,
 				stat_update_idle,
 				stat_cmd_receive_buffer_overflow,
 				stat_cmd_send_buffer_overflow,
 				stat_uart_receive_buffer_overflow,
-				stat_uart_send_buffer_overflow);
+				stat_uart_send_buffer_overflow,
+				stat_uart_rx_dropped,
+				stat_uart_bridge_packets,
+				stat_uart_bridge_bytes);
 }
 
 irom void stats_i2c(string_t *dst)
@@ -351,3 +394,61 @@ irom void stats_wlan(string_t *dst)
 	string_ip(dst, ip_addr_info.netmask);
 	string_append(dst, "\n");
 }
+
+attr_speed iram void stat_latency_record(stat_latency_t *latency, uint32_t us, uint32_t limit)
+{
+	unsigned int bucket;
+
+	for(bucket = 0; (bucket < (stat_latency_buckets - 1)) && (us >= limit); bucket++)
+		limit *= 10;
+
+	latency->histogram[bucket]++;
+	latency->runs++;
+
+	if(us > latency->max_us)
+		latency->max_us = us;
+}
+
+irom void stats_scheduler(string_t *dst)
+{
+	static const char *source_name[background_source_size] =
+	{
+		"bridge",
+		"longop",
+		"command",
+		"display",
+		"sensor",
+	};
+
+	const stat_latency_t *latency;
+	unsigned int source;
+
+	string_append(dst, "> latency from ready to run, <100us <1ms <10ms <100ms <1s >=1s\n");
+
+	for(source = 0; source < background_source_size; source++)
+	{
+		latency = &stat_background_latency[source];
+
+		string_format(dst, "> %s runs: %u, max: %u us, %u %u %u %u %u %u\n",
+				source_name[source], latency->runs, latency->max_us,
+				latency->histogram[0], latency->histogram[1], latency->histogram[2],
+				latency->histogram[3], latency->histogram[4], latency->histogram[5]);
+	}
+
+	latency = &stat_fast_timer_duration;
+
+	string_append(dst, "> io tick duration, <10us <100us <1ms <10ms <100ms >=100ms\n");
+	string_format(dst, "> io ticks: %u, max: %u us, %u %u %u %u %u %u\n",
+			latency->runs, latency->max_us,
+			latency->histogram[0], latency->histogram[1], latency->histogram[2],
+			latency->histogram[3], latency->histogram[4], latency->histogram[5]);
+
+	latency = &stat_timer_jitter;
+
+	string_append(dst, "> timer pin lateness, <10us <100us <1ms <10ms <100ms >=100ms\n");
+	string_format(dst, "> timer transitions: %u, max: %u us, %u %u %u %u %u %u, periods skipped: %u\n",
+			latency->runs, latency->max_us,
+			latency->histogram[0], latency->histogram[1], latency->histogram[2],
+			latency->histogram[3], latency->histogram[4], latency->histogram[5],
+			stat_timer_overrun);
+}
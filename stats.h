@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "util.h"
+#include "user_main.h"
 
 enum
 {
@@ -11,6 +12,18 @@ enum
 	stack_bottom = 0x40000000 - sizeof(void *)
 };
 
+enum
+{
+	stat_latency_buckets = 6, // decades, starting at the first limit passed to stat_latency_record
+};
+
+typedef struct
+{
+	unsigned int runs;
+	unsigned int max_us;
+	unsigned int histogram[stat_latency_buckets];
+} stat_latency_t;
+
 typedef struct
 {
 	unsigned int user_rf_cal_sector_set:1;
@@ -21,6 +34,8 @@ extern stat_called_t stat_called;
 
 extern int stat_uart_rx_interrupts;
 extern int stat_uart_tx_interrupts;
+extern int stat_uart_rx_bytes;
+extern int stat_uart_rx_threshold;
 extern int stat_fast_timer;
 extern int stat_slow_timer;
 extern int stat_pwm_timer_interrupts;
@@ -30,17 +45,35 @@ extern int stat_i2c_init_time_us;
 extern int stat_display_init_time_us;
 extern int stat_cmd_receive_buffer_overflow;
 extern int stat_cmd_send_buffer_overflow;
+extern int stat_cmd_pipelined;
+extern int stat_cmd_reply_split;
+extern int stat_cmd_reply_parts;
+extern int stat_cmd_binary;
+extern int stat_cmd_binary_errors;
+extern int stat_cmd_binary_split;
+extern int stat_cmd_udp_duplicates;
+extern int stat_cmd_queued;
+extern int stat_tcp_refused;
 extern int stat_uart_receive_buffer_overflow;
 extern int stat_uart_send_buffer_overflow;
+extern int stat_uart_rx_dropped;
+extern int stat_uart_bridge_packets;
+extern int stat_uart_bridge_bytes;
 
 extern int stat_update_uart;
 extern int stat_update_longop;
 extern int stat_update_command_udp;
 extern int stat_update_command_tcp;
 extern int stat_update_display;
+extern int stat_update_sensor;
 extern int stat_update_ntp;
 extern int stat_update_idle;
 
+extern stat_latency_t stat_background_latency[background_source_size];
+extern stat_latency_t stat_fast_timer_duration;
+extern stat_latency_t stat_timer_jitter;
+extern int stat_timer_overrun;
+
 extern volatile uint32_t *stat_stack_sp_initial;
 extern int stat_stack_painted;
 
@@ -49,4 +82,6 @@ void stats_time(string_t *dst);
 void stats_counters(string_t *dst);
 void stats_i2c(string_t *dst);
 void stats_wlan(string_t *dst);
+void stats_scheduler(string_t *dst);
+void stat_latency_record(stat_latency_t *latency, uint32_t us, uint32_t limit);
 #endif
@@ -0,0 +1,149 @@
+#ifndef application_host_h
+#define application_host_h
+
+/*
+ * Host build of application.c: the source is included so the tests can
+ * reach its static command table and lookup. The modules it dispatches to
+ * are replaced by the stand-ins below, which do nothing.
+ */
+
+#include "test.h"
+
+// io_gpio.h needs the SoC registers, application.c only uses this from it
+
+#define io_gpio_h
+#include "io.h"
+
+app_action_t application_function_pwm_period(const string_t *src, string_t *dst);
+
+#include "application.c"
+
+#define application_host_handler(name) \
+	app_action_t name(const string_t *src, string_t *dst) \
+	{ \
+		return(app_action_error); \
+	}
+
+application_host_handler(application_function_display_brightness)
+application_host_handler(application_function_display_default_message)
+application_host_handler(application_function_display_dump)
+application_host_handler(application_function_display_flip_timeout)
+application_host_handler(application_function_display_set)
+application_host_handler(application_function_http_get)
+application_host_handler(application_function_io_clear_flag)
+application_host_handler(application_function_io_fade)
+application_host_handler(application_function_io_mode)
+application_host_handler(application_function_io_read)
+application_host_handler(application_function_io_set_flag)
+application_host_handler(application_function_io_trigger)
+application_host_handler(application_function_io_write)
+application_host_handler(application_function_ota_commit)
+application_host_handler(application_function_ota_finish)
+application_host_handler(application_function_ota_read)
+application_host_handler(application_function_ota_receive)
+application_host_handler(application_function_ota_send)
+application_host_handler(application_function_ota_write)
+application_host_handler(application_function_ota_write_dummy)
+application_host_handler(application_function_pwm_period)
+
+i2c_error_t i2c_send(int address, bool_t sendstop, int length, const uint8_t *bytes)
+{
+	return(i2c_error_address_nak);
+}
+
+bool_t i2c_sensor_detected(int bus, i2c_sensor_t sensor)
+{
+	return(false);
+}
+
+i2c_error_t i2c_sensor_init(int bus, i2c_sensor_t sensor)
+{
+	return(i2c_error_address_nak);
+}
+
+bool_t i2c_sensor_read(string_t *dst, int bus, i2c_sensor_t sensor, bool_t verbose, bool_t html)
+{
+	return(false);
+}
+
+io_error_t io_trigger_pin(string_t *dst, int io, int pin, io_trigger_t trigger)
+{
+	return(io_error);
+}
+
+void stats_counters(string_t *dst)
+{
+}
+
+void stats_firmware(string_t *dst)
+{
+}
+
+void stats_i2c(string_t *dst)
+{
+}
+
+void stats_scheduler(string_t *dst)
+{
+}
+
+void stats_time(string_t *dst)
+{
+}
+
+void stats_wlan(string_t *dst)
+{
+}
+
+const char *time_get(unsigned int *h, unsigned int *m, unsigned int *s, unsigned int *Y, unsigned int *M, unsigned int *D)
+{
+	*h = *m = *s = *Y = *M = *D = 0;
+
+	return("none");
+}
+
+void time_ntp_init(void)
+{
+}
+
+void time_set_hms(unsigned int h, unsigned int m, unsigned int s)
+{
+}
+
+void time_set_stamp(unsigned int base)
+{
+}
+
+void uart_parity_to_string(string_t *dst, uart_parity_t parity)
+{
+}
+
+void uart_rx_config(int threshold, int timeout, bool_t adaptive)
+{
+}
+
+uart_parity_t uart_string_to_parity(const string_t *src)
+{
+	return(parity_error);
+}
+
+bool_t wlan_init(void)
+{
+	return(false);
+}
+
+// the lookup before the alias index: the first entry with a matching alias wins
+
+static const application_function_table_t *application_lookup_linear(const string_t *command)
+{
+	const application_function_table_t *tableptr;
+
+	for(tableptr = application_function_table; tableptr->function; tableptr++)
+		if(string_match_cstr(command, tableptr->command1) ||
+				string_match_cstr(command, tableptr->command2))
+			return(tableptr);
+
+	return((const application_function_table_t *)0);
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "test.h"
+
+/*
+ * Command lookups per second: the linear scan over the command table as it
+ * was before the alias index, against the binary search on the index. The
+ * commands are all aliases in table order, the last command in the table
+ * and a word that matches nothing, the worst case for the linear scan.
+ */
+
+#include "application_host.h"
+
+enum
+{
+	rounds = 1024 * 1024,
+};
+
+static const application_function_table_t *volatile sink;
+
+static void report(const char *name, uint64_t start)
+{
+	uint64_t us = test_time_us() - start;
+
+	test_log("%-32s %8.1f ns/lookup\n", name, ((double)us * 1000) / rounds);
+}
+
+int main(int argc, const char **argv)
+{
+	string_t commands[2 * 128];
+	string_t last, none;
+	const application_function_table_t *entry;
+	unsigned int count, ix;
+	uint64_t start;
+
+	for(count = 0, entry = application_function_table; entry->function; entry++)
+	{
+		commands[count++] = string_from_cstr(strlen(entry->command1) + 1, (char *)(uintptr_t)entry->command1);
+		commands[count++] = string_from_cstr(strlen(entry->command2) + 1, (char *)(uintptr_t)entry->command2);
+	}
+
+	last = commands[count - 1];
+	none = string_from_cstr(16, (char *)(uintptr_t)"no-such-command");
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+		sink = application_lookup_linear(&commands[ix % count]);
+
+	report("linear scan, every alias", start);
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+		sink = application_lookup(&commands[ix % count]);
+
+	report("alias index, every alias", start);
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+		sink = application_lookup_linear(&last);
+
+	report("linear scan, last entry", start);
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+		sink = application_lookup(&last);
+
+	report("alias index, last entry", start);
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+		sink = application_lookup_linear(&none);
+
+	report("linear scan, no match", start);
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+		sink = application_lookup(&none);
+
+	report("alias index, no match", start);
+
+	return(test_done(argv[0]));
+}
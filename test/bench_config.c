@@ -0,0 +1,132 @@
+#include "test.h"
+
+/*
+ * Lookups per second with all config entry slots in use: config_get_int()
+ * through the hash index, the same lookup with a linear scan over the entries
+ * as it was before the index, and a bound handle. The ids are looked up in
+ * table order, the last entry and an id that isn't there are the worst case
+ * for the linear scan.
+ */
+
+#include "config.c"
+
+enum
+{
+	rounds = 1024 * 1024,
+};
+
+static volatile int sink;
+
+static bool_t config_get_int_linear(const string_t *id, int index1, int index2, int *value)
+{
+	const string_t *varid;
+	unsigned int ix;
+
+	varid = expand_varid(id, index1, index2);
+
+	for(ix = 0; ix < config_entries_length; ix++)
+	{
+		if((config_entries[ix].id_length == string_length(varid)) &&
+				!memcmp(config_entry_id(&config_entries[ix]), string_buffer(varid), string_length(varid)))
+		{
+			*value = config_entries[ix].int_value;
+			return(true);
+		}
+	}
+
+	return(false);
+}
+
+static void report(const char *name, uint64_t start)
+{
+	uint64_t us = test_time_us() - start;
+
+	test_log("%-32s %8.1f M/s\n", name, (double)rounds / (double)(us ? us : 1));
+}
+
+int main(int argc, const char **argv)
+{
+	string_init(id_template, "io.%u.%u.mode");
+	string_init(none, "io.9.9.mode");
+	config_handle_t handle;
+	unsigned int ix;
+	uint64_t start;
+	int value;
+
+	string_crc32_init();
+	flash_sim_erase();
+	config_read();
+
+	for(ix = 0; config_entries_length < config_entries_size; ix++)
+		if(!config_set_int(&id_template, ix / 16, ix % 16, ix))
+			test_fail("config full after %u entries", config_entries_length);
+
+	test_log("%u entries\n", config_entries_length);
+
+	start = test_time_us();
+
+	for(ix = 0, value = 0; ix < rounds; ix++)
+	{
+		config_get_int_linear(&id_template, (ix % 127) / 16, (ix % 127) % 16, &value);
+		sink = value;
+	}
+
+	report("linear scan, every entry", start);
+
+	start = test_time_us();
+
+	for(ix = 0, value = 0; ix < rounds; ix++)
+	{
+		config_get_int(&id_template, (ix % 127) / 16, (ix % 127) % 16, &value);
+		sink = value;
+	}
+
+	report("index, every entry", start);
+
+	start = test_time_us();
+
+	for(ix = 0, value = 0; ix < rounds; ix++)
+	{
+		config_get_int_linear(&id_template, 126 / 16, 126 % 16, &value);
+		sink = value;
+	}
+
+	report("linear scan, last entry", start);
+
+	start = test_time_us();
+
+	for(ix = 0, value = 0; ix < rounds; ix++)
+	{
+		config_get_int(&id_template, 126 / 16, 126 % 16, &value);
+		sink = value;
+	}
+
+	report("index, last entry", start);
+
+	start = test_time_us();
+
+	for(ix = 0, value = 0; ix < rounds; ix++)
+		sink = config_get_int_linear(&none, -1, -1, &value);
+
+	report("linear scan, no match", start);
+
+	start = test_time_us();
+
+	for(ix = 0, value = 0; ix < rounds; ix++)
+		sink = config_get_int(&none, -1, -1, &value);
+
+	report("index, no match", start);
+
+	config_bind(&handle, &id_template, 126 / 16, 126 % 16);
+	start = test_time_us();
+
+	for(ix = 0, value = 0; ix < rounds; ix++)
+	{
+		config_handle_get_int(&handle, &value);
+		sink = value;
+	}
+
+	report("bound handle", start);
+
+	return(test_done(argv[0]));
+}
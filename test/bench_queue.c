@@ -0,0 +1,115 @@
+#include "test.h"
+
+#include "queue.h"
+
+/*
+ * Bytes per second through the queue: the byte at a time queue with a
+ * modulo on every push and pop as it was before the power of two rework,
+ * the current queue one byte at a time and the current queue in bulk.
+ */
+
+enum
+{
+	queue_size = 1024,
+	chunk_size = 128,
+	total_bytes = 256 * 1024 * 1024,
+};
+
+typedef struct
+{
+	char *data;
+	int size;
+	int in;
+	int out;
+	int lf;
+} old_queue_t;
+
+static char buffer[queue_size];
+static char chunk[chunk_size];
+static volatile char sink;
+
+static void old_queue_push(old_queue_t *queue, char data)
+{
+	if(data == '\n')
+		queue->lf++;
+
+	queue->data[queue->in] = data;
+	queue->in = (queue->in + 1) % queue->size;
+}
+
+static char old_queue_pop(old_queue_t *queue)
+{
+	char data;
+
+	data = queue->data[queue->out];
+	queue->out = (queue->out + 1) % queue->size;
+
+	if(data == '\n')
+		queue->lf--;
+
+	return(data);
+}
+
+static void report(const char *name, uint64_t start)
+{
+	uint64_t us = test_time_us() - start;
+
+	test_log("%-24s %8.1f Mbyte/s\n", name, (double)total_bytes / (double)(us ? us : 1));
+}
+
+int main(int argc, const char **argv)
+{
+	old_queue_t old_queue = { buffer, queue_size - 1, 0, 0, 0 };	// the old queue wastes one byte
+	queue_t queue;
+	uint64_t start;
+	unsigned int done, ix;
+	char c;
+
+	for(ix = 0; ix < chunk_size; ix++)
+		chunk[ix] = (ix % 40) ? 'x' : '\n';
+
+	start = test_time_us();
+
+	for(done = 0; done < total_bytes; done += chunk_size)
+	{
+		for(ix = 0; ix < chunk_size; ix++)
+			old_queue_push(&old_queue, chunk[ix]);
+
+		for(ix = 0, c = 0; ix < chunk_size; ix++)
+			c ^= old_queue_pop(&old_queue);
+
+		sink = c;
+	}
+
+	report("old, byte at a time", start);
+
+	queue_new(&queue, queue_size, buffer);
+	start = test_time_us();
+
+	for(done = 0; done < total_bytes; done += chunk_size)
+	{
+		for(ix = 0; ix < chunk_size; ix++)
+			queue_push(&queue, chunk[ix]);
+
+		for(ix = 0, c = 0; ix < chunk_size; ix++)
+			c ^= queue_pop(&queue);
+
+		sink = c;
+	}
+
+	report("new, byte at a time", start);
+
+	queue_new(&queue, queue_size, buffer);
+	start = test_time_us();
+
+	for(done = 0; done < total_bytes; done += chunk_size)
+	{
+		queue_push_n(&queue, chunk, chunk_size);
+		queue_pop_n(&queue, chunk, chunk_size);
+		sink = chunk[0];
+	}
+
+	report("new, push_n/pop_n", start);
+
+	return(test_done(argv[0]));
+}
@@ -0,0 +1,169 @@
+#include "test.h"
+
+/*
+ * Conversions per second of the bme280 and tsl2560 compensation, the double
+ * precision versions as they were before the fixed point rework against the
+ * current integer versions. The host has a floating point unit, the lx106
+ * emulates doubles in software, so on the device the difference is larger.
+ */
+
+#include "i2c_sensor.c"
+
+enum
+{
+	rounds = 4 * 1024 * 1024,
+};
+
+static volatile double double_sink;
+static volatile int32_t int_sink;
+
+static void bme280_double(int32_t adc_T, int32_t adc_P, int32_t adc_H, double *temperature, double *pressure, double *humidity)
+{
+	double var1, var2;
+	int32_t t_fine;
+
+	var1 = (adc_T / 16384.0 - bme280.dig_T1 / 1024.0) * bme280.dig_T2;
+	var2 = ((adc_T / 131072.0 - bme280.dig_T1 / 8192.0) * (adc_T / 131072.0 - bme280.dig_T1 / 8192.0)) * bme280.dig_T3;
+
+	t_fine = (int32_t)(var1 + var2);
+
+	*temperature = (var1 + var2) / 5120.0;
+
+	var1 = (t_fine / 2.0) - 64000.0;
+	var2 = var1 * var1 * bme280.dig_P6 / 32768.0;
+	var2 = var2 + var1 * bme280.dig_P5 * 2.0;
+	var2 = (var2 / 4.0) + (bme280.dig_P4 * 65536.0);
+	var1 = (bme280.dig_P3 * var1 * var1 / 524288.0 + bme280.dig_P2 * var1) / 524288.0;
+	var1 = (1.0 + var1 / 32768.0) * bme280.dig_P1;
+
+	if(var1 < 0.0001)
+		*pressure = 0;
+	else
+	{
+		*pressure = 1048576.0 - adc_P;
+		*pressure = (*pressure - (var2 / 4096.0)) * 6250.0 / var1;
+		var1 = bme280.dig_P9 * *pressure * *pressure / 2147483648.0;
+		var2 = *pressure * bme280.dig_P8 / 32768.0;
+		*pressure = *pressure + (var1 + var2 + bme280.dig_P7) / 16.0;
+		*pressure /= 100.0;
+	}
+
+	*humidity = (t_fine - 76800.0);
+	*humidity = (adc_H - (bme280.dig_H4 * 64.0 + bme280.dig_H5 / 16384.0 * *humidity)) * (bme280.dig_H2 / 65536.0 * (1.0 + bme280.dig_H6 / 67108864.0 * *humidity * (1.0 + bme280.dig_H3 / 67108864.0 * *humidity)));
+	*humidity = *humidity * (1.0 - bme280.dig_H1 * *humidity / 524288.0);
+
+	if(*humidity > 100.0)
+		*humidity = 100.0;
+
+	if(*humidity < 0.0)
+		*humidity = 0.0;
+}
+
+typedef struct
+{
+	double ratio_top;
+	double ch0_factor;
+	double ch1_factor;
+} tsl2560_double_lookup_t;
+
+static const tsl2560_double_lookup_t tsl2560_double_lookup[] =
+{
+	{ 0.125, 0.03040, 0.02720 },
+	{ 0.250, 0.03250, 0.04400 },
+	{ 0.375, 0.03510, 0.05440 },
+	{ 0.500, 0.03810, 0.06240 },
+	{ 0.610, 0.02240, 0.03100 },
+	{ 0.800, 0.01280, 0.01530 },
+	{ 1.300, 0.00146, 0.00112 },
+	{ 0.000, 0.00000, 0.00000 }
+};
+
+static double tsl2560_double(unsigned int ch0r, unsigned int ch1r)
+{
+	const tsl2560_double_lookup_t *entry;
+	double ch0, ch1, ratio, lux;
+
+	ch0 = ch0r;
+	ch1 = ch1r;
+
+	ratio = ch0r ? (ch1 / ch0) : 0;
+
+	for(entry = tsl2560_double_lookup; entry->ratio_top > 0; entry++)
+		if(ratio <= entry->ratio_top)
+			break;
+
+	lux = (ch0 * entry->ch0_factor) - (ch1 * entry->ch1_factor);
+
+	return((lux < 0) ? 0 : lux);
+}
+
+static void report(const char *name, uint64_t start)
+{
+	uint64_t us = test_time_us() - start;
+
+	test_log("%-24s %8.1f M/s\n", name, (double)rounds / (double)(us ? us : 1));
+}
+
+int main(int argc, const char **argv)
+{
+	double temperature_d, pressure_d, humidity_d;
+	int32_t temperature, humidity;
+	uint32_t pressure;
+	uint64_t start;
+	unsigned int ix;
+
+	bme280.dig_T1 = 27504;
+	bme280.dig_T2 = 26435;
+	bme280.dig_T3 = -1000;
+	bme280.dig_P1 = 36477;
+	bme280.dig_P2 = -10685;
+	bme280.dig_P3 = 3024;
+	bme280.dig_P4 = 2855;
+	bme280.dig_P5 = 140;
+	bme280.dig_P6 = -7;
+	bme280.dig_P7 = 15500;
+	bme280.dig_P8 = -14600;
+	bme280.dig_P9 = 6000;
+	bme280.dig_H1 = 75;
+	bme280.dig_H2 = 362;
+	bme280.dig_H3 = 0;
+	bme280.dig_H4 = 313;
+	bme280.dig_H5 = 50;
+	bme280.dig_H6 = 30;
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+	{
+		bme280_double(519888 + (ix & 0xffff), 415148 - (ix & 0xffff), 30000 + (ix & 0x3fff), &temperature_d, &pressure_d, &humidity_d);
+		double_sink = temperature_d + pressure_d + humidity_d;
+	}
+
+	report("bme280, double", start);
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+	{
+		bme280_compensate(519888 + (ix & 0xffff), 415148 - (ix & 0xffff), 30000 + (ix & 0x3fff), &temperature, &pressure, &humidity);
+		int_sink = temperature + (int32_t)pressure + humidity;
+	}
+
+	report("bme280, integer", start);
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+		double_sink = tsl2560_double(ix & 0xffff, (ix >> 3) & 0x7fff);
+
+	report("tsl2560, double", start);
+
+	start = test_time_us();
+
+	for(ix = 0; ix < rounds; ix++)
+		int_sink = tsl2560_lux(ix & 0xffff, (ix >> 3) & 0x7fff);
+
+	report("tsl2560, integer", start);
+
+	return(test_done(argv[0]));
+}
@@ -0,0 +1,121 @@
+#include "test.h"
+
+#include "string_double.h"
+
+/*
+ * Values per second through the number formatters: string_double() as it
+ * was, on a value converted from 1/1000 units like the callers used to do,
+ * against string_milli(). The host has a floating point unit, the lx106
+ * emulates doubles in software, so on the device the difference is larger.
+ *
+ * Command lines per second through argument parsing: every argument read
+ * with parse_int() scanning the line with string_sep() each time, against
+ * the same after parse_args_bind(), like application_content() does.
+ */
+
+enum
+{
+	rounds = 4 * 1024 * 1024,
+	line_rounds = 256 * 1024,
+};
+
+static const char *const command_lines[] =
+{
+	"io-write 0 5 1",
+	"io-mode 1 3 pwm 0 1000 autostart",
+	"io-mode 0 12 inputdigital counter 100 pullup autostart",
+	"display-set 0 10 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20",
+	"i2c-sensor-calibrate 0 3 1.02 -0.5",
+};
+
+static volatile int sink;
+
+static unsigned int parse_line(const string_t *line, bool_t bind)
+{
+	parse_args_t args;
+	int index, value, sum;
+
+	if(bind)
+		parse_args_bind(&args, line, ' ');
+
+	for(index = 1, sum = 0; parse_int(index, line, &value, 0, ' ') != parse_out_of_range; index++)
+		sum += value;
+
+	if(bind)
+		parse_args_unbind(&args);
+
+	sink = sum;
+
+	return(index - 1);
+}
+
+static void report(const char *name, uint64_t start, unsigned int length)
+{
+	uint64_t us = test_time_us() - start;
+
+	test_log("%-32s %8.2f M/s (%u bytes)\n", name, (double)rounds / (double)(us ? us : 1), length);
+}
+
+static void bench_lines(void)
+{
+	string_t line;
+	unsigned int ix, round, arguments;
+	uint64_t start, scanned_us, bound_us;
+
+	for(ix = 0; ix < (sizeof(command_lines) / sizeof(*command_lines)); ix++)
+	{
+		line = string_from_cstr(strlen(command_lines[ix]) + 1, (char *)(uintptr_t)command_lines[ix]);
+
+		start = test_time_us();
+
+		for(round = 0, arguments = 0; round < line_rounds; round++)
+			arguments = parse_line(&line, false);
+
+		scanned_us = test_time_us() - start;
+		start = test_time_us();
+
+		for(round = 0; round < line_rounds; round++)
+			parse_line(&line, true);
+
+		bound_us = test_time_us() - start;
+
+		test_log("%2u arguments: string_sep %6.2f M/s, parse_args %6.2f M/s\n", arguments,
+				(double)line_rounds / (double)(scanned_us ? scanned_us : 1), (double)line_rounds / (double)(bound_us ? bound_us : 1));
+	}
+}
+
+int main(int argc, const char **argv)
+{
+	string_new(stack, dst, 64);
+	unsigned int ix, length;
+	uint64_t start;
+	int value;
+
+	start = test_time_us();
+
+	for(ix = 0, length = 0; ix < rounds; ix++)
+	{
+		value = (int)(ix * 2654435761U) >> 8;	// spread over +/- 8388.608
+
+		string_clear(&dst);
+		length += string_double(&dst, value / 1000.0, 2, 1000000);
+	}
+
+	report("string_double, precision 2", start, length);
+
+	start = test_time_us();
+
+	for(ix = 0, length = 0; ix < rounds; ix++)
+	{
+		value = (int)(ix * 2654435761U) >> 8;
+
+		string_clear(&dst);
+		length += string_milli(&dst, value, 2, 1000000);
+	}
+
+	report("string_milli, precision 2", start, length);
+
+	bench_lines();
+
+	return(test_done(argv[0]));
+}
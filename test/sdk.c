@@ -0,0 +1,335 @@
+#include "test.h"
+
+#include "util.h"
+#include "uart.h"
+#include "ota.h"
+#include "i2c.h"
+#include "user_main.h"
+
+#include <sntp.h>
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/*
+ * Host side stand-ins for the SDK and for the parts of the firmware the
+ * tested sources call into, plus a simulated SPI flash. The flash behaves
+ * like NOR flash: erase sets a sector to 0xff, a write can only clear bits.
+ * A power cut can be scheduled after a number of write or erase operations,
+ * the operation it hits is only done partially and every operation after it
+ * fails until the power is switched on again.
+ */
+
+int vprintf(const char *, va_list);
+int vsnprintf(char *, size_t, const char *, va_list);
+int fflush(void *);
+
+enum
+{
+	flash_sim_size = 0x200000,
+	flash_sim_sectors = flash_sim_size / SPI_FLASH_SEC_SIZE,
+};
+
+static uint8_t flash_sim[flash_sim_size];
+static uint8_t flash_sim_saved[flash_sim_size];
+static unsigned int flash_sim_erase_count[flash_sim_sectors];
+static int flash_sim_ops_left = -1;
+static unsigned int flash_sim_torn_bytes;
+static bool_t flash_sim_power = true;
+static flash_sim_cut_t flash_sim_last_cut;
+static unsigned int test_failures;
+static char uart_send_queue_buffer[1024];
+
+queue_t uart_send_queue = { uart_send_queue_buffer, sizeof(uart_send_queue_buffer), sizeof(uart_send_queue_buffer) - 1, 0, 0, 0 };
+queue_t uart_receive_queue;
+os_event_t background_task_queue[background_task_queue_length];
+
+void test_check(bool_t ok, const char *file, int line, const char *expr)
+{
+	if(ok)
+		return;
+
+	test_log("%s:%d: check failed: %s\n", file, line, expr);
+	test_failures++;
+}
+
+void test_fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+
+	test_log("\n");
+	exit(1);
+}
+
+void test_log(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+
+	// don't leave anything in the buffer for a forked child to print again
+
+	fflush((void *)0);
+}
+
+uint64_t test_time_us(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, 0);
+
+	return(((uint64_t)now.tv_sec * 1000000) + now.tv_usec);
+}
+
+int test_done(const char *name)
+{
+	test_log("%s: %s\n", name, test_failures ? "FAILED" : "ok");
+
+	return(test_failures ? 1 : 0);
+}
+
+void flash_sim_erase(void)
+{
+	memset(flash_sim, 0xff, sizeof(flash_sim));
+	memset(flash_sim_erase_count, 0, sizeof(flash_sim_erase_count));
+	flash_sim_power_on();
+}
+
+void flash_sim_save(void)
+{
+	memcpy(flash_sim_saved, flash_sim, sizeof(flash_sim));
+}
+
+void flash_sim_restore(void)
+{
+	memcpy(flash_sim, flash_sim_saved, sizeof(flash_sim));
+	flash_sim_power_on();
+}
+
+// write the flash image to a file, to look at the journal after a failed check
+
+void flash_sim_dump(const char *file)
+{
+	int fd;
+
+	if((fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		test_fail("cannot create %s", file);
+
+	if(write(fd, flash_sim, sizeof(flash_sim)) != (ssize_t)sizeof(flash_sim))
+		test_fail("cannot write %s", file);
+
+	close(fd);
+}
+
+void flash_sim_power_cut(int ops, unsigned int torn_bytes)
+{
+	flash_sim_ops_left = ops;
+	flash_sim_torn_bytes = torn_bytes;
+	flash_sim_last_cut.type = flash_sim_cut_none;
+}
+
+bool_t flash_sim_power_on(void)
+{
+	bool_t was_cut = !flash_sim_power;
+
+	flash_sim_power = true;
+	flash_sim_ops_left = -1;
+
+	return(was_cut);
+}
+
+flash_sim_cut_t flash_sim_cut(void)
+{
+	return(flash_sim_last_cut);
+}
+
+unsigned int flash_sim_erases(unsigned int sector)
+{
+	return(flash_sim_erase_count[sector]);
+}
+
+// returns the number of bytes the operation may process, sizes below the requested size mean a power cut
+
+static unsigned int flash_sim_operation(flash_sim_cut_type_t type, uint32_t address, unsigned int size)
+{
+	if(!flash_sim_power)
+		return(0);
+
+	if(flash_sim_ops_left < 0)
+		return(size);
+
+	if(flash_sim_ops_left-- > 0)
+		return(size);
+
+	flash_sim_power = false;
+	flash_sim_last_cut.type = type;
+	flash_sim_last_cut.address = address;
+
+	return((flash_sim_torn_bytes < size) ? flash_sim_torn_bytes : size);
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sector)
+{
+	unsigned int size;
+
+	if(sector >= flash_sim_sectors)
+		test_fail("erase of sector %#x beyond flash", sector);
+
+	size = flash_sim_operation(flash_sim_cut_erase, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+	memset(&flash_sim[sector * SPI_FLASH_SEC_SIZE], 0xff, size);
+	flash_sim_erase_count[sector]++;
+
+	return((size == SPI_FLASH_SEC_SIZE) ? SPI_FLASH_RESULT_OK : SPI_FLASH_RESULT_ERR);
+}
+
+SpiFlashOpResult spi_flash_write(uint32_t dst, const void *src, uint32_t size)
+{
+	const uint8_t *from = src;
+	unsigned int ix, done;
+
+	if((dst & 3) || (size & 3) || ((uintptr_t)src & 3) || ((dst + size) > flash_sim_size))
+		test_fail("unaligned or out of range flash write %#x/%u", dst, size);
+
+	done = flash_sim_operation(flash_sim_cut_write, dst, size);
+
+	for(ix = 0; ix < done; ix++)
+		flash_sim[dst + ix] &= from[ix];
+
+	return((done == size) ? SPI_FLASH_RESULT_OK : SPI_FLASH_RESULT_ERR);
+}
+
+SpiFlashOpResult spi_flash_read(uint32_t src, void *dst, uint32_t size)
+{
+	if((src & 3) || ((uintptr_t)dst & 3) || ((src + size) > flash_sim_size))
+		test_fail("unaligned or out of range flash read %#x/%u", src, size);
+
+	if(!flash_sim_power)
+		return(SPI_FLASH_RESULT_ERR);
+
+	memcpy(dst, &flash_sim[src], size);
+
+	return(SPI_FLASH_RESULT_OK);
+}
+
+int ets_vsnprintf(char *dst, size_t size, const char *fmt, va_list ap)
+{
+	return(vsnprintf(dst, size, fmt, ap));
+}
+
+void os_delay_us(uint16 us)
+{
+}
+
+void os_timer_disarm(os_timer_t *timer)
+{
+}
+
+void os_timer_arm(os_timer_t *timer, uint32_t ms, bool repeat)
+{
+}
+
+void os_timer_setfn(os_timer_t *timer, os_timer_func_t *func, void *arg)
+{
+	timer->func = func;
+	timer->arg = arg;
+}
+
+void system_soft_wdt_feed(void)
+{
+}
+
+void system_restart(void)
+{
+	test_fail("system_restart");
+}
+
+uint32 system_get_time(void)
+{
+	return(0);
+}
+
+void uart_start_transmit(char enable)
+{
+}
+
+bool_t ota_is_active(void)
+{
+	return(false);
+}
+
+void background_task_wake(background_source_t source)
+{
+}
+
+// no devices on the i2c bus
+
+void i2c_error_format_string(string_t *dst, i2c_error_t error)
+{
+	string_format(dst, "i2c error %d", error);
+}
+
+i2c_error_t i2c_select_bus(unsigned int bus)
+{
+	return(i2c_error_ok);
+}
+
+i2c_error_t i2c_receive(int address, int length, uint8_t *bytes)
+{
+	return(i2c_error_address_nak);
+}
+
+i2c_error_t i2c_send_1(int address, int byte0)
+{
+	return(i2c_error_address_nak);
+}
+
+i2c_error_t i2c_send_2(int address, int byte0, int byte1)
+{
+	return(i2c_error_address_nak);
+}
+
+i2c_error_t i2c_send_3(int address, int byte0, int byte1, int byte2)
+{
+	return(i2c_error_address_nak);
+}
+
+i2c_error_t i2c_send_receive(int address, int sendbyte0, int length, uint8_t *bytes)
+{
+	return(i2c_error_address_nak);
+}
+
+bool wifi_station_scan(void *config, scan_done_cb_t cb)
+{
+	return(false);
+}
+
+uint32 sntp_get_current_timestamp(void)
+{
+	return(0);
+}
+
+char *sntp_get_real_time(uint32 stamp)
+{
+	return((char *)0);
+}
+
+sint8 sntp_get_timezone(void)
+{
+	return(0);
+}
+
+ip_addr_t sntp_getserver(unsigned char index)
+{
+	ip_addr_t address = { 0 };
+
+	return(address);
+}
@@ -0,0 +1,26 @@
+#ifndef c_types_h
+#define c_types_h
+
+// host side stand-in for the SDK header, only what the tested sources use
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t		uint8;
+typedef int8_t		sint8;
+typedef int8_t		int8;
+typedef uint16_t	uint16;
+typedef int16_t		sint16;
+typedef int16_t		int16;
+typedef uint32_t	uint32;
+typedef int32_t		sint32;
+typedef int32_t		int32;
+typedef unsigned char	bool;
+
+#define true	(1)
+#define false	(0)
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef espconn_h
+#define espconn_h
+
+// host side stand-in for the SDK header, only what the tested sources use
+
+#include "c_types.h"
+
+typedef struct
+{
+	int remote_port;
+	int local_port;
+	uint8 local_ip[4];
+	uint8 remote_ip[4];
+} esp_tcp;
+
+typedef struct
+{
+	int remote_port;
+	int local_port;
+	uint8 local_ip[4];
+	uint8 remote_ip[4];
+} esp_udp;
+
+struct espconn
+{
+	int type;
+	int state;
+
+	union
+	{
+		esp_tcp *tcp;
+		esp_udp *udp;
+	} proto;
+
+	void *reverse;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef ets_sys_h
+#define ets_sys_h
+
+// host side stand-in for the SDK header, only what the tested sources use
+
+#include "c_types.h"
+
+typedef void ETSTimerFunc(void *);
+
+typedef struct
+{
+	ETSTimerFunc	*func;
+	void			*arg;
+} ETSTimer;
+
+#endif
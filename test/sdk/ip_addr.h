@@ -0,0 +1,13 @@
+#ifndef ip_addr_h
+#define ip_addr_h
+
+// host side stand-in for the SDK header, only what the tested sources use
+
+#include "c_types.h"
+
+typedef struct ip_addr
+{
+	uint32 addr;
+} ip_addr_t;
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef mem_h
+#define mem_h
+
+// host side stand-in for the SDK header, the tested sources don't allocate
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef os_type_h
+#define os_type_h
+
+// host side stand-in for the SDK header, only what the tested sources use
+
+#include "c_types.h"
+#include "ets_sys.h"
+
+typedef struct
+{
+	uint32 sig;
+	uint32 par;
+} os_event_t;
+
+#define os_timer_func_t ETSTimerFunc
+#define os_timer_t ETSTimer
+
+#endif
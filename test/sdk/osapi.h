@@ -0,0 +1,16 @@
+#ifndef osapi_h
+#define osapi_h
+
+// host side stand-in for the SDK header, only what the tested sources use
+
+#include "c_types.h"
+#include "os_type.h"
+
+#include <string.h>
+
+void os_delay_us(uint16);
+void os_timer_disarm(os_timer_t *);
+void os_timer_arm(os_timer_t *, uint32_t, bool);
+void os_timer_setfn(os_timer_t *, os_timer_func_t *, void *);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef sntp_h
+#define sntp_h
+
+// host side stand-in for the SDK header, only what the tested sources use
+
+#include "c_types.h"
+#include "ip_addr.h"
+
+uint32 sntp_get_current_timestamp(void);
+char *sntp_get_real_time(uint32);
+sint8 sntp_get_timezone(void);
+ip_addr_t sntp_getserver(unsigned char);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef spi_flash_h
+#define spi_flash_h
+
+// host side stand-in for the SDK header, implemented by test/sdk.c on a simulated flash
+
+#include "c_types.h"
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum
+{
+	SPI_FLASH_RESULT_OK,
+	SPI_FLASH_RESULT_ERR,
+	SPI_FLASH_RESULT_TIMEOUT,
+} SpiFlashOpResult;
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sector);
+SpiFlashOpResult spi_flash_write(uint32 dst, uint32 *src, uint32 size);
+SpiFlashOpResult spi_flash_read(uint32 src, uint32 *dst, uint32 size);
+
+#endif
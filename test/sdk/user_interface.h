@@ -0,0 +1,52 @@
+#ifndef user_interface_h
+#define user_interface_h
+
+// host side stand-in for the SDK header, only what the tested sources use
+
+#include "c_types.h"
+#include "os_type.h"
+
+#define USER_TASK_PRIO_0 0
+
+typedef enum
+{
+	OK = 0,
+	FAIL,
+	PENDING,
+	BUSY,
+	CANCEL,
+} STATUS;
+
+typedef enum
+{
+	AUTH_OPEN = 0,
+	AUTH_WEP,
+	AUTH_WPA_PSK,
+	AUTH_WPA2_PSK,
+	AUTH_WPA_WPA2_PSK,
+	AUTH_MAX
+} AUTH_MODE;
+
+struct bss_info
+{
+	struct
+	{
+		struct bss_info *stqe_next;
+	} next;
+
+	uint8 bssid[6];
+	uint8 ssid[32];
+	uint8 channel;
+	sint8 rssi;
+	AUTH_MODE authmode;
+	sint16 freq_offset;
+};
+
+typedef void (*scan_done_cb_t)(void *arg, STATUS status);
+
+void system_restart(void);
+void system_soft_wdt_feed(void);
+uint32 system_get_time(void);
+bool wifi_station_scan(void *config, scan_done_cb_t cb);
+
+#endif
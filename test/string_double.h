@@ -0,0 +1,76 @@
+#ifndef string_double_h
+#define string_double_h
+
+#include "util.h"
+
+/*
+ * string_double() as it was before string_milli() replaced it, to compare
+ * the output and the speed of both.
+ */
+
+static int string_double(string_t *dst, double value, int precision, double top_decimal)
+{
+	double compare;
+	int decimal;
+	bool_t skip_leading_zeroes;
+	int original_length;
+
+	original_length = dst->length;
+
+	if(value < 0)
+	{
+		string_append_char(dst, '-');
+		value = 0 - value;
+	}
+
+	skip_leading_zeroes = true;
+
+	if(value > (10 * top_decimal))
+	{
+		string_append_char(dst, '+');
+		string_append_char(dst, '+');
+		string_append_char(dst, '+');
+
+		return(dst->length - original_length);
+	}
+
+	for(compare = top_decimal; compare > 0; compare /= 10)
+	{
+		if(value >= compare)
+		{
+			skip_leading_zeroes = false;
+
+			decimal = (unsigned int)(value / compare);
+			value -= decimal * compare;
+
+			string_append_char(dst, (char)(decimal + '0'));
+		}
+		else
+			if(!skip_leading_zeroes)
+				string_append_char(dst, '0');
+
+		if((compare <= 1) && (precision == 0))
+			break;
+
+		if((unsigned int)compare == 1)
+		{
+			if(skip_leading_zeroes)
+			{
+				string_append_char(dst, '0');
+				skip_leading_zeroes = false;
+			}
+
+			string_append_char(dst, '.');
+		}
+
+		if((compare <= 1) && (precision > 0))
+			--precision;
+	}
+
+	if(dst->length == original_length)
+		string_append_char(dst, '0');
+
+	return(dst->length - original_length);
+}
+
+#endif
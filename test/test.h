@@ -0,0 +1,45 @@
+#ifndef test_h
+#define test_h
+
+#include "util.h"
+
+#include <stdint.h>
+
+/*
+ * Host side unit tests, built and run with "make test". The firmware sources
+ * are compiled with HOSTCC against the stand-in SDK headers in test/sdk,
+ * test/sdk.c implements the SDK functions they call. A failed check is
+ * reported and counted, test_done() turns the count into the exit status.
+ */
+
+typedef enum
+{
+	flash_sim_cut_none,
+	flash_sim_cut_erase,
+	flash_sim_cut_write,
+} flash_sim_cut_type_t;
+
+typedef struct
+{
+	flash_sim_cut_type_t	type;
+	uint32_t				address;
+} flash_sim_cut_t;
+
+void			test_check(bool_t ok, const char *file, int line, const char *expr);
+void			test_fail(const char *fmt, ...) __attribute__ ((format (printf, 1, 2))) __attribute__ ((noreturn));
+void			test_log(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+uint64_t		test_time_us(void);
+int				test_done(const char *name);
+
+void			flash_sim_erase(void);
+void			flash_sim_save(void);
+void			flash_sim_restore(void);
+void			flash_sim_dump(const char *file);
+void			flash_sim_power_cut(int ops, unsigned int torn_bytes);
+bool_t			flash_sim_power_on(void);
+flash_sim_cut_t	flash_sim_cut(void);
+unsigned int	flash_sim_erases(unsigned int sector);
+
+#define test_assert(expr) test_check(!!(expr), __FILE__, __LINE__, #expr)
+
+#endif
@@ -0,0 +1,142 @@
+#include "test.h"
+
+/*
+ * The sorted alias index must find the same table entry for any command as
+ * the linear scan over the table it replaced: every alias of every entry,
+ * the words around them and words that are no alias at all. Splitting a
+ * packet into commands must leave a ';' in free text alone.
+ */
+
+#include "application_host.h"
+
+static unsigned int lookups;
+
+static void lookup_compare(const char *text, int length)
+{
+	string_t command = string_from_cstr(length + 1, (char *)(uintptr_t)text);
+	const application_function_table_t *indexed, *linear;
+
+	command.length = length;
+	lookups++;
+
+	indexed = application_lookup(&command);
+	linear = application_lookup_linear(&command);
+
+	if(indexed != linear)
+	{
+		test_log("lookup \"%.*s\": entry %d, linear scan entry %d\n", length, text,
+				indexed ? (int)(indexed - application_function_table) : -1,
+				linear ? (int)(linear - application_function_table) : -1);
+		test_assert(false);
+	}
+}
+
+static void test_aliases(void)
+{
+	const application_function_table_t *entry;
+	const char *alias;
+	string_t command;
+	char text[64];
+	int entries, which, length, ix;
+
+	for(entries = 0; application_function_table[entries].function; entries++)
+		;
+
+	// the index holds (entry << 1) | alias in a byte
+
+	test_assert((entries * 2) <= 256);
+	test_assert(sizeof(application_alias_index) >= (size_t)(entries * 2));
+
+	for(entry = application_function_table; entry->function; entry++)
+	{
+		for(which = 0; which < 2; which++)
+		{
+			alias = which ? entry->command2 : entry->command1;
+			length = strlen(alias);
+
+			command = string_from_cstr(length + 1, (char *)(uintptr_t)alias);
+			test_assert(application_lookup(&command));
+			lookup_compare(alias, length);
+
+			// every prefix
+
+			for(ix = 0; ix < length; ix++)
+				lookup_compare(alias, ix);
+
+			// extended by one character, and with the last character changed either way
+
+			if((length + 2) > (int)sizeof(text))
+				continue;
+
+			memcpy(text, alias, length);
+			text[length + 1] = '\0';
+
+			for(text[length] = ' '; text[length] <= '~'; text[length]++)
+				lookup_compare(text, length + 1);
+
+			if(length > 0)
+			{
+				text[length] = '\0';
+				text[length - 1] = alias[length - 1] + 1;
+				lookup_compare(text, length);
+				text[length - 1] = alias[length - 1] - 1;
+				lookup_compare(text, length);
+			}
+		}
+	}
+
+	lookup_compare("", 0);
+	lookup_compare("~", 1);
+	lookup_compare("\x01", 1);
+	lookup_compare("\xff", 1);
+	lookup_compare("no-such-command", 15);
+	lookup_compare("a", 1);
+	lookup_compare("zzzzzzzzzzzz", 12);
+
+	test_log("application_lookup: %d entries, %u lookups\n", entries, lookups);
+}
+
+// split packet into commands, expected is terminated by a null pointer
+
+static void split_compare(const char *packet, const char *const *expected)
+{
+	string_t src = string_from_cstr(strlen(packet) + 1, (char *)(uintptr_t)packet);
+	int offset, next, length, ix;
+
+	for(offset = 0, ix = 0; offset < string_length(&src); offset = next, ix++)
+	{
+		next = application_command_next(&src, offset, &length);
+
+		if(!expected[ix] || (length != (int)strlen(expected[ix])) || memcmp(packet + offset, expected[ix], length))
+		{
+			test_log("split \"%s\": command %d is \"%.*s\", expected \"%s\"\n", packet, ix, length, packet + offset,
+					expected[ix] ? expected[ix] : "(none)");
+			test_assert(false);
+			return;
+		}
+	}
+
+	test_assert(!expected[ix]);
+}
+
+static void test_split(void)
+{
+	split_compare("ss;sc 1\nhelp", (const char *const[]){ "ss", "sc 1\n", "help", 0 });
+	split_compare("xyz;ss", (const char *const[]){ "xyz", "ss", 0 });
+	split_compare("wcc ssid pa;ss", (const char *const[]){ "wcc ssid pa;ss", 0 });
+	split_compare("wlan-client-configure ssid pa;ss\nss;ss", (const char *const[]){ "wlan-client-configure ssid pa;ss\n", "ss", "ss", 0 });
+	split_compare("wac ap pass;word 6\nss", (const char *const[]){ "wac ap pass;word 6\n", "ss", 0 });
+	split_compare("cs text -1 -1 one;two;three\nss", (const char *const[]){ "cs text -1 -1 one;two;three\n", "ss", 0 });
+	split_compare("ds 0 10 - a;b", (const char *const[]){ "ds 0 10 - a;b", 0 });
+	split_compare("ddm hello;world\r\nss", (const char *const[]){ "ddm hello;world\r\n", "ss", 0 });
+	split_compare("id shed;garden\nss", (const char *const[]){ "id shed;garden\n", "ss", 0 });
+	split_compare("GET /a;b HTTP/1.0\r\nHost: x;y\r\n", (const char *const[]){ "GET /a;b HTTP/1.0\r\nHost: x;y\r\n", 0 });
+}
+
+int main(int argc, const char **argv)
+{
+	test_aliases();
+	test_split();
+
+	return(test_done(argv[0]));
+}
@@ -0,0 +1,414 @@
+#include "test.h"
+
+#include "binary.h"
+#include "io.h"
+#include "i2c_sensor.h"
+#include "stats.h"
+#include "binaryclient.h"
+
+/*
+ * The binary framing end to end: the host client library talks over a
+ * socketpair to a forked device that runs binary.c on simulated ios and a
+ * sensor cache. The device takes the frames out of the packets like
+ * background_task_command_handler() does; on the stream socket it reads in
+ * random amounts, so frames come in split and several at a time.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+_Static_assert((int)binary_client_magic == (int)binary_magic, "binary client magic");
+_Static_assert((int)binary_client_reply == (int)binary_reply, "binary client reply");
+_Static_assert((int)binary_client_header_size == (int)binary_header_size, "binary client header size");
+_Static_assert((int)binary_client_crc_size == (int)binary_crc_size, "binary client crc size");
+_Static_assert((int)binary_client_request_size_max == (int)binary_request_size_max, "binary client request size");
+_Static_assert((int)binary_client_op_sensor_read == (int)binary_op_sensor_read, "binary client opcodes");
+_Static_assert((int)binary_client_tlv_pin_value == (int)binary_tlv_pin_value, "binary client arguments");
+_Static_assert((int)binary_client_status_duplicate == (int)binary_status_duplicate, "binary client status");
+
+enum
+{
+	sim_ios = 2,
+	sim_sensor_bus = 0,
+	sim_sensor = 1,
+	sim_sensor_value = 21500,
+	sim_sensor_age = 1200,
+	pipelined = 200,
+	timeout_ms = 5000,
+};
+
+static const int sim_pins[sim_ios] = { 16, 4 };
+static int sim_value[sim_ios][max_pins_per_io];
+
+int stat_cmd_binary;
+int stat_cmd_binary_errors;
+
+io_error_t io_read_pin(string_t *errormsg, int io, int pin, int *value)
+{
+	if((io < 0) || (io >= sim_ios) || (pin < 0) || (pin >= sim_pins[io]))
+		return(io_error);
+
+	*value = sim_value[io][pin];
+
+	return(io_ok);
+}
+
+io_error_t io_write_pin(string_t *errormsg, int io, int pin, int value)
+{
+	if((io < 0) || (io >= sim_ios) || (pin < 0) || (pin >= sim_pins[io]))
+		return(io_error);
+
+	sim_value[io][pin] = value;
+
+	return(io_ok);
+}
+
+io_error_t io_trigger_pin(string_t *errormsg, int io, int pin, io_trigger_t trigger)
+{
+	if((io < 0) || (io >= sim_ios) || (pin < 0) || (pin >= sim_pins[io]))
+		return(io_error);
+
+	if(trigger == io_trigger_toggle)
+		sim_value[io][pin] = !sim_value[io][pin];
+
+	return(io_ok);
+}
+
+bool_t i2c_sensor_cached(int bus, i2c_sensor_t sensor, int *value, int *age)
+{
+	if((bus != sim_sensor_bus) || ((int)sensor != sim_sensor))
+		return(false);
+
+	*value = sim_sensor_value;
+	*age = sim_sensor_age;
+
+	return(true);
+}
+
+static unsigned int random_next(void)
+{
+	static unsigned int seed = 1;
+
+	seed = (seed * 1103515245) + 12345;
+
+	return(seed >> 16);
+}
+
+static void device_write(int fd, bool_t stream, const string_t *reply)
+{
+	int offset, length;
+
+	if(!stream)
+	{
+		test_assert(write(fd, string_buffer(reply), string_length(reply)) == string_length(reply));
+		return;
+	}
+
+	for(offset = 0; offset < string_length(reply); offset += length)
+	{
+		length = 1 + (random_next() % 16);
+
+		if(length > (string_length(reply) - offset))
+			length = string_length(reply) - offset;
+
+		test_assert(write(fd, string_buffer(reply) + offset, length) == length);
+	}
+}
+
+// returns false when the stream can't be followed any further, the connection is then closed
+
+static bool_t device_packet(int fd, bool_t stream, char *packet, int length, char *partial, int *partial_length)
+{
+	string_new(stack, reply, 4096);
+	string_t rest, frame;
+	int offset, frame_length;
+
+	memmove(packet + *partial_length, packet, length);
+	memcpy(packet, partial, *partial_length);
+	length += *partial_length;
+	*partial_length = 0;
+
+	for(offset = 0; offset < length; offset += frame_length)
+	{
+		string_set(&rest, packet + offset, length - offset, length - offset);
+
+		// text commands aren't part of this test
+
+		test_assert(binary_frame(&rest));
+
+		frame_length = binary_frame_length(&rest);
+
+		if((frame_length == 0) && stream)
+		{
+			test_assert(string_length(&rest) < binary_request_size_max);
+			memcpy(partial, string_buffer(&rest), string_length(&rest));
+			*partial_length = string_length(&rest);
+			break;
+		}
+
+		if(frame_length <= 0)
+		{
+			binary_reply_status(&rest, &reply, binary_status_frame_error);
+			device_write(fd, stream, &reply);
+			return(!stream);
+		}
+
+		string_set(&frame, packet + offset, frame_length, frame_length);
+		binary_request(&frame, &reply);
+		device_write(fd, stream, &reply);
+	}
+
+	return(true);
+}
+
+static void device(int fd, bool_t stream)
+{
+	char packet[2048], partial[binary_request_size_max];
+	int length, partial_length = 0;
+
+	string_crc32_init();
+
+	for(;;)
+	{
+		// room is left to put a kept partial frame in front
+
+		length = read(fd, packet, stream ? (int)(1 + (random_next() % 48)) : (int)(sizeof(packet) - binary_request_size_max));
+
+		if(length <= 0)
+			break;
+
+		if(!device_packet(fd, stream, packet, length, partial, &partial_length))
+			break;
+	}
+
+	close(fd);
+	exit(test_done(stream ? "loopback device, stream" : "loopback device, datagram"));
+}
+
+static pid_t device_start(binary_client_t *client, bool_t stream)
+{
+	int fds[2];
+	pid_t pid;
+
+	test_assert(socketpair(AF_UNIX, stream ? SOCK_STREAM : SOCK_DGRAM, 0, fds) == 0);
+
+	if((pid = fork()) == 0)
+	{
+		close(fds[0]);
+		device(fds[1], stream);
+	}
+
+	close(fds[1]);
+	binary_client_init(client, fds[0], stream, timeout_ms);
+
+	return(pid);
+}
+
+static void device_stop(binary_client_t *client, pid_t pid)
+{
+	int status;
+
+	// a datagram socket doesn't see the other end close, an empty datagram stops the device
+
+	if(!client->stream)
+		test_assert(write(client->fd, "", 0) == 0);
+
+	binary_client_close(client);
+	test_assert(waitpid(pid, &status, 0) == pid);
+	test_assert(WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+}
+
+static void test_frame_length(void)
+{
+	char buffer[binary_request_size_max + 1] = { (char)binary_magic, 10, 0 };
+	string_t src;
+
+	string_set(&src, buffer, sizeof(buffer), 0);
+	test_assert(binary_frame_length(&src) == 0);
+	string_setlength(&src, 2);
+	test_assert(binary_frame_length(&src) == 0);
+	string_setlength(&src, 9);
+	test_assert(binary_frame_length(&src) == 0);
+	string_setlength(&src, 10);
+	test_assert(binary_frame_length(&src) == 10);
+	string_setlength(&src, 30);
+	test_assert(binary_frame_length(&src) == 10);
+
+	buffer[1] = binary_frame_size_min - 1;
+	test_assert(binary_frame_length(&src) == -1);
+
+	buffer[1] = binary_request_size_max + 1;
+	string_setlength(&src, sizeof(buffer));
+	test_assert(binary_frame_length(&src) == -1);
+}
+
+// the header of a reply to a frame too short to carry them has opcode and request id zero
+
+static void test_short_frame(void)
+{
+	char buffer[] = { (char)binary_magic, 11, 0, binary_op_io_read, 0x34, 0x12 };
+	binary_client_reply_t reply;
+	string_new(stack, dst, 64);
+	string_t src;
+	int length;
+
+	for(length = 1; length <= (int)sizeof(buffer); length++)
+	{
+		string_set(&src, buffer, length, length);
+		binary_reply_status(&src, &dst, binary_status_frame_error);
+
+		test_assert(binary_client_decode((const uint8_t *)string_buffer(&dst), string_length(&dst), &reply) == string_length(&dst));
+		test_assert(reply.status == binary_status_frame_error);
+		test_assert(reply.op == ((length < binary_header_size) ? 0 : binary_op_io_read));
+		test_assert(reply.id == ((length < binary_header_size) ? 0 : 0x1234));
+	}
+}
+
+static void test_stream(void)
+{
+	binary_client_t client;
+	binary_client_reply_t reply;
+	uint8_t frame[binary_request_size_max], args[16];
+	int id[pipelined];
+	int ix, io, pin, value, age, length;
+	pid_t pid;
+
+	pid = device_start(&client, true);
+
+	test_assert(binary_client_io_write(&client, 0, 3, 1234) == binary_status_ok);
+	test_assert(binary_client_io_read(&client, 0, 3, &value) == binary_status_ok);
+	test_assert(value == 1234);
+	test_assert(binary_client_io_write(&client, 1, 2, -5) == binary_status_ok);
+	test_assert(binary_client_io_read(&client, 1, 2, &value) == binary_status_ok);
+	test_assert(value == -5);
+	test_assert(binary_client_io_read(&client, 1, 9, &value) == binary_status_io_error);
+	test_assert(binary_client_io_trigger(&client, 0, 4, io_trigger_toggle) == binary_status_ok);
+	test_assert(binary_client_io_read(&client, 0, 4, &value) == binary_status_ok);
+	test_assert(value == 1);
+	test_assert(binary_client_io_trigger(&client, 0, 4, io_trigger_size) == binary_status_argument_error);
+	test_assert(binary_client_sensor_read(&client, sim_sensor_bus, sim_sensor, &value, &age) == binary_status_ok);
+	test_assert((value == sim_sensor_value) && (age == sim_sensor_age));
+	test_assert(binary_client_sensor_read(&client, sim_sensor_bus, sim_sensor + 1, &value, &age) == binary_status_sensor_error);
+	test_assert(binary_client_request(&client, 0x7f, args, 0, &reply) == binary_status_unknown_opcode);
+
+	// a snapshot reply is larger than any request
+
+	test_assert(binary_client_io_snapshot(&client, -1, &reply) == binary_status_ok);
+
+	for(ix = 0; binary_client_reply_pin_value(&reply, ix, &io, &pin, &value) == 0; ix++)
+		test_assert((io < sim_ios) && (pin < sim_pins[io]) && (value == (((io == 0) && (pin == 3)) ? 1234 : ((io == 1) && (pin == 2)) ? -5 : ((io == 0) && (pin == 4)) ? 1 : 0)));
+
+	test_assert(ix == (sim_pins[0] + sim_pins[1]));
+
+	test_assert(binary_client_io_snapshot(&client, 1, &reply) == binary_status_ok);
+
+	for(ix = 0; binary_client_reply_pin_value(&reply, ix, &io, &pin, &value) == 0; ix++)
+		test_assert(io == 1);
+
+	test_assert(ix == sim_pins[1]);
+
+	// many requests before the first reply is read, the replies come back in order
+
+	for(ix = 0; ix < pipelined; ix++)
+	{
+		length = binary_client_arg(args, 0, sizeof(args), binary_tlv_io, 1, 0);
+		length = binary_client_arg(args, length, sizeof(args), binary_tlv_pin, 1, ix % sim_pins[0]);
+		length = binary_client_arg(args, length, sizeof(args), binary_tlv_value, 4, (uint32_t)ix);
+		test_assert((id[ix] = binary_client_send(&client, binary_op_io_write, args, length)) >= 0);
+	}
+
+	for(ix = 0; ix < pipelined; ix++)
+	{
+		test_assert(binary_client_receive(&client, &reply) == 0);
+		test_assert((reply.id == (unsigned int)id[ix]) && (reply.op == binary_op_io_write) && (reply.status == binary_status_ok));
+	}
+
+	for(pin = 0; pin < sim_pins[0]; pin++)
+	{
+		for(ix = pipelined - 1; (ix % sim_pins[0]) != pin; ix--)
+			;
+
+		test_assert(binary_client_io_read(&client, 0, pin, &value) == binary_status_ok);
+		test_assert(value == ix);
+	}
+
+	// a bad crc is answered, the stream continues after the frame
+
+	length = binary_client_encode(frame, sizeof(frame), binary_op_io_read, 0x4321, args, 0);
+	frame[length - 1] ^= 0x01;
+	test_assert(write(client.fd, frame, length) == length);
+	test_assert(binary_client_receive(&client, &reply) == 0);
+	test_assert((reply.id == 0x4321) && (reply.status == binary_status_crc_error));
+	test_assert(binary_client_io_read(&client, 0, 3, &value) == binary_status_ok);
+
+	// an impossible length can't be skipped, the device hangs up after the reply
+
+	length = binary_client_encode(frame, sizeof(frame), binary_op_io_read, 0x4322, args, 0);
+	frame[1] = 3;
+	test_assert(write(client.fd, frame, length) == length);
+	test_assert(binary_client_receive(&client, &reply) == 0);
+	test_assert((reply.id == 0x4322) && (reply.status == binary_status_frame_error));
+	test_assert(binary_client_receive(&client, &reply) == -1);
+
+	device_stop(&client, pid);
+}
+
+static void test_datagram(void)
+{
+	binary_client_t client;
+	binary_client_reply_t reply;
+	uint8_t frame[binary_request_size_max], args[16];
+	int value, length;
+	pid_t pid;
+
+	pid = device_start(&client, false);
+
+	test_assert(binary_client_io_write(&client, 1, 0, 77) == binary_status_ok);
+	test_assert(binary_client_io_read(&client, 1, 0, &value) == binary_status_ok);
+	test_assert(value == 77);
+
+	// a datagram is never continued, a cut off frame is an error
+
+	length = binary_client_arg(args, 0, sizeof(args), binary_tlv_io, 1, 1);
+	length = binary_client_encode(frame, sizeof(frame), binary_op_io_read, 0x5555, args, length);
+	test_assert(write(client.fd, frame, length - 2) == (length - 2));
+	test_assert(binary_client_receive(&client, &reply) == 0);
+	test_assert((reply.id == 0x5555) && (reply.status == binary_status_frame_error));
+
+	test_assert(write(client.fd, frame, 2) == 2);
+	test_assert(binary_client_receive(&client, &reply) == 0);
+	test_assert((reply.id == 0) && (reply.op == 0) && (reply.status == binary_status_frame_error));
+
+	// two frames in one datagram
+
+	length = binary_client_encode(frame, sizeof(frame), binary_op_io_read, 0x6001, args, 0);
+	length += binary_client_encode(frame + length, sizeof(frame) - length, binary_op_io_read, 0x6002, args, 0);
+	test_assert(write(client.fd, frame, length) == length);
+	test_assert(binary_client_receive(&client, &reply) == 0);
+	test_assert((reply.id == 0x6001) && (reply.status == binary_status_argument_error));
+	test_assert(binary_client_receive(&client, &reply) == 0);
+	test_assert((reply.id == 0x6002) && (reply.status == binary_status_argument_error));
+
+	// the client's ids wrap around to 1, 0 is for requests without duplicate detection
+
+	client.next_id = 0xffff;
+	test_assert(binary_client_io_read(&client, 1, 0, &value) == binary_status_ok);
+	test_assert(client.next_id == 1);
+
+	device_stop(&client, pid);
+}
+
+int main(int argc, const char **argv)
+{
+	string_crc32_init();
+	binary_client_crc32_init();
+
+	test_frame_length();
+	test_short_frame();
+	test_stream();
+	test_datagram();
+
+	return(test_done(argv[0]));
+}
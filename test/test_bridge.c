@@ -0,0 +1,190 @@
+#include "test.h"
+
+#include "queue.h"
+#include "user_main.h"
+
+/*
+ * Coalesce thresholds, and the uart to tcp bridge pipeline on a simulated
+ * uart and socket: the uart fills the receive queue at the baud rate, the
+ * bridge sends spans from the queue in place like background_task_bridge_uart()
+ * and the socket only takes a new packet once the previous one is acked.
+ */
+
+typedef struct
+{
+	unsigned int	baud;
+	unsigned int	ack_us;
+	unsigned int	coalesce_bytes;
+	unsigned int	coalesce_time;
+} bridge_setup_t;
+
+typedef struct
+{
+	unsigned int	received;
+	unsigned int	lost;
+	unsigned int	sent;
+	unsigned int	packets;
+	unsigned int	out_of_order;
+	unsigned int	max_hold_us;
+} bridge_result_t;
+
+enum
+{
+	sim_duration_us = 2000000,
+	sim_task_interval_us = 50,
+	sim_wlan_bytes_per_ms = 1000,	// 8 Mbit/s
+};
+
+static char receive_queue_buffer[bridge_receive_queue_size];
+
+static void test_wait(void)
+{
+	// disabled
+
+	test_assert(bridge_coalesce_wait(1, 0, 0, 0) == 0);
+	test_assert(bridge_coalesce_wait(1, 0, 100, 0) == 0);
+	test_assert(bridge_coalesce_wait(0, 0, 0, 1000) == 0);
+
+	// byte threshold reached
+
+	test_assert(bridge_coalesce_wait(100, 0, 100, 1000) == 0);
+	test_assert(bridge_coalesce_wait(101, 10, 100, 1000) == 0);
+
+	// hold for the rest of the time
+
+	test_assert(bridge_coalesce_wait(99, 0, 100, 1000) == 1000);
+	test_assert(bridge_coalesce_wait(99, 400, 100, 1000) == 600);
+	test_assert(bridge_coalesce_wait(1, 999, 100, 1000) == 1);
+
+	// time threshold reached
+
+	test_assert(bridge_coalesce_wait(1, 1000, 100, 1000) == 0);
+	test_assert(bridge_coalesce_wait(1, 5000, 100, 1000) == 0);
+}
+
+static bridge_result_t simulate(const bridge_setup_t *setup)
+{
+	bridge_result_t result = { 0 };
+	queue_t queue;
+	char *data;
+	unsigned int now, next_byte_ns, in_flight, ack_at, next_task, ix;
+	unsigned int since = 0;
+	bool_t waiting = false;
+	uint64_t uart_ns;
+	uint8_t expect = 0, value = 0;
+	int length;
+
+	queue_new(&queue, sizeof(receive_queue_buffer), receive_queue_buffer);
+
+	uart_ns = 0;
+	next_byte_ns = ((uint64_t)10 * 1000000000) / setup->baud;	// 10 bits per byte
+	in_flight = 0;
+	ack_at = 0;
+	next_task = 0;
+
+	for(now = 0; now < sim_duration_us; now++)
+	{
+		// uart receive interrupt, bytes that don't fit are lost
+
+		for(; uart_ns < ((uint64_t)now * 1000); uart_ns += next_byte_ns)
+		{
+			result.received++;
+
+			if(queue_full(&queue))
+				result.lost++;
+			else
+				queue_push(&queue, (char)value);
+
+			value++;
+		}
+
+		// sent callback releases the data
+
+		if(in_flight && (now >= ack_at))
+		{
+			queue_advance(&queue, in_flight);
+			in_flight = 0;
+		}
+
+		if(now < next_task)
+			continue;
+
+		next_task = now + sim_task_interval_us;
+
+		if(in_flight || queue_empty(&queue))
+			continue;
+
+		if(!waiting)
+			since = now;
+
+		if((waiting = (bridge_coalesce_wait(queue_length(&queue), now - since, setup->coalesce_bytes, setup->coalesce_time) > 0)))
+			continue;
+
+		if((now - since) > result.max_hold_us)
+			result.max_hold_us = now - since;
+
+		length = queue_span(&queue, &data);
+
+		if(length > bridge_send_size_max)
+			length = bridge_send_size_max;
+
+		for(ix = 0; ix < (unsigned int)length; ix++)
+			if((uint8_t)data[ix] != expect++)
+				result.out_of_order++;
+
+		in_flight = length;
+		ack_at = now + setup->ack_us + ((length * 1000) / sim_wlan_bytes_per_ms);
+		result.sent += length;
+		result.packets++;
+	}
+
+	return(result);
+}
+
+static void test_pipeline(void)
+{
+	static const bridge_setup_t no_coalesce_460800 = { 460800, 3000, 0, 0 };
+	static const bridge_setup_t no_coalesce_921600 = { 921600, 3000, 0, 0 };
+	static const bridge_setup_t coalesce_921600 = { 921600, 3000, 512, 2000 };
+	static const bridge_setup_t no_coalesce_9600 = { 9600, 3000, 0, 0 };
+	static const bridge_setup_t coalesce_9600 = { 9600, 3000, 64, 20000 };
+	static const bridge_setup_t slow_ack_921600 = { 921600, 60000, 0, 0 };
+	bridge_result_t result, coalesced;
+
+	result = simulate(&no_coalesce_460800);
+	test_assert(result.lost == 0);
+	test_assert(result.out_of_order == 0);
+	test_assert(result.sent > (result.received - bridge_receive_queue_size));
+
+	result = simulate(&no_coalesce_921600);
+	test_log("921600 baud: %u bytes in %u packets, lost %u\n", result.sent, result.packets, result.lost);
+	test_assert(result.lost == 0);
+	test_assert(result.out_of_order == 0);
+
+	result = simulate(&coalesce_921600);
+	test_assert(result.lost == 0);
+	test_assert(result.out_of_order == 0);
+
+	// coalescing at low rates makes fewer and larger packets and holds data no longer than the time threshold
+
+	result = simulate(&no_coalesce_9600);
+	coalesced = simulate(&coalesce_9600);
+	test_log("9600 baud: %u packets, coalesced %u packets\n", result.packets, coalesced.packets);
+	test_assert(coalesced.lost == 0);
+	test_assert(coalesced.out_of_order == 0);
+	test_assert((coalesced.packets * 4) < result.packets);
+	test_assert(coalesced.max_hold_us <= (coalesce_9600.coalesce_time + sim_task_interval_us));
+
+	// the simulation does notice when the socket can't keep up
+
+	result = simulate(&slow_ack_921600);
+	test_assert(result.lost > 0);
+}
+
+int main(int argc, const char **argv)
+{
+	test_wait();
+	test_pipeline();
+
+	return(test_done(argv[0]));
+}
@@ -0,0 +1,465 @@
+#include "test.h"
+
+#include "config.h"
+
+/*
+ * Config journal on a simulated flash. Every kind of write is also run with
+ * a power cut at each of its flash operations in turn, after which the
+ * config read back must be either the old or the new config, never a mix,
+ * and the journal must accept writes again.
+ */
+
+enum
+{
+	model_size = 192,
+	model_value_size = 64,
+	torn_sizes = 4,
+};
+
+typedef struct
+{
+	char	id[config_entry_id_size];
+	char	value[model_value_size];
+	bool_t	present;
+} model_entry_t;
+
+typedef struct
+{
+	unsigned int	length;
+	model_entry_t	entry[model_size];
+} model_t;
+
+typedef struct
+{
+	unsigned int	runs;
+	unsigned int	erase;
+	unsigned int	header;
+	unsigned int	record;
+} cuts_t;
+
+// bytes of the operation hit by the power cut that still make it to flash
+
+static const unsigned int torn_size[torn_sizes] = { 0, 4, 12, 40 };
+
+static model_t model;
+static unsigned int change_round;
+
+static void model_set(model_t *m, const char *id, const char *value)
+{
+	unsigned int ix;
+
+	for(ix = 0; ix < m->length; ix++)
+		if(!strcmp(m->entry[ix].id, id))
+			break;
+
+	if(ix >= m->length)
+	{
+		if(m->length >= model_size)
+			test_fail("model full");
+
+		strecpy(m->entry[m->length++].id, id, config_entry_id_size);
+	}
+
+	strecpy(m->entry[ix].value, value, model_value_size);
+	m->entry[ix].present = true;
+}
+
+static bool_t model_matches(const model_t *m)
+{
+	string_new(stack, value, model_value_size + 8);
+	string_t id;
+	unsigned int ix;
+	bool_t found;
+
+	for(ix = 0; ix < m->length; ix++)
+	{
+		id = string_from_cstr(config_entry_id_size, (char *)(uintptr_t)m->entry[ix].id);
+		string_clear(&value);
+		found = config_get_string(&id, -1, -1, &value);
+
+		if(found != m->entry[ix].present)
+			return(false);
+
+		if(found && strcmp(string_to_cstr(&value), m->entry[ix].value))
+			return(false);
+	}
+
+	return(true);
+}
+
+static bool_t set(const char *id, const char *value)
+{
+	string_t id_string = string_from_cstr(config_entry_id_size, (char *)(uintptr_t)id);
+	string_t value_string = string_from_cstr(model_value_size, (char *)(uintptr_t)value);
+
+	if(!config_set_string(&id_string, -1, -1, &value_string, 0, -1))
+		return(false);
+
+	model_set(&model, id, value);
+
+	return(true);
+}
+
+static void delete(const char *id)
+{
+	string_t id_string = string_from_cstr(config_entry_id_size, (char *)(uintptr_t)id);
+	unsigned int ix;
+
+	test_assert(config_delete(&id_string, -1, -1, false) == 1);
+
+	for(ix = 0; ix < model.length; ix++)
+		if(!strcmp(model.entry[ix].id, id))
+			model.entry[ix].present = false;
+}
+
+// start from blank flash, config_read() adds the default flags
+
+static void blank(void)
+{
+	string_new(stack, value, 16);
+	string_init(id, "flags");
+
+	flash_sim_erase();
+	test_assert(!config_read());
+
+	memset(&model, 0, sizeof(model));
+	test_assert(config_get_string(&id, -1, -1, &value));
+	model_set(&model, "flags", string_to_cstr(&value));
+}
+
+static void fill(unsigned int entries, unsigned int value_length)
+{
+	char id[config_entry_id_size], value[model_value_size];
+	unsigned int ix;
+
+	for(ix = 0; ix < entries; ix++)
+	{
+		string_t id_string, value_string;
+
+		string_set(&id_string, id, sizeof(id), 0);
+		string_format(&id_string, "entry.%u", ix);
+		string_to_cstr(&id_string);
+
+		string_set(&value_string, value, sizeof(value), 0);
+		string_format(&value_string, "%u", ix);
+
+		while(string_length(&value_string) < (int)value_length)
+			string_append_char(&value_string, 'a' + (ix % 26));
+
+		string_to_cstr(&value_string);
+
+		if(!set(id, value))
+			break;
+	}
+}
+
+static void change_append(void)
+{
+	char value[16];
+	string_t value_string;
+
+	string_set(&value_string, value, sizeof(value), 0);
+	string_format(&value_string, "value-%u", change_round);
+	string_to_cstr(&value_string);
+
+	test_assert(set("entry.1", value));
+	test_assert(set("extra", value));
+}
+
+static void change_delete(void)
+{
+	delete("entry.2");
+}
+
+/*
+ * Run change() and config_write() on the committed config, first with a power
+ * cut at the first flash operation of the write, then at the second and so
+ * on, until the write completes without being cut.
+ */
+
+static void write_with_power_cuts(const char *name, void (*change)(void), cuts_t *cuts)
+{
+	model_t committed, changed;
+	flash_sim_cut_t cut;
+	unsigned int op, torn;
+
+	committed = model;
+	flash_sim_save();
+
+	for(op = 0;; op++)
+	{
+		for(torn = 0; torn < torn_sizes; torn++)
+		{
+			flash_sim_restore();
+			test_assert(config_read());
+			model = committed;
+			test_assert(model_matches(&model));
+
+			change_round++;
+			change();
+			changed = model;
+
+			flash_sim_power_cut(op, torn_size[torn]);
+			config_write();
+			cut = flash_sim_cut();
+
+			if(!flash_sim_power_on())
+			{
+				test_assert(config_read());
+				test_assert(model_matches(&changed));
+				return;
+			}
+
+			cuts->runs++;
+
+			if(cut.type == flash_sim_cut_erase)
+				cuts->erase++;
+			else if((cut.address % SPI_FLASH_SEC_SIZE) == 0)
+				cuts->header++;
+			else
+				cuts->record++;
+
+			test_assert(config_read());
+
+			if(model_matches(&changed))
+				model = changed;
+			else if(model_matches(&committed))
+				model = committed;
+			else
+			{
+				test_log("%s: power cut at op %u (%s at %#x, %u bytes) left a mixed config, flash image in test/config-flash.bin\n", name, op,
+						(cut.type == flash_sim_cut_erase) ? "erase" : "write", cut.address, torn_size[torn]);
+				flash_sim_dump("test/config-flash.bin");
+				test_assert(false);
+				continue;
+			}
+
+			// the journal must take writes again after the cut
+
+			change_round++;
+			change_append();
+			test_assert(config_write() > 0);
+			test_assert(config_read());
+			test_assert(model_matches(&model));
+		}
+	}
+}
+
+static void test_roundtrip(void)
+{
+	char value[config_entry_string_size + 8];
+	string_init(id, "entry.5");
+	string_t value_string;
+
+	blank();
+	fill(20, 10);
+	test_assert(config_write() > 0);
+	test_assert(config_read());
+	test_assert(model_matches(&model));
+
+	delete("entry.3");
+	test_assert(set("entry.4", "-17"));
+	test_assert(config_write() > 0);
+	test_assert(config_read());
+	test_assert(model_matches(&model));
+
+	// values that don't fit are refused, not cut short
+
+	memset(value, 'x', sizeof(value));
+	value[config_entry_string_size - 1] = '\0';
+	test_assert(set("entry.5", value));
+
+	value_string = string_from_cstr(sizeof(value), value);
+	string_append(&value_string, "y");
+	test_assert(string_length(&value_string) == config_entry_string_size);
+	test_assert(!config_set_string(&id, -1, -1, &value_string, 0, -1));
+	test_assert(!config_set_string(&id, -1, -1, &value_string, -1, -1));
+	test_assert(config_write() > 0);
+	test_assert(config_read());
+	test_assert(model_matches(&model));
+}
+
+static void test_wear(void)
+{
+	char value[16];
+	string_t value_string;
+	unsigned int round, sector, erases, min_erases, max_erases;
+
+	blank();
+	fill(10, 20);
+	test_assert(config_write() > 0);
+
+	for(round = 0; round < 2000; round++)
+	{
+		string_set(&value_string, value, sizeof(value), 0);
+		string_format(&value_string, "%u", round * 7919);
+		string_to_cstr(&value_string);
+
+		test_assert(set((round & 1) ? "entry.5" : "entry.6", value));
+		test_assert(config_write() > 0);
+
+		if((round % 97) == 0)
+		{
+			test_assert(config_read());
+			test_assert(model_matches(&model));
+		}
+	}
+
+	test_assert(config_read());
+	test_assert(model_matches(&model));
+
+	min_erases = ~0U;
+	max_erases = 0;
+
+	for(sector = 0; sector < USER_CONFIG_JOURNAL_SECTORS; sector++)
+	{
+		erases = flash_sim_erases(USER_CONFIG_JOURNAL_SECTOR + sector);
+
+		if(erases < min_erases)
+			min_erases = erases;
+
+		if(erases > max_erases)
+			max_erases = erases;
+	}
+
+	test_assert(min_erases > 0);
+	test_assert(max_erases <= ((min_erases * 2) + 2));
+}
+
+static void test_full(void)
+{
+	char value[model_value_size];
+	unsigned int round;
+
+	// fill until config_set_*() refuses, the snapshot must still fit next to the live chain
+
+	blank();
+	fill(model_size - 1, 15);
+	test_assert(model.length < model_size);
+	test_assert(config_write() > 0);
+	test_assert(config_read());
+	test_assert(model_matches(&model));
+
+	for(round = 0; round < 200; round++)
+	{
+		strecpy(value, (round & 1) ? "0" : "1", sizeof(value));
+		test_assert(set("entry.0", value));
+		test_assert(config_write() > 0);
+	}
+
+	test_assert(config_read());
+	test_assert(model_matches(&model));
+}
+
+static void test_handle(void)
+{
+	string_new(stack, value_string, model_value_size);
+	string_init(id, "entry.5");
+	string_init(other, "entry.6");
+	string_init(later, "later");
+	config_handle_t handle, handle_later;
+	model_t committed;
+	unsigned int generation, round;
+	int value, entry;
+
+	blank();
+	fill(20, 0);
+	test_assert(config_write() > 0);
+	committed = model;
+
+	config_bind(&handle, &id, -1, -1);
+	config_bind(&handle_later, &later, -1, -1);
+	test_assert(config_handle_get_int(&handle, &value) && (value == 5));
+	test_assert(!config_handle_get_int(&handle_later, &value));
+	generation = handle.generation;
+	entry = handle.entry;
+
+	// reads of other entries and a value change in place leave the index alone, the handle stays valid
+
+	for(round = 0; round < 20; round++)
+		test_assert(config_get_int(&other, -1, -1, &value) && (value == 6));
+
+	test_assert(set("entry.5", "17"));
+	test_assert(config_handle_get_int(&handle, &value) && (value == 17));
+	test_assert((handle.generation == generation) && (handle.entry == entry));
+
+	// a new entry, a delete and a read from flash each change the index, the handle looks its entry up again
+
+	test_assert(set("later", "some text"));
+	test_assert(config_handle_get_int(&handle, &value) && (value == 17));
+	test_assert(handle.generation != generation);
+	test_assert(config_handle_get_string(&handle_later, &value_string) && string_match_cstr(&value_string, "some text"));
+	generation = handle.generation;
+
+	delete("entry.3");
+	test_assert(config_handle_get_int(&handle, &value) && (value == 17));
+	test_assert(handle.generation != generation);
+	generation = handle.generation;
+
+	test_assert(config_read());
+	model = committed;
+	test_assert(config_handle_get_int(&handle, &value) && (value == 5));
+	test_assert(!config_handle_get_int(&handle_later, &value));
+	test_assert(handle.generation != generation);
+
+	// a handle to a deleted key reports it missing, also when another id takes over its slot
+
+	delete("entry.5");
+	test_assert(!config_handle_get_int(&handle, &value));
+	test_assert(handle.entry < 0);
+
+	test_assert(set("taker", "1"));
+	test_assert(!config_handle_get_int(&handle, &value));
+
+	test_assert(set("entry.5", "-3"));
+	test_assert(config_handle_get_int(&handle, &value) && (value == -3));
+	test_assert(model_matches(&model));
+}
+
+static void test_power_cut(void)
+{
+	cuts_t append = { 0 }, rollover = { 0 }, compact = { 0 };
+	unsigned int round;
+
+	// torn records: a plain append to the current sector
+
+	blank();
+	fill(10, 10);
+	test_assert(config_write() > 0);
+	write_with_power_cuts("append", change_append, &append);
+
+	// torn sector headers: keep appending until the appends have gone into new sectors a few times
+
+	for(round = 0; round < 300; round++)
+		write_with_power_cuts("rollover", change_append, &rollover);
+
+	// interrupted compaction: a delete forces a full snapshot
+
+	blank();
+	fill(40, 30);
+	test_assert(config_write() > 0);
+	write_with_power_cuts("compact", change_delete, &compact);
+
+	test_log("power cuts: append %u (record %u), rollover %u (header %u), compact %u (erase %u, header %u, record %u)\n",
+			append.runs, append.record, rollover.runs, rollover.header,
+			compact.runs, compact.erase, compact.header, compact.record);
+
+	test_assert(append.record > 0);
+	test_assert(rollover.header > 0);
+	test_assert(compact.erase > 0);
+	test_assert(compact.header > 0);
+	test_assert(compact.record > 0);
+}
+
+int main(int argc, const char **argv)
+{
+	string_crc32_init();
+
+	test_roundtrip();
+	test_wear();
+	test_full();
+	test_handle();
+	test_power_cut();
+
+	return(test_done(argv[0]));
+}
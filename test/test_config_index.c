@@ -0,0 +1,192 @@
+#include "test.h"
+
+/*
+ * The hash index over the config entries against a plain linear scan of the
+ * entries, after random sets, deletes and reads from flash, and the running
+ * snapshot size against the sizes of the records. There are more
+ * ids than entry slots, so the table runs full and sets get refused, and
+ * deletes leave holes that later sets fill again.
+ */
+
+#include "config.c"
+
+enum
+{
+	pool_size = 160,
+	rounds = 4000,
+};
+
+static char pool[pool_size][config_entry_id_size];
+
+static unsigned int random_next(void)
+{
+	static unsigned int seed = 1;
+
+	seed = (seed * 1103515245) + 12345;
+
+	return(seed >> 16);
+}
+
+static config_entry_t *find_linear(const string_t *id)
+{
+	unsigned int ix;
+
+	for(ix = 0; ix < config_entries_length; ix++)
+		if((config_entries[ix].id_length == string_length(id)) &&
+				!memcmp(config_entry_id(&config_entries[ix]), string_buffer(id), string_length(id)))
+			return(&config_entries[ix]);
+
+	return((config_entry_t *)0);
+}
+
+static unsigned int index_check(void)
+{
+	string_new(stack, value, config_entry_string_size);
+	string_t id;
+	unsigned int ix, found, size;
+
+	for(ix = 0; ix < pool_size; ix++)
+	{
+		id = string_from_cstr(config_entry_id_size, pool[ix]);
+		test_assert(find_config_entry(&id, -1, -1) == find_linear(&id));
+	}
+
+	// every live entry must be reachable through the index, the running snapshot size must add up
+
+	for(ix = 0, found = 0, size = config_record_size(0, 0); ix < config_entries_length; ix++)
+	{
+		if(!config_entries[ix].id_length)
+			continue;
+
+		string_clear(&value);
+		config_entry_value(&config_entries[ix], &value);
+		size += config_record_size(config_entries[ix].id_length, string_length(&value));
+
+		string_set(&id, &config_arena[config_entries[ix].offset], config_entries[ix].id_length, config_entries[ix].id_length);
+		test_assert(find_config_entry(&id, -1, -1) == &config_entries[ix]);
+		found++;
+	}
+
+	test_assert(config_snapshot_size == size);
+	test_assert(config_snapshot_sectors() <= config_snapshot_sectors_bound(config_snapshot_size));
+	test_assert(config_snapshot_sectors_bound(config_snapshot_size) <= config_snapshot_sectors_max);
+
+	return(found);
+}
+
+static void set_random(unsigned int ix)
+{
+	char value[16];
+	string_t id, value_string;
+	unsigned int length;
+
+	string_set(&value_string, value, sizeof(value), 0);
+
+	if(random_next() & 1)
+		string_format(&value_string, "%d", (int)random_next() - 16384);
+	else
+	{
+		length = 1 + (random_next() % (sizeof(value) - 1));
+
+		while(string_length(&value_string) < (int)length)
+			string_append_char(&value_string, 'a' + (random_next() % 26));
+	}
+
+	// half of the io ids go through the %u expansion, like the io code sets them
+
+	if((ix >= (pool_size / 2)) && (random_next() & 1))
+	{
+		string_init(id_template, "io.%u.%u.mode");
+		config_set_string(&id_template, (ix - (pool_size / 2)) / 16, (ix - (pool_size / 2)) % 16, &value_string, 0, -1);
+	}
+	else
+	{
+		id = string_from_cstr(config_entry_id_size, pool[ix]);
+		config_set_string(&id, -1, -1, &value_string, 0, -1);
+	}
+}
+
+int main(int argc, const char **argv)
+{
+	string_t id;
+	unsigned int round, ix, entries, entries_max, deletes, reads;
+
+	string_crc32_init();
+
+	for(ix = 0; ix < pool_size; ix++)
+	{
+		string_set(&id, pool[ix], sizeof(pool[ix]), 0);
+
+		if(ix < (pool_size / 2))
+			string_format(&id, "entry.%u", ix);
+		else
+			string_format(&id, "io.%u.%u.mode", (ix - (pool_size / 2)) / 16, (ix - (pool_size / 2)) % 16);
+
+		string_to_cstr(&id);
+	}
+
+	flash_sim_erase();
+	test_assert(!config_read());
+	index_check();
+
+	entries_max = 0;
+	deletes = 0;
+	reads = 0;
+
+	for(round = 0; round < rounds; round++)
+	{
+		ix = random_next() % pool_size;
+
+		switch(random_next() % 16)
+		{
+			case(0):
+			{
+				id = string_from_cstr(config_entry_id_size, pool[ix]);
+				deletes += config_delete(&id, -1, -1, false);
+				break;
+			}
+
+			case(1):
+			{
+				if((random_next() % 8) == 0)
+				{
+					string_init(prefix, "entry.1");
+					deletes += config_delete(&prefix, -1, -1, true);
+				}
+
+				break;
+			}
+
+			case(2):
+			{
+				if((random_next() % 4) == 0)
+				{
+					config_write();
+					test_assert(config_read());
+					reads++;
+				}
+
+				break;
+			}
+
+			default:
+			{
+				set_random(ix);
+				break;
+			}
+		}
+
+		entries = index_check();
+
+		if(entries > entries_max)
+			entries_max = entries;
+	}
+
+	test_assert(entries_max == config_entries_size);
+	test_assert(deletes > 0);
+	test_assert(reads > 0);
+
+	test_log("config index: %u rounds, %u deletes, %u reads, %u entries at most\n", rounds, deletes, reads, entries_max);
+
+	return(test_done(argv[0]));
+}
@@ -0,0 +1,189 @@
+#include "test.h"
+
+#include "queue.h"
+
+/*
+ * Queue against a plain array model: single bytes, bulk push and pop,
+ * spans and free running counters wrapping around.
+ */
+
+enum
+{
+	buffer_size = 64,
+	model_size = 4096,
+};
+
+static char buffer[buffer_size];
+static char model[model_size];
+static unsigned int model_in, model_out;
+
+static void model_check(const queue_t *queue)
+{
+	unsigned int ix;
+	int lf;
+
+	test_assert(queue_length(queue) == (int)(model_in - model_out));
+	test_assert(queue_space(queue) == (int)(queue->size - (model_in - model_out)));
+	test_assert(queue_empty(queue) == (model_in == model_out));
+	test_assert(queue_full(queue) == ((model_in - model_out) == queue->size));
+
+	for(ix = model_out, lf = 0; ix != model_in; ix++)
+		if(model[ix % model_size] == '\n')
+			lf++;
+
+	test_assert(queue_lf(queue) == lf);
+}
+
+static char next_byte(void)
+{
+	static unsigned int seed = 1;
+
+	seed = (seed * 1103515245) + 12345;
+
+	return(((seed >> 16) % 8) ? (char)('a' + ((seed >> 16) % 26)) : '\n');
+}
+
+static void test_new(void)
+{
+	queue_t queue;
+
+	queue_new(&queue, 100, buffer);
+	test_assert(queue.size == 64);
+	test_assert(queue.mask == 63);
+
+	queue_new(&queue, 64, buffer);
+	test_assert(queue.size == 64);
+	test_assert(queue_empty(&queue));
+	test_assert(queue_space(&queue) == 64);
+}
+
+static void test_single(void)
+{
+	queue_t queue;
+	unsigned int round;
+	int ix;
+	char c;
+
+	queue_new(&queue, buffer_size, buffer);
+	model_in = model_out = 0;
+
+	// the full buffer size is usable
+
+	for(ix = 0; ix < buffer_size; ix++)
+	{
+		c = next_byte();
+		queue_push(&queue, c);
+		model[model_in++ % model_size] = c;
+	}
+
+	model_check(&queue);
+	test_assert(queue_full(&queue));
+
+	for(round = 0; round < 1000; round++)
+	{
+		for(ix = 0; ix < (int)(round % 7) && !queue_empty(&queue); ix++)
+			test_assert(queue_pop(&queue) == model[model_out++ % model_size]);
+
+		for(ix = 0; ix < (int)(round % 5) && !queue_full(&queue); ix++)
+		{
+			c = next_byte();
+			queue_push(&queue, c);
+			model[model_in++ % model_size] = c;
+		}
+
+		model_check(&queue);
+	}
+}
+
+static void test_bulk(unsigned int start)
+{
+	queue_t queue;
+	char data[buffer_size * 2], *span;
+	unsigned int round, ix;
+	int length, done, chunk;
+
+	queue_new(&queue, buffer_size, buffer);
+
+	// start the free running counters anywhere, including just before they wrap
+
+	queue.in = queue.out = start;
+	model_in = model_out = start;
+
+	for(round = 0; round < 5000; round++)
+	{
+		length = (round * 7) % (buffer_size + 13);
+
+		for(ix = 0; ix < (unsigned int)length; ix++)
+			data[ix] = next_byte();
+
+		done = queue_push_n(&queue, data, length);
+		test_assert(done == ((length < (int)(buffer_size - (model_in - model_out))) ? length : (int)(buffer_size - (model_in - model_out))));
+
+		for(ix = 0; ix < (unsigned int)done; ix++)
+			model[model_in++ % model_size] = data[ix];
+
+		model_check(&queue);
+
+		switch(round % 3)
+		{
+			case(0):
+			{
+				length = (round * 11) % (buffer_size + 17);
+				done = queue_pop_n(&queue, data, length);
+				test_assert(done == ((length < (int)(model_in - model_out)) ? length : (int)(model_in - model_out)));
+
+				for(ix = 0; ix < (unsigned int)done; ix++)
+					test_assert(data[ix] == model[model_out++ % model_size]);
+
+				break;
+			}
+
+			case(1):
+			{
+				// a span never crosses the end of the buffer
+
+				chunk = queue_span(&queue, &span);
+				test_assert(chunk <= (int)(model_in - model_out));
+				test_assert((span + chunk) <= (buffer + buffer_size));
+				test_assert((chunk > 0) || queue_empty(&queue));
+
+				for(ix = 0; ix < (unsigned int)chunk; ix++)
+					test_assert(span[ix] == model[(model_out + ix) % model_size]);
+
+				chunk = (chunk + 1) / 2;
+				queue_advance(&queue, chunk);
+				model_out += chunk;
+
+				break;
+			}
+
+			default:
+			{
+				// advancing past the span wraps around
+
+				length = (round * 5) % (buffer_size + 3);
+
+				if(length > (int)(model_in - model_out))
+					length = model_in - model_out;
+
+				queue_advance(&queue, length);
+				model_out += length;
+
+				break;
+			}
+		}
+
+		model_check(&queue);
+	}
+}
+
+int main(int argc, const char **argv)
+{
+	test_new();
+	test_single();
+	test_bulk(0);
+	test_bulk(0U - 1000);
+	test_bulk(0U - 3);
+
+	return(test_done(argv[0]));
+}
@@ -0,0 +1,298 @@
+#include "test.h"
+
+/*
+ * Fixed point sensor compensation against the datasheet example vectors and
+ * against the datasheets' floating point formulas over the whole measuring
+ * range. The compensation functions are static, so the driver source is
+ * included here, test/sdk.c provides an i2c bus without devices.
+ */
+
+#include "i2c_sensor.c"
+
+typedef struct
+{
+	int32_t	samples;
+	double	max_error;
+} deviation_t;
+
+static void deviation(deviation_t *dev, double fixed, double reference)
+{
+	double error = (fixed > reference) ? (fixed - reference) : (reference - fixed);
+
+	if(error > dev->max_error)
+		dev->max_error = error;
+
+	dev->samples++;
+}
+
+static void bmp085_calibration(void)
+{
+	// BST-BMP085-DS000 section 3.5
+
+	bmp085.ac1 = 408;
+	bmp085.ac2 = -72;
+	bmp085.ac3 = -14383;
+	bmp085.ac4 = 32741;
+	bmp085.ac5 = 32757;
+	bmp085.ac6 = 23153;
+	bmp085.b1 = 6190;
+	bmp085.b2 = 4;
+	bmp085.mc = -8711;
+	bmp085.md = 2868;
+}
+
+static void bme280_calibration(void)
+{
+	// BST-BMP280-DS001 section 3.12, the humidity values are from an actual BME280
+
+	bme280.dig_T1 = 27504;
+	bme280.dig_T2 = 26435;
+	bme280.dig_T3 = -1000;
+	bme280.dig_P1 = 36477;
+	bme280.dig_P2 = -10685;
+	bme280.dig_P3 = 3024;
+	bme280.dig_P4 = 2855;
+	bme280.dig_P5 = 140;
+	bme280.dig_P6 = -7;
+	bme280.dig_P7 = 15500;
+	bme280.dig_P8 = -14600;
+	bme280.dig_P9 = 6000;
+	bme280.dig_H1 = 75;
+	bme280.dig_H2 = 362;
+	bme280.dig_H3 = 0;
+	bme280.dig_H4 = 313;
+	bme280.dig_H5 = 50;
+	bme280.dig_H6 = 30;
+}
+
+// the bmp085 pressure calculation on real numbers
+
+static double bmp085_reference_pressure(int32_t up, unsigned int oss, int32_t b5)
+{
+	double x1, x2, x3, b3, b4, b6, b7, p;
+
+	b6	= b5 - 4000;
+	x1	= (bmp085.b2 * (b6 * b6 / 4096)) / 2048;
+	x2	= bmp085.ac2 * b6 / 2048;
+	x3	= x1 + x2;
+	b3	= (((bmp085.ac1 * 4 + x3) * (1 << oss)) + 2) / 4;
+	x1	= bmp085.ac3 * b6 / 8192;
+	x2	= (bmp085.b1 * (b6 * b6 / 4096)) / 65536;
+	x3	= ((x1 + x2) + 2) / 4;
+	b4	= bmp085.ac4 * (x3 + 32768) / 32768;
+	b7	= (up - b3) * (50000 / (1 << oss));
+	p	= (b7 * 2) / b4;
+	x1	= (p / 256) * (p / 256);
+	x1	= (x1 * 3038) / 65536;
+	x2	= (-7357 * p) / 65536;
+
+	return(p + ((x1 + x2 + 3791) / 16));
+}
+
+// BST-BME280-DS001 section 8.1, as used by the driver before the fixed point conversion
+
+static void bme280_reference(int32_t adc_T, int32_t adc_P, int32_t adc_H, double *temperature, double *pressure, double *humidity)
+{
+	double var1, var2, t_fine, p, h;
+
+	var1 = (adc_T / 16384.0 - bme280.dig_T1 / 1024.0) * bme280.dig_T2;
+	var2 = ((adc_T / 131072.0 - bme280.dig_T1 / 8192.0) * (adc_T / 131072.0 - bme280.dig_T1 / 8192.0)) * bme280.dig_T3;
+	t_fine = var1 + var2;
+	*temperature = t_fine / 5120.0;
+
+	var1 = (t_fine / 2.0) - 64000.0;
+	var2 = var1 * var1 * bme280.dig_P6 / 32768.0;
+	var2 = var2 + var1 * bme280.dig_P5 * 2.0;
+	var2 = (var2 / 4.0) + (bme280.dig_P4 * 65536.0);
+	var1 = (bme280.dig_P3 * var1 * var1 / 524288.0 + bme280.dig_P2 * var1) / 524288.0;
+	var1 = (1.0 + var1 / 32768.0) * bme280.dig_P1;
+	p = 1048576.0 - adc_P;
+	p = (p - (var2 / 4096.0)) * 6250.0 / var1;
+	var1 = bme280.dig_P9 * p * p / 2147483648.0;
+	var2 = p * bme280.dig_P8 / 32768.0;
+	*pressure = p + (var1 + var2 + bme280.dig_P7) / 16.0;
+
+	h = t_fine - 76800.0;
+	h = (adc_H - (bme280.dig_H4 * 64.0 + bme280.dig_H5 / 16384.0 * h)) * (bme280.dig_H2 / 65536.0 * (1.0 + bme280.dig_H6 / 67108864.0 * h * (1.0 + bme280.dig_H3 / 67108864.0 * h)));
+	h = h * (1.0 - bme280.dig_H1 * h / 524288.0);
+
+	if(h > 100.0)
+		h = 100.0;
+
+	if(h < 0.0)
+		h = 0.0;
+
+	*humidity = h;
+}
+
+// TSL2561 datasheet, T package, lux = ch0 * factor0 - ch1 * factor1 for ranges of ch1 / ch0
+
+static double tsl2560_reference(unsigned int ch0, unsigned int ch1)
+{
+	double ratio = ch0 ? ((double)ch1 / ch0) : 0;
+
+	if(ratio <= 0.125)
+		return((0.0304 * ch0) - (0.0272 * ch1));
+
+	if(ratio <= 0.250)
+		return((0.0325 * ch0) - (0.0440 * ch1));
+
+	if(ratio <= 0.375)
+		return((0.0351 * ch0) - (0.0544 * ch1));
+
+	if(ratio <= 0.500)
+		return((0.0381 * ch0) - (0.0624 * ch1));
+
+	if(ratio <= 0.610)
+		return((0.0224 * ch0) - (0.0310 * ch1));
+
+	if(ratio <= 0.800)
+		return((0.0128 * ch0) - (0.0153 * ch1));
+
+	if(ratio <= 1.300)
+		return((0.00146 * ch0) - (0.00112 * ch1));
+
+	return(0);
+}
+
+static void test_bmp085(void)
+{
+	deviation_t dev = { 0 };
+	double reference;
+	int32_t b5, p, previous;
+	int32_t ut, up;
+	unsigned int oss;
+
+	bmp085_calibration();
+
+	// datasheet example: 15.0 C, 69964 Pa
+
+	test_assert(bmp085_compensate_temperature(27898, &b5));
+	test_assert(((b5 + 8) >> 4) == 150);
+	test_assert((((b5 + 8) * 100) / 16) / 100 == 150);
+	test_assert(bmp085_compensate_pressure(23843, 0, b5, &p));
+	test_assert(p == 69964);
+
+	// -40 to +85 C and 300 to 1100 hPa, the datasheet's calculation overflows far outside that
+
+	for(oss = 0; oss <= 3; oss++)
+	{
+		for(ut = 20000; ut < 40000; ut += 97)
+		{
+			test_assert(bmp085_compensate_temperature(ut, &b5));
+
+			if((((b5 + 8) >> 4) < -400) || (((b5 + 8) >> 4) > 850))
+				continue;
+
+			previous = -1;
+
+			for(up = (8000 << oss); up < (65536 << oss); up += (61 << oss))
+			{
+				reference = bmp085_reference_pressure(up, oss, b5);
+
+				if((reference < 30000) || (reference > 110000))
+					continue;
+
+				test_assert(bmp085_compensate_pressure(up, oss, b5, &p));
+				deviation(&dev, p, reference);
+
+				if(p < previous)
+				{
+					test_log("bmp085: pressure drops from %d to %d Pa at up = %d, oss = %u\n", previous, p, up, oss);
+					test_assert(false);
+				}
+
+				previous = p;
+			}
+		}
+	}
+
+	// the truncating steps of the datasheet's integer calculation add up to about 10 Pa
+
+	test_log("bmp085: %d samples, max deviation %.2f Pa\n", dev.samples, dev.max_error);
+	test_assert(dev.max_error < 12);
+}
+
+static void test_bme280(void)
+{
+	deviation_t dev_t = { 0 }, dev_p = { 0 }, dev_h = { 0 };
+	double t_ref, p_ref, h_ref;
+	int32_t adc_T, adc_P, adc_H;
+	int32_t temperature, humidity;
+	uint32_t pressure;
+
+	bme280_calibration();
+
+	// datasheet example: 25.08 C, 100653 Pa
+
+	bme280_compensate(519888, 415148, 0, &temperature, &pressure, &humidity);
+	test_assert(temperature == 2508);
+	test_assert((pressure >> 8) == 100653);
+
+	// -40 to +85 C, 300 to 1100 hPa, 0 to 100 %
+
+	for(adc_T = 380000; adc_T < 660000; adc_T += 4999)
+	{
+		for(adc_P = 200000; adc_P < 600000; adc_P += 997)
+		{
+			bme280_compensate(adc_T, adc_P, 0, &temperature, &pressure, &humidity);
+			bme280_reference(adc_T, adc_P, 0, &t_ref, &p_ref, &h_ref);
+
+			if((t_ref < -40) || (t_ref > 85) || (p_ref < 30000) || (p_ref > 110000))
+				continue;
+
+			deviation(&dev_t, temperature / 100.0, t_ref);
+			deviation(&dev_p, pressure / 256.0, p_ref);
+		}
+
+		for(adc_H = 0; adc_H < 65536; adc_H += 13)
+		{
+			bme280_compensate(adc_T, 415148, adc_H, &temperature, &pressure, &humidity);
+			bme280_reference(adc_T, 415148, adc_H, &t_ref, &p_ref, &h_ref);
+
+			if((t_ref < -40) || (t_ref > 85))
+				continue;
+
+			deviation(&dev_h, humidity / 1024.0, h_ref);
+		}
+	}
+
+	test_log("bme280: max deviation %.3f C (%d samples), %.2f Pa (%d samples), %.3f %% (%d samples)\n",
+			dev_t.max_error, dev_t.samples, dev_p.max_error, dev_p.samples, dev_h.max_error, dev_h.samples);
+
+	test_assert(dev_t.max_error <= 0.01);
+	test_assert(dev_p.max_error < 2);
+	test_assert(dev_h.max_error < 0.05);
+}
+
+static void test_tsl2560(void)
+{
+	deviation_t dev = { 0 };
+	unsigned int ch0, ch1;
+	double reference;
+
+	for(ch0 = 0; ch0 < 65535; ch0 += 61)
+	{
+		for(ch1 = 0; ch1 < 65535; ch1 += 59)
+		{
+			reference = tsl2560_reference(ch0, ch1);
+
+			if(reference < 0)
+				reference = 0;
+
+			deviation(&dev, tsl2560_lux(ch0, ch1) / 1000.0, reference);
+		}
+	}
+
+	test_log("tsl2560: %d samples, max deviation %.3f lux\n", dev.samples, dev.max_error);
+	test_assert(dev.max_error < 0.01);
+}
+
+int main(int argc, const char **argv)
+{
+	test_bmp085();
+	test_bme280();
+	test_tsl2560();
+
+	return(test_done(argv[0]));
+}
@@ -12,6 +12,43 @@
 
 #include "esp-uart-register.h"
 
+enum
+{
+	uart_rx_threshold_max = 112,	// leave room in the 128 byte fifo for interrupt latency
+	uart_tx_threshold = 64,
+};
+
+/*
+ * In adaptive mode the "fifo full" threshold is doubled every time the
+ * fifo fills up before the line goes quiet (sustained traffic) and drops
+ * back to the configured value on the first "timeout" interrupt (end of a
+ * burst, interactive use).
+ */
+
+static struct
+{
+	unsigned int	threshold;
+	unsigned int	timeout;
+	unsigned int	current;
+	bool_t			adaptive;
+} uart_rx =
+{
+	.threshold = 16,
+	.timeout = 2,
+	.current = 16,
+	.adaptive = false,
+};
+
+attr_speed iram static void uart_write_conf1(void)
+{
+	write_peri_reg(UART_CONF1(0),
+			((uart_rx.timeout & UART_RX_TOUT_THRHD) << UART_RX_TOUT_THRHD_S) | UART_RX_TOUT_EN |
+			((uart_rx.current & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |
+			((uart_tx_threshold & UART_TXFIFO_EMPTY_THRHD) << UART_TXFIFO_EMPTY_THRHD_S));
+
+	stat_uart_rx_threshold = uart_rx.current;
+}
+
 irom attr_pure uart_parity_t uart_string_to_parity(const string_t *src)
 {
 	uart_parity_t rv;
@@ -71,28 +108,54 @@ attr_speed iram static int uart_tx_fifo_length(void)
 
 attr_speed iram static void uart_callback(void *p)
 {
-	char data;
+	char buffer[128];
+	int length, ix;
+	uint32_t status;
+	unsigned int threshold;
 
 	ETS_UART_INTR_DISABLE();
 
 	// receive fifo "timeout" or "full" -> data available
 
-	if(read_peri_reg(UART_INT_ST(0)) & (UART_RXFIFO_TOUT_INT_ST | UART_RXFIFO_FULL_INT_ST))
+	status = read_peri_reg(UART_INT_ST(0));
+
+	if(status & (UART_RXFIFO_TOUT_INT_ST | UART_RXFIFO_FULL_INT_ST))
 	{
 		stat_uart_rx_interrupts++;
 
+		if(uart_rx.adaptive)
+		{
+			if(status & UART_RXFIFO_TOUT_INT_ST)
+				threshold = uart_rx.threshold;
+			else
+				threshold = uart_rx.current * 2;
+
+			if(threshold > uart_rx_threshold_max)
+				threshold = uart_rx_threshold_max;
+
+			if(threshold != uart_rx.current)
+			{
+				uart_rx.current = threshold;
+				uart_write_conf1();
+			}
+		}
+
 		// make sure to fetch all data from the fifo, or we'll get a another
 		// interrupt immediately after we enable it
 
-		while(uart_rx_fifo_length() > 0)
+		while((length = uart_rx_fifo_length()) > 0)
 		{
-			data = read_peri_reg(UART_FIFO(0));
+			if(length > (int)sizeof(buffer))
+				length = sizeof(buffer);
+
+			for(ix = 0; ix < length; ix++)
+				buffer[ix] = read_peri_reg(UART_FIFO(0));
 
-			if(!queue_full(&uart_receive_queue))
-				queue_push(&uart_receive_queue, data);
+			stat_uart_rx_bytes += length;
+			stat_uart_rx_dropped += length - queue_push_n(&uart_receive_queue, buffer, length);
 		}
 
-		system_os_post(background_task_id, 0, 0);
+		background_task_wake(background_source_bridge);
 	}
 
 	// receive transmit fifo "empty", room for new data in the fifo
@@ -101,8 +164,10 @@ attr_speed iram static void uart_callback(void *p)
 	{
 		stat_uart_tx_interrupts++;
 
-		while(!queue_empty(&uart_send_queue) && (uart_tx_fifo_length() < 64))
-			write_peri_reg(UART_FIFO(0), queue_pop(&uart_send_queue));
+		length = queue_pop_n(&uart_send_queue, buffer, uart_tx_threshold - uart_tx_fifo_length());
+
+		for(ix = 0; ix < length; ix++)
+			write_peri_reg(UART_FIFO(0), buffer[ix]);
 
 		uart_start_transmit(!queue_empty(&uart_send_queue));
 	}
@@ -150,6 +215,7 @@ irom void uart_init(int baud, int data_bits, int stop_bits, uart_parity_t parity
 
 	// Set receive fifo "full" threshold.
 	// When the fifo grows beyond this threshold, raise an interrupt.
+	// Both are set by uart_rx_config().
 
 	// Set transmit fifo "empty" threshold.
 	// If the fifo contains less than this numbers of bytes, raise an
@@ -158,10 +224,7 @@ irom void uart_init(int baud, int data_bits, int stop_bits, uart_parity_t parity
 	// something in it that should be written to the uart's fifo, see
 	// uart_start_transmit().
 
-	write_peri_reg(UART_CONF1(0),
-			(( 2 & UART_RX_TOUT_THRHD) << UART_RX_TOUT_THRHD_S) | UART_RX_TOUT_EN |
-			((16 & UART_RXFIFO_FULL_THRHD) << UART_RXFIFO_FULL_THRHD_S) |
-			((64 & UART_TXFIFO_EMPTY_THRHD) << UART_TXFIFO_EMPTY_THRHD_S));
+	uart_write_conf1();
 
 	write_peri_reg(UART_INT_CLR(0), 0xffff);
 	write_peri_reg(UART_INT_ENA(0), UART_RXFIFO_TOUT_INT_ENA | UART_RXFIFO_FULL_INT_ENA);
@@ -176,3 +239,28 @@ attr_speed iram void uart_start_transmit(char c)
 	else
 		clear_peri_reg_mask(UART_INT_ENA(0), UART_TXFIFO_EMPTY_INT_ENA);
 }
+
+irom void uart_rx_config(int threshold, int timeout, bool_t adaptive)
+{
+	if(threshold < 1)
+		threshold = 1;
+
+	if(threshold > uart_rx_threshold_max)
+		threshold = uart_rx_threshold_max;
+
+	if(timeout < 1)
+		timeout = 1;
+
+	if(timeout > UART_RX_TOUT_THRHD)
+		timeout = UART_RX_TOUT_THRHD;
+
+	ETS_UART_INTR_DISABLE();
+
+	uart_rx.threshold = threshold;
+	uart_rx.timeout = timeout;
+	uart_rx.current = threshold;
+	uart_rx.adaptive = adaptive;
+	uart_write_conf1();
+
+	ETS_UART_INTR_ENABLE();
+}
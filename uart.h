@@ -29,5 +29,6 @@ uart_parity_t	uart_string_to_parity(const string_t *src);
 void			uart_parameters_to_string(string_t *dst, const uart_parameters_t *);
 void			uart_init(int baud, int data_bits, int stop_bits, uart_parity_t parity);
 void			uart_start_transmit(char);
+void			uart_rx_config(int threshold, int timeout, bool_t adaptive);
 
 #endif
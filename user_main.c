@@ -2,6 +2,7 @@
 
 #include "util.h"
 #include "application.h"
+#include "binary.h"
 #include "io.h"
 #include "stats.h"
 #include "i2c.h"
@@ -71,7 +72,118 @@ static socket_data_t socket_cmd =
 	}
 };
 
-static char _socket_uart_send_buffer[1024];
+/*
+ * A command packet can hold several commands (see application_command_next()).
+ * They're run in order and their replies are collected in the send buffer.
+ * A command is only started while at least "reserve" bytes are free, otherwise
+ * the replies so far are sent first and the remaining commands are copied
+ * to the pipeline buffer, to be run when the send has completed. What doesn't
+ * fit in the pipeline buffer is lost, the command that was cut off is not run
+ * but answered with an overflow error.
+ */
+
+enum
+{
+	cmd_pipeline_reserve = sizeof(_socket_cmd_send_buffer) / 2,
+};
+
+static char _socket_cmd_pipeline_buffer[bridge_send_size_max];
+
+static struct
+{
+	int			offset;
+	int			commands;
+	bool_t		pending;
+	int			overflow;	// offset of the command cut off by a pipeline buffer overflow, -1 = none
+	bool_t			has_id;
+	uint32_t		id;
+	unsigned int	cursor;
+	bool_t			close;
+	socket_remote_t	remote;
+} cmd_pipeline =
+{
+	.offset = 0,
+	.commands = 0,
+	.pending = false,
+	.overflow = -1,
+	.has_id = false,
+	.id = 0,
+	.cursor = 0,
+	.close = false,
+};
+
+/*
+ * Several tcp clients (and any number of udp peers) share the one command
+ * handler. A packet that comes in while another request is being handled is
+ * copied to the backlog and run, in order of arrival, when the handler is free
+ * again. The receive of a tcp client is held while it has a packet waiting, so
+ * no client can have more than one packet queued and crowd out the others.
+ */
+
+enum
+{
+	cmd_backlog_size = 2048,
+};
+
+typedef struct
+{
+	socket_remote_t	remote;
+	int				length;
+} cmd_backlog_header_t;
+
+static char _socket_cmd_backlog_buffer[cmd_backlog_size];
+static queue_t cmd_backlog;
+static socket_remote_t cmd_disconnect_remote;
+
+/*
+ * UDP may lose or duplicate packets, so a client that retransmits can't tell
+ * whether a command has already been run. If a request carries an id (a
+ * nonzero request id of a binary frame or a "#<id> " prefix on a text packet), the
+ * first part of the reply is kept, keyed by remote address, port and id. A
+ * retransmitted request is then answered from the cache instead of being run
+ * again. If the reply didn't fit, the retransmit gets a "duplicate" answer,
+ * never a second execution. Text replies start with the same "#<id> " prefix.
+ */
+
+enum
+{
+	cmd_dedup_entries = 4,
+	cmd_dedup_reply_size = 128,
+	cmd_dedup_binary = 0x80000000,
+};
+
+typedef struct
+{
+	uint32_t	address;
+	uint32_t	id;
+	uint32_t	sequence;
+	uint16_t	port;
+	uint8_t		valid;
+	uint8_t		complete;
+	uint16_t	length;
+	char		reply[cmd_dedup_reply_size];
+} cmd_dedup_t;
+
+static cmd_dedup_t cmd_dedup[cmd_dedup_entries];
+static uint32_t cmd_dedup_sequence;
+
+/*
+ * On tcp a binary frame may be split over several packets. The start of an
+ * incomplete frame is kept for each client and put in front of the next
+ * packet from the same client. The serial tells apart a new connection that
+ * took over the child slot.
+ */
+
+typedef struct
+{
+	unsigned int	serial;
+	int				length;
+	char			data[binary_request_size_max];
+} cmd_partial_t;
+
+static cmd_partial_t cmd_partial[socket_tcp_children_max];
+
+// the uart socket's send buffer is a view on the span of uart_receive_queue that is being sent
 
 static socket_data_t socket_uart =
 {
@@ -86,12 +198,34 @@ static socket_data_t socket_uart =
 	.send_buffer =
 	{
 		.length = 0,
-		.size = sizeof(_socket_uart_send_buffer),
-		.buffer = _socket_uart_send_buffer
+		.size = 0,
+		.buffer = (char *)0
 	}
 };
 
 static bool_t uart_bridge_active = false;
+
+/*
+ * The bridge sends from uart_receive_queue in place. While a packet is in
+ * flight the queue keeps filling behind it, so the next packet is
+ * ready when the sent callback comes in. Small amounts are held back until
+ * either "bytes" are available or the oldest data has waited "time" us.
+ */
+
+static struct
+{
+	unsigned int	bytes;
+	unsigned int	time;
+	bool_t			waiting;
+	uint32_t		since;
+	ETSTimer		timer;
+} bridge_coalesce =
+{
+	.bytes = 0,
+	.time = 0,
+	.waiting = false,
+	.since = 0,
+};
 static reset_state_t reset_state = reset_state_inactive;
 
 static struct
@@ -106,6 +240,45 @@ static struct
 	.init_displays = 0,
 };
 
+/*
+ * Background work is split in sources that are marked ready by the events
+ * that produce work for them (uart interrupt, socket callbacks, timers).
+ * background_task() runs one unit of work from the next ready source in
+ * round robin order and then yields to the SDK by posting itself again.
+ */
+
+static struct
+{
+	struct
+	{
+		volatile uint8_t	ready;
+		uint32_t			since;
+	} source[background_source_size];
+
+	unsigned int	next;
+	volatile bool_t	posted;
+} background_scheduler;
+
+attr_speed iram static void background_source_ready(background_source_t source)
+{
+	if(!background_scheduler.source[source].ready)
+	{
+		background_scheduler.source[source].since = system_get_time();
+		background_scheduler.source[source].ready = 1;
+	}
+}
+
+attr_speed iram void background_task_wake(background_source_t source)
+{
+	background_source_ready(source);
+
+	if(!background_scheduler.posted)
+	{
+		background_scheduler.posted = true;
+		system_os_post(background_task_id, background_signal_wake, 0);
+	}
+}
+
 static ETSTimer fast_timer;
 static ETSTimer slow_timer;
 
@@ -135,29 +308,67 @@ iram void user_rf_pre_init(void)
 
 static void user_init2(void);
 
+attr_speed iram static void bridge_uart_release(void)
+{
+	queue_advance(&uart_receive_queue, string_length(&socket_uart.send_buffer));
+	string_clear(&socket_uart.send_buffer);
+	socket_uart.state = socket_state_idle;
+}
+
+attr_speed iram static void bridge_coalesce_timer_callback(void *arg)
+{
+	background_task_wake(background_source_bridge);
+}
+
+attr_speed iram static bool_t bridge_uart_hold(void)
+{
+	uint32_t now;
+	unsigned int wait;
+
+	now = system_get_time();
+
+	if(!bridge_coalesce.waiting)
+		bridge_coalesce.since = now;
+
+	wait = bridge_coalesce_wait(queue_length(&uart_receive_queue), now - bridge_coalesce.since, bridge_coalesce.bytes, bridge_coalesce.time);
+
+	if(!(bridge_coalesce.waiting = (wait > 0)))
+		return(false);
+
+	os_timer_disarm(&bridge_coalesce.timer);
+	os_timer_arm(&bridge_coalesce.timer, (wait + 999) / 1000, 0);
+
+	return(true);
+}
+
 attr_speed iram static bool_t background_task_bridge_uart(void)
 {
-	if(socket_uart.state == socket_state_idle)
-	{
-		while(!queue_empty(&uart_receive_queue) && string_space(&socket_uart.send_buffer))
-			string_append_char(&socket_uart.send_buffer, queue_pop(&uart_receive_queue));
+	char *data;
+	int length;
 
-		if(!string_empty(&socket_uart.send_buffer))
-		{
-			socket_uart.state = socket_state_sending;
+	if((socket_uart.state != socket_state_idle) || queue_empty(&uart_receive_queue) || bridge_uart_hold())
+		return(false);
 
-			if(socket_send(&socket_uart.socket, &socket_uart.send_buffer))
-				return(true);
-			else
-			{
-				string_clear(&socket_uart.send_buffer);
-				socket_uart.state = socket_state_idle;
-				stat_uart_send_buffer_overflow++;
-				return(false);
-			}
-		}
+	// send straight from the queue, the data is only released once it has been sent
+
+	length = queue_span(&uart_receive_queue, &data);
+
+	if(length > bridge_send_size_max)
+		length = bridge_send_size_max;
+
+	string_set(&socket_uart.send_buffer, data, length, length);
+	socket_uart.state = socket_state_sending;
+
+	if(socket_send(&socket_uart.socket, &socket_uart.send_buffer))
+	{
+		stat_uart_bridge_packets++;
+		stat_uart_bridge_bytes += length;
+		return(true);
 	}
 
+	bridge_uart_release();
+	stat_uart_send_buffer_overflow++;
+
 	return(false);
 }
 
@@ -165,7 +376,7 @@ attr_speed iram static bool_t background_task_longop_handler(void)
 {
 	if(bg_action.disconnect)
 	{
-		socket_disconnect_accepted(&socket_cmd.socket);
+		socket_disconnect(&socket_cmd.socket, &cmd_disconnect_remote);
 		bg_action.disconnect = 0;
 		return(true);
 	}
@@ -191,74 +402,615 @@ attr_speed iram static bool_t background_task_longop_handler(void)
 	return(false);
 }
 
+irom static bool_t cmd_request_id(const string_t *src, uint32_t *id, int *offset)
+{
+	int current, digits;
+	char byte;
+
+	if(binary_frame(src))
+	{
+		*offset = 0;
+
+		// id 0 = no duplicate detection, see binary.h
+
+		if((*id = binary_request_id(src)) == 0)
+			return(false);
+
+		*id |= cmd_dedup_binary;
+		return(true);
+	}
+
+	if((string_length(src) < 3) || (string_at(src, 0) != '#'))
+		return(false);
+
+	*id = 0;
+
+	for(current = 1, digits = 0; current < string_length(src); current++, digits++)
+	{
+		byte = string_at(src, current);
+
+		if((byte < '0') || (byte > '9'))
+			break;
+
+		if(*id > ((cmd_dedup_binary - 1 - 9) / 10))
+			return(false);
+
+		*id = (*id * 10) + (byte - '0');
+	}
+
+	if((digits == 0) || (current >= string_length(src)) || (string_at(src, current) != ' '))
+		return(false);
+
+	*offset = current + 1;
+	return(true);
+}
+
+irom static cmd_dedup_t *cmd_dedup_find(void)
+{
+	int entry;
+
+	for(entry = 0; entry < cmd_dedup_entries; entry++)
+		if(cmd_dedup[entry].valid && (cmd_dedup[entry].id == cmd_pipeline.id) &&
+				(cmd_dedup[entry].address == cmd_pipeline.remote.address.ip_addr.addr) &&
+				(cmd_dedup[entry].port == cmd_pipeline.remote.port))
+			return(&cmd_dedup[entry]);
+
+	return((cmd_dedup_t *)0);
+}
+
+irom static void cmd_dedup_store(const string_t *reply, bool_t complete)
+{
+	cmd_dedup_t *slot;
+	int entry;
+
+	// replace an unused or otherwise the least recently stored entry
+
+	for(entry = 0, slot = &cmd_dedup[0]; entry < cmd_dedup_entries; entry++)
+	{
+		if(!cmd_dedup[entry].valid)
+		{
+			slot = &cmd_dedup[entry];
+			break;
+		}
+
+		if((cmd_dedup_sequence - cmd_dedup[entry].sequence) > (cmd_dedup_sequence - slot->sequence))
+			slot = &cmd_dedup[entry];
+	}
+
+	if(string_length(reply) > cmd_dedup_reply_size)
+		complete = false;
+
+	slot->address = cmd_pipeline.remote.address.ip_addr.addr;
+	slot->port = cmd_pipeline.remote.port;
+	slot->id = cmd_pipeline.id;
+	slot->sequence = cmd_dedup_sequence++;
+	slot->valid = 1;
+	slot->complete = complete ? 1 : 0;
+	slot->length = complete ? string_length(reply) : 0;
+
+	if(complete)
+		memcpy(slot->reply, string_buffer(reply), slot->length);
+}
+
+irom static void cmd_dedup_replay(const cmd_dedup_t *entry)
+{
+	string_clear(&socket_cmd.send_buffer);
+
+	if(entry->complete)
+	{
+		memcpy(string_buffer_nonconst(&socket_cmd.send_buffer), entry->reply, entry->length);
+		string_setlength(&socket_cmd.send_buffer, entry->length);
+	}
+	else
+		if(cmd_pipeline.id & cmd_dedup_binary)
+			binary_reply_status(&socket_cmd.receive_buffer, &socket_cmd.send_buffer, binary_status_duplicate);
+		else
+			string_format(&socket_cmd.send_buffer, "#%u > duplicate request, reply not kept\n", cmd_pipeline.id);
+
+	stat_cmd_udp_duplicates++;
+}
+
+/*
+ * Commands that don't fit in the pipeline buffer are lost. Return the offset
+ * of the first command that was cut off, it must not be run. Only a newline
+ * or a ';' proves a text command complete, a binary frame its length field.
+ */
+
+irom static int cmd_overflow(const string_t *src)
+{
+	string_t rest;
+	int offset, next, length;
+
+	stat_cmd_receive_buffer_overflow++;
+
+	for(offset = 0; offset < string_length(src); offset = next)
+	{
+		string_set(&rest, src->buffer + offset, string_length(src) - offset, string_length(src) - offset);
+
+		if(binary_frame(&rest))
+		{
+			if((length = binary_frame_length(&rest)) <= 0)
+				break;
+
+			next = offset + length;
+		}
+		else
+		{
+			next = application_command_next(src, offset, &length);
+
+			if((next >= string_length(src)) && ((offset + length) == next) && (string_at(src, next - 1) != '\n'))
+				break;
+		}
+	}
+
+	return(offset);
+}
+
+irom static void cmd_partial_keep(void)
+{
+	cmd_partial_t *partial = &cmd_partial[cmd_pipeline.remote.child];
+
+	// binary_frame_length() said it's incomplete, so it's shorter than binary_request_size_max
+
+	partial->serial = cmd_pipeline.remote.serial;
+	partial->length = string_length(&socket_cmd.receive_buffer);
+	memcpy(partial->data, string_buffer(&socket_cmd.receive_buffer), partial->length);
+
+	stat_cmd_binary_split++;
+}
+
+irom static void cmd_partial_prepend(const socket_remote_t *remote)
+{
+	cmd_partial_t *partial;
+	bool_t overflow;
+	int length;
+
+	if(remote->proto != proto_tcp)
+		return;
+
+	partial = &cmd_partial[remote->child];
+
+	if(partial->length == 0)
+		return;
+
+	if(partial->serial == remote->serial)
+	{
+		length = string_length(&socket_cmd.receive_buffer);
+		overflow = (partial->length + length) > (int)sizeof(_socket_cmd_pipeline_buffer);
+
+		if(overflow)
+			length = sizeof(_socket_cmd_pipeline_buffer) - partial->length;
+
+		// the packet may already be in the pipeline buffer, when it comes from the backlog
+
+		memmove(_socket_cmd_pipeline_buffer + partial->length, string_buffer(&socket_cmd.receive_buffer), length);
+		memcpy(_socket_cmd_pipeline_buffer, partial->data, partial->length);
+		string_set(&socket_cmd.receive_buffer, _socket_cmd_pipeline_buffer, sizeof(_socket_cmd_pipeline_buffer), partial->length + length);
+
+		if(overflow)
+			cmd_pipeline.overflow = cmd_overflow(&socket_cmd.receive_buffer);
+	}
+
+	partial->length = 0;
+}
+
+attr_speed iram static void cmd_start(const socket_remote_t *remote)
+{
+	cmd_pipeline.overflow = -1;
+	cmd_partial_prepend(remote);
+
+	cmd_pipeline.offset = 0;
+	cmd_pipeline.commands = 0;
+	cmd_pipeline.pending = false;
+	cmd_pipeline.cursor = 0;
+	cmd_pipeline.close = false;
+	cmd_pipeline.remote = *remote;
+	socket_cmd.state = socket_state_received;
+
+	background_task_wake(background_source_command);
+}
+
+irom static void cmd_backlog_push(socket_t *socket, const string_t *buffer)
+{
+	cmd_backlog_header_t header;
+
+	header.remote = socket->remote;
+	header.length = string_length(buffer);
+
+	if((header.length > (int)sizeof(_socket_cmd_pipeline_buffer)) ||
+			(queue_space(&cmd_backlog) < (int)(sizeof(header) + header.length)))
+	{
+		stat_cmd_receive_buffer_overflow++;
+		return;
+	}
+
+	queue_push_n(&cmd_backlog, (const char *)&header, sizeof(header));
+	queue_push_n(&cmd_backlog, string_buffer(buffer), header.length);
+	socket_receive_hold(socket, &header.remote, true);
+
+	stat_cmd_queued++;
+}
+
+// the current request is done, start the next one from the backlog, if any
+
+attr_speed iram static void cmd_idle(void)
+{
+	cmd_backlog_header_t header;
+
+	cmd_pipeline.pending = false;
+
+	if(queue_empty(&cmd_backlog))
+	{
+		socket_cmd.state = socket_state_idle;
+		return;
+	}
+
+	queue_pop_n(&cmd_backlog, (char *)&header, sizeof(header));
+	queue_pop_n(&cmd_backlog, _socket_cmd_pipeline_buffer, header.length);
+	string_set(&socket_cmd.receive_buffer, _socket_cmd_pipeline_buffer, sizeof(_socket_cmd_pipeline_buffer), header.length);
+	socket_receive_hold(&socket_cmd.socket, &header.remote, false);
+
+	cmd_start(&header.remote);
+}
+
+// the rest of the packet is run after the reply has been sent
+
+irom static void cmd_keep_remaining(void)
+{
+	int remaining;
+	bool_t overflow;
+
+	remaining = string_length(&socket_cmd.receive_buffer) - cmd_pipeline.offset;
+
+	if(remaining > 0)
+	{
+		// the receive buffer is only valid until the next packet comes in, keep a copy
+
+		overflow = remaining > (int)sizeof(_socket_cmd_pipeline_buffer);
+
+		if(overflow)
+			remaining = sizeof(_socket_cmd_pipeline_buffer);
+
+		memmove(_socket_cmd_pipeline_buffer, socket_cmd.receive_buffer.buffer + cmd_pipeline.offset, remaining);
+		string_set(&socket_cmd.receive_buffer, _socket_cmd_pipeline_buffer, sizeof(_socket_cmd_pipeline_buffer), remaining);
+
+		if(overflow)
+			cmd_pipeline.overflow = cmd_overflow(&socket_cmd.receive_buffer);
+		else
+			if(cmd_pipeline.overflow >= 0)
+				cmd_pipeline.overflow -= cmd_pipeline.offset;
+
+		cmd_pipeline.offset = 0;
+		cmd_pipeline.pending = true;
+	}
+	else
+		cmd_pipeline.pending = false;
+}
+
+attr_speed iram static bool_t background_task_command_send(void)
+{
+	socket_cmd.state = socket_state_sending;
+
+	if(!socket_send_to(&socket_cmd.socket, &cmd_pipeline.remote, &socket_cmd.send_buffer))
+	{
+		stat_cmd_send_buffer_overflow++;
+		cmd_idle();
+		return(false);
+	}
+
+	return(true);
+}
+
 attr_speed iram static bool_t background_task_command_handler(void)
 {
+	string_t command, reply, trimmed;
+	int current, next, length;
+	app_action_t action;
+	cmd_dedup_t *entry;
+	bool_t first;
+
 	if(socket_cmd.state != socket_state_received)
 		return(false);
 
 	socket_cmd.state = socket_state_processing;
 
+	if(cmd_pipeline.commands == 0)
+	{
+		cmd_pipeline.has_id = cmd_request_id(&socket_cmd.receive_buffer, &cmd_pipeline.id, &cmd_pipeline.offset);
+
+		if(cmd_pipeline.has_id && (cmd_pipeline.remote.proto == proto_udp) && (entry = cmd_dedup_find()))
+		{
+			cmd_dedup_replay(entry);
+			cmd_pipeline.pending = false;
+			return(background_task_command_send());
+		}
+	}
+
+	if(binary_frame(&socket_cmd.receive_buffer))
+	{
+		length = binary_frame_length(&socket_cmd.receive_buffer);
+
+		// the frame was cut off by a pipeline buffer overflow, reply with an error like for a bad length
+
+		if(cmd_pipeline.overflow == 0)
+		{
+			cmd_pipeline.overflow = -1;
+			length = -1;
+		}
+
+		// wait for the rest of the frame in the next packet
+
+		if((length == 0) && (cmd_pipeline.remote.proto == proto_tcp))
+		{
+			cmd_partial_keep();
+			cmd_idle();
+			return(true);
+		}
+
+		if(length > 0)
+		{
+			string_set(&command, socket_cmd.receive_buffer.buffer, length, length);
+			binary_request(&command, &socket_cmd.send_buffer);
+			cmd_pipeline.offset = length;
+		}
+		else
+		{
+			// incomplete udp packet, bad length or overflow, where the next frame starts is unknown, drop the rest
+
+			stat_cmd_binary++;
+			stat_cmd_binary_errors++;
+			binary_reply_status(&socket_cmd.receive_buffer, &socket_cmd.send_buffer, binary_status_frame_error);
+			cmd_pipeline.offset = string_length(&socket_cmd.receive_buffer);
+
+			// a tcp stream can't be followed any further
+
+			if(length < 0)
+				cmd_pipeline.close = true;
+		}
+
+		// more frames or text commands may follow in the same packet
+
+		cmd_keep_remaining();
+
+		if(cmd_pipeline.has_id && (cmd_pipeline.remote.proto == proto_udp))
+			cmd_dedup_store(&socket_cmd.send_buffer, true);
+
+		return(background_task_command_send());
+	}
+
+	first = cmd_pipeline.commands == 0;
+
 	string_clear(&socket_cmd.send_buffer);
 
-	switch(application_content(&socket_cmd.receive_buffer, &socket_cmd.send_buffer))
+	if(cmd_pipeline.has_id)
+		string_format(&socket_cmd.send_buffer, "#%u ", cmd_pipeline.id);
+
+	do
 	{
-		case(app_action_normal):
-		case(app_action_error):
-		case(app_action_http_ok):
+		next = application_command_next(&socket_cmd.receive_buffer, cmd_pipeline.offset, &length);
+
+		string_set(&command, socket_cmd.receive_buffer.buffer + cmd_pipeline.offset,
+				string_size(&socket_cmd.receive_buffer) - cmd_pipeline.offset, length);
+
+		if(cmd_pipeline.commands > 0)
+		{
+			trimmed = command;
+			string_trim_nl(&trimmed);
+
+			if(string_empty(&trimmed))
+			{
+				cmd_pipeline.offset = next;
+				continue;
+			}
+
+			if((string_size(&socket_cmd.send_buffer) - string_length(&socket_cmd.send_buffer)) < cmd_pipeline_reserve)
+			{
+				stat_cmd_reply_split++;
+				break;
+			}
+
+			if(cmd_pipeline.cursor == 0)
+				stat_cmd_pipelined++;
+		}
+
+		string_set(&reply, socket_cmd.send_buffer.buffer + string_length(&socket_cmd.send_buffer),
+				string_size(&socket_cmd.send_buffer) - string_length(&socket_cmd.send_buffer), 0);
+
+		// the rest of the packet was lost to a pipeline buffer overflow, don't run what's left of this command
+
+		if(cmd_pipeline.offset == cmd_pipeline.overflow)
 		{
-			/* no special action for now */
+			string_append(&socket_cmd.send_buffer, "> receive buffer overflow, command dropped\n");
+			cmd_pipeline.offset = string_length(&socket_cmd.receive_buffer);
+			cmd_pipeline.overflow = -1;
 			break;
 		}
-		case(app_action_empty):
+
+		current = cmd_pipeline.offset;
+		cmd_pipeline.offset = next;
+		cmd_pipeline.commands++;
+
+		switch((action = application_content(&command, &reply, &cmd_pipeline.cursor)))
+		{
+			case(app_action_normal):
+			case(app_action_error):
+			{
+				/* no special action for now */
+				break;
+			}
+			case(app_action_more):
+			{
+				// run the command again for the next part, after this one has been sent
+
+				cmd_pipeline.offset = current;
+				stat_cmd_reply_parts++;
+				break;
+			}
+			case(app_action_http_ok):
+			{
+				// the page may not have a Content-Length, close the connection when it's sent
+
+				cmd_pipeline.close = true;
+				break;
+			}
+			case(app_action_empty):
+			{
+				string_clear(&reply);
+				string_append(&reply, "> empty command\n");
+				break;
+			}
+			case(app_action_disconnect):
+			{
+				string_clear(&reply);
+				string_append(&reply, "> disconnect\n");
+				cmd_disconnect_remote = cmd_pipeline.remote;
+				bg_action.disconnect = 1;
+				background_task_wake(background_source_longop);
+				break;
+			}
+			case(app_action_reset):
+			{
+				string_clear(&reply);
+				string_append(&reply, "> reset\n");
+				reset_state = reset_state_send_reply;
+				break;
+			}
+			case(app_action_ota_commit):
+			{
+#if IMAGE_OTA == 1
+				rboot_config rcfg = rboot_get_config();
+				string_format(&reply, "OTA commit slot %d\n", rcfg.current_rom);
+				reset_state = reset_state_send_reply;
+#endif
+				break;
+			}
+		}
+
+		string_setlength(&socket_cmd.send_buffer, string_length(&socket_cmd.send_buffer) + string_length(&reply));
+
+		// the connection is going away, ignore the rest of the packet
+
+		if((action == app_action_disconnect) || (action == app_action_reset) || (action == app_action_ota_commit) ||
+				(action == app_action_http_ok))
+			cmd_pipeline.offset = string_length(&socket_cmd.receive_buffer);
+	}
+	while((action != app_action_more) && (cmd_pipeline.offset < string_length(&socket_cmd.receive_buffer)));
+
+	cmd_keep_remaining();
+
+	if(first && cmd_pipeline.has_id && (cmd_pipeline.remote.proto == proto_udp))
+		cmd_dedup_store(&socket_cmd.send_buffer, !cmd_pipeline.pending);
+
+	return(background_task_command_send());
+}
+
+attr_speed iram static bool_t background_task_run(background_source_t source)
+{
+	switch(source)
+	{
+		case(background_source_bridge):
 		{
-			string_clear(&socket_cmd.send_buffer);
-			string_append(&socket_cmd.send_buffer, "> empty command\n");
+			if(uart_bridge_active && background_task_bridge_uart())
+			{
+				stat_update_uart++;
+				return(true);
+			}
+
 			break;
 		}
-		case(app_action_disconnect):
+
+		case(background_source_longop):
 		{
-			string_clear(&socket_cmd.send_buffer);
-			string_append(&socket_cmd.send_buffer, "> disconnect\n");
-			bg_action.disconnect = 1;
+			if(background_task_longop_handler())
+			{
+				stat_update_longop++;
+				return(true);
+			}
+
 			break;
 		}
-		case(app_action_reset):
+
+		case(background_source_command):
 		{
-			string_clear(&socket_cmd.send_buffer);
-			string_append(&socket_cmd.send_buffer, "> reset\n");
-			reset_state = reset_state_send_reply;
+			if(background_task_command_handler())
+			{
+				if(cmd_pipeline.remote.proto == proto_tcp)
+					stat_update_command_tcp++;
+				else
+					stat_update_command_udp++;
+
+				return(true);
+			}
+
 			break;
 		}
-		case(app_action_ota_commit):
+
+		case(background_source_display):
 		{
-#if IMAGE_OTA == 1
-			rboot_config rcfg = rboot_get_config();
-			string_format(&socket_cmd.send_buffer, "OTA commit slot %d\n", rcfg.current_rom);
-			reset_state = reset_state_send_reply;
-#endif
+			if(display_periodic())
+			{
+				stat_update_display++;
+				return(true);
+			}
+
 			break;
 		}
-	}
 
-	socket_cmd.state = socket_state_sending;
+		case(background_source_sensor):
+		{
+			if(i2c_sensor_sample())
+			{
+				stat_update_sensor++;
+				return(true);
+			}
 
-	if(!socket_send(&socket_cmd.socket, &socket_cmd.send_buffer))
-	{
-		stat_cmd_send_buffer_overflow++;
-		socket_cmd.state = socket_state_idle;
-		return(false);
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
 	}
 
-	return(true);
+	return(false);
 }
 
-attr_speed iram static void background_task(os_event_t *events) // posted every ~100 ms = ~10 Hz
+attr_speed iram static void background_task_idle(void)
 {
-	stat_slow_timer++;
 	config_wlan_mode_t wlan_mode;
 	int wlan_mode_int;
 	string_init(varname_wlan_mode, "wlan.mode");
 
+	// fallback to config-ap-mode when not connected or no ip within 30 seconds
+
+	if((wifi_station_get_connect_status() != STATION_GOT_IP) && (stat_update_idle == 300))
+	{
+		if(config_get_int(&varname_wlan_mode, -1, -1, &wlan_mode_int))
+			wlan_mode = (config_wlan_mode_t)wlan_mode_int;
+		else
+			wlan_mode = config_wlan_mode_client;
+
+		if(wlan_mode == config_wlan_mode_client)
+		{
+			wlan_mode_int = (int)config_wlan_mode_ap;
+			config_set_int(&varname_wlan_mode, -1, -1, wlan_mode_int);
+			config_get_int(&varname_wlan_mode, -1, -1, &wlan_mode_int);
+			wlan_init();
+		}
+	}
+
+	stat_update_idle++;
+}
+
+attr_speed iram static void background_task(os_event_t *event) // woken by events and every ~100 ms = ~10 Hz
+{
+	unsigned int ix;
+	background_source_t source;
+	uint32_t now;
+
+	background_scheduler.posted = false;
+
 	switch(reset_state)
 	{
 		case(reset_state_request_tcp_disconnect):
@@ -283,75 +1035,60 @@ attr_speed iram static void background_task(os_event_t *events) // posted every
 		default: break;
 	}
 
-	if(uart_bridge_active && background_task_bridge_uart())
-	{
-		stat_update_uart++;
-		system_os_post(background_task_id, 0, 0);
-		return;
-	}
-
-	if(background_task_longop_handler())
-	{
-		stat_update_longop++;
-		system_os_post(background_task_id, 0, 0);
-		return;
-	}
+	// the tick polls all sources, for those that have no event to wake them (display, longop)
 
-	if(background_task_command_handler())
+	if(event->sig == background_signal_tick)
 	{
-		if(socket_proto(&socket_cmd.socket) == proto_tcp)
-			stat_update_command_tcp++;
-		else
-			stat_update_command_udp++;
+		for(source = 0; source < background_source_size; source++)
+			background_source_ready(source);
 
-		system_os_post(background_task_id, 0, 0);
-		return;
+		background_task_idle();
 	}
 
-	if(display_periodic())
+	// one unit of work per invocation, round robin between ready sources
+
+	for(ix = 0; ix < background_source_size; ix++)
 	{
-		stat_update_display++;
-		system_os_post(background_task_id, 0, 0);
-		return;
-	}
+		source = (background_scheduler.next + ix) % background_source_size;
 
-	// fallback to config-ap-mode when not connected or no ip within 30 seconds
+		if(!background_scheduler.source[source].ready)
+			continue;
 
-	if((wifi_station_get_connect_status() != STATION_GOT_IP) && (stat_update_idle == 300))
-	{
-		if(config_get_int(&varname_wlan_mode, -1, -1, &wlan_mode_int))
-			wlan_mode = (config_wlan_mode_t)wlan_mode_int;
-		else
-			wlan_mode = config_wlan_mode_client;
+		background_scheduler.source[source].ready = 0;
+		now = system_get_time();
 
-		if(wlan_mode == config_wlan_mode_client)
+		if(background_task_run(source))
 		{
-			wlan_mode_int = (int)config_wlan_mode_ap;
-			config_set_int(&varname_wlan_mode, -1, -1, wlan_mode_int);
-			config_get_int(&varname_wlan_mode, -1, -1, &wlan_mode_int);
-			wlan_init();
+			stat_latency_record(&stat_background_latency[source], now - background_scheduler.source[source].since, 100);
+			background_scheduler.next = (source + 1) % background_source_size;
+			background_task_wake(source); // might have more work
+			return;
 		}
 	}
-
-	stat_update_idle++;
 }
 
 attr_speed iram static void fast_timer_callback(void *arg)
 {
+	uint32_t start;
+
 	stat_fast_timer++;
 
 	// timer runs every 10 ms = 100 Hz
 
+	start = system_get_time();
 	io_periodic();
+	stat_latency_record(&stat_fast_timer_duration, system_get_time() - start, 10);
 }
 
 attr_speed iram static void slow_timer_callback(void *arg)
 {
+	stat_slow_timer++;
+
 	// run background task every ~100 ms = ~10 Hz
 
 	time_periodic();
 
-	system_os_post(background_task_id, 0, 0);
+	system_os_post(background_task_id, background_signal_tick, 0);
 }
 
 void user_init(void);
@@ -371,18 +1108,26 @@ irom void user_init(void)
 	}
 
 	static char uart_send_queue_buffer[1024];
-	static char uart_receive_queue_buffer[1024];
+	static char uart_receive_queue_buffer[bridge_receive_queue_size];
 
 	int uart_baud, uart_data, uart_stop, uart_parity_int;
+	int uart_rx_threshold, uart_rx_timeout, uart_rx_adaptive;
 	uart_parity_t uart_parity;
 
 	string_init(varname_uart_baud, "uart.baud");
 	string_init(varname_uart_data, "uart.data");
 	string_init(varname_uart_stop, "uart.stop");
 	string_init(varname_uart_parity, "uart.parity");
+	string_init(varname_uart_rx_threshold, "uart.rx.threshold");
+	string_init(varname_uart_rx_timeout, "uart.rx.timeout");
+	string_init(varname_uart_rx_adaptive, "uart.rx.adaptive");
 
 	system_set_os_print(0);
 
+	// os timers in us resolution, for the timer pins, must be done before any timer is armed
+
+	system_timer_reinit();
+
 	queue_new(&uart_send_queue, sizeof(uart_send_queue_buffer), uart_send_queue_buffer);
 	queue_new(&uart_receive_queue, sizeof(uart_receive_queue_buffer), uart_receive_queue_buffer);
 
@@ -406,7 +1151,17 @@ irom void user_init(void)
 	else
 		uart_parity = parity_none;
 
+	if(!config_get_int(&varname_uart_rx_threshold, -1, -1, &uart_rx_threshold))
+		uart_rx_threshold = 16;
+
+	if(!config_get_int(&varname_uart_rx_timeout, -1, -1, &uart_rx_timeout))
+		uart_rx_timeout = 2;
+
+	if(!config_get_int(&varname_uart_rx_adaptive, -1, -1, &uart_rx_adaptive))
+		uart_rx_adaptive = 0;
+
 	uart_init(uart_baud, uart_data, uart_stop, uart_parity);
+	uart_rx_config(uart_rx_threshold, uart_rx_timeout, !!uart_rx_adaptive);
 
 	os_install_putc1(&logchar);
 	system_set_os_print(1);
@@ -479,14 +1234,12 @@ attr_speed iram static void callback_received_cmd(socket_t *socket, const string
 {
 	if(socket_cmd.state != socket_state_idle)
 	{
-		stat_cmd_receive_buffer_overflow++;
+		cmd_backlog_push(socket, buffer);
 		return;
 	}
 
 	socket_cmd.receive_buffer = *buffer;
-	socket_cmd.state = socket_state_received;
-
-	system_os_post(background_task_id, 0, 0);
+	cmd_start(&socket->remote);
 }
 
 iram static void callback_received_uart(socket_t *socket, const string_t *buffer, void *userdata)
@@ -501,6 +1254,15 @@ iram static void callback_received_uart(socket_t *socket, const string_t *buffer
 	strip_telnet = config_flags_get().flag.strip_telnet;
 	telnet_strip_state = ts_copy;
 
+	if(!strip_telnet)
+	{
+		if(queue_push_n(&uart_send_queue, string_buffer(buffer), length) < length)
+			stat_uart_receive_buffer_overflow++;
+
+		uart_start_transmit(!queue_empty(&uart_send_queue));
+		return;
+	}
+
 	for(current = 0; current < length; current++)
 	{
 		byte = string_at(buffer, current);
@@ -543,22 +1305,36 @@ attr_speed iram static void callback_sent_cmd(socket_t *socket, void *userdata)
 {
 	if(reset_state == reset_state_send_reply)
 	{
-		if(socket->remote.proto == proto_udp)
+		if(cmd_pipeline.remote.proto == proto_udp)
 			reset_state = reset_state_wait;
 		else
 			reset_state = reset_state_request_tcp_disconnect;
 	}
 
-	socket_cmd.state = socket_state_idle;
+	if(cmd_pipeline.pending)
+	{
+		cmd_pipeline.pending = false;
+		socket_cmd.state = socket_state_received;
+		background_task_wake(background_source_command);
+		return;
+	}
+
+	if(cmd_pipeline.close && (cmd_pipeline.remote.proto == proto_tcp))
+	{
+		cmd_disconnect_remote = cmd_pipeline.remote;
+		bg_action.disconnect = 1;
+		background_task_wake(background_source_longop);
+	}
+
+	cmd_idle();
 }
 
 attr_speed iram static void callback_sent_uart(socket_t *socket, void *userdata)
 {
-	if(!queue_empty(&uart_receive_queue))
-		system_os_post(background_task_id, 0, 0); // retry to send data still in the fifo
+	bridge_uart_release();
 
-	string_clear(&socket_uart.send_buffer);
-	socket_uart.state = socket_state_idle;
+	if(!queue_empty(&uart_receive_queue))
+		background_task_wake(background_source_bridge); // retry to send data still in the fifo
 }
 
 // error
@@ -568,13 +1344,15 @@ irom static void callback_error_cmd(socket_t *socket, int error, void *userdata)
 	if(reset_state != reset_state_inactive)
 		reset_state = reset_state_go;
 
-	socket_cmd.state = socket_state_idle;
+	// only abandon the current request if it's from the connection that failed
+
+	if((socket_cmd.state == socket_state_sending) && socket_remote_match(&socket->remote, &cmd_pipeline.remote))
+		cmd_idle();
 }
 
 irom static void callback_error_uart(socket_t *socket, int error, void *userdata)
 {
-	string_clear(&socket_uart.send_buffer);
-	socket_uart.state = socket_state_idle;
+	bridge_uart_release();
 }
 
 // disconnect
@@ -584,22 +1362,17 @@ irom static void callback_disconnect_cmd(socket_t *socket, void *userdata)
 	if((reset_state == reset_state_request_tcp_disconnect) || (reset_state == reset_state_wait_tcp_disconnect))
 		reset_state = reset_state_wait;
 
-	socket_cmd.state = socket_state_idle;
+	if((socket_cmd.state == socket_state_sending) && socket_remote_match(&socket->remote, &cmd_pipeline.remote))
+		cmd_idle();
 }
 
 irom static void callback_disconnect_uart(socket_t *socket, void *userdata)
 {
-	string_clear(&socket_uart.send_buffer);
-	socket_uart.state = socket_state_idle;
+	bridge_uart_release();
 }
 
 // accept
 
-irom static void callback_accept_cmd(socket_t *socket, void *userdata)
-{
-	socket_cmd.state = socket_state_idle;
-}
-
 irom static void callback_accept_uart(socket_t *socket, void *userdata)
 {
 	queue_flush(&uart_send_queue);
@@ -611,13 +1384,16 @@ irom static void callback_accept_uart(socket_t *socket, void *userdata)
 
 irom static void user_init2(void)
 {
-	int uart_port, uart_timeout;
-	int cmd_port, cmd_timeout;
+	int uart_port, uart_timeout, uart_coalesce_bytes, uart_coalesce_time;
+	int cmd_port, cmd_timeout, cmd_clients;
 
 	string_init(varname_bridge_port, "bridge.port");
 	string_init(varname_bridge_timeout, "bridge.timeout");
+	string_init(varname_bridge_coalesce_bytes, "bridge.coalesce.bytes");
+	string_init(varname_bridge_coalesce_time, "bridge.coalesce.time");
 	string_init(varname_cmd_port, "cmd.port");
 	string_init(varname_cmd_timeout, "cmd.timeout");
+	string_init(varname_cmd_clients, "cmd.clients");
 
 	if(!config_get_int(&varname_bridge_port, -1, -1, &uart_port))
 		uart_port = 0;
@@ -625,12 +1401,24 @@ irom static void user_init2(void)
 	if(!config_get_int(&varname_bridge_timeout, -1, -1, &uart_timeout))
 		uart_timeout = 90;
 
+	if(!config_get_int(&varname_bridge_coalesce_bytes, -1, -1, &uart_coalesce_bytes) || (uart_coalesce_bytes < 0))
+		uart_coalesce_bytes = 0;
+
+	if(!config_get_int(&varname_bridge_coalesce_time, -1, -1, &uart_coalesce_time) || (uart_coalesce_time < 0))
+		uart_coalesce_time = 0;
+
+	bridge_coalesce.bytes = uart_coalesce_bytes;
+	bridge_coalesce.time = uart_coalesce_time;
+
 	if(!config_get_int(&varname_cmd_port, -1, -1, &cmd_port))
 		cmd_port = 24;
 
 	if(!config_get_int(&varname_cmd_timeout, -1, -1, &cmd_timeout))
 		cmd_timeout = 90;
 
+	if(!config_get_int(&varname_cmd_clients, -1, -1, &cmd_clients))
+		cmd_clients = 3;
+
 	if(config_flags_get().flag.cpu_high_speed)
 		system_update_cpu_freq(160);
 	else
@@ -642,14 +1430,17 @@ irom static void user_init2(void)
 	time_init();
 	io_init();
 
-	socket_create(true, true, &socket_cmd.socket, cmd_port, cmd_timeout,
-			callback_received_cmd, callback_sent_cmd, callback_error_cmd, callback_disconnect_cmd, callback_accept_cmd, (void *)&socket_cmd);
+	queue_new(&cmd_backlog, sizeof(_socket_cmd_backlog_buffer), _socket_cmd_backlog_buffer);
+
+	socket_create(true, true, &socket_cmd.socket, cmd_port, cmd_timeout, cmd_clients,
+			callback_received_cmd, callback_sent_cmd, callback_error_cmd, callback_disconnect_cmd, (void *)0, (void *)&socket_cmd);
 
 	if(uart_port > 0)
 	{
-		socket_create(true, true, &socket_uart.socket, uart_port, uart_timeout,
+		socket_create(true, true, &socket_uart.socket, uart_port, uart_timeout, 1,
 				callback_received_uart, callback_sent_uart, callback_error_uart, callback_disconnect_uart, callback_accept_uart, (void *)&socket_uart);
 
+		os_timer_setfn(&bridge_coalesce.timer, bridge_coalesce_timer_callback, (void *)0);
 		uart_bridge_active = true;
 	}
 
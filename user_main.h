@@ -12,11 +12,42 @@ enum
 {
 	background_task_id				= USER_TASK_PRIO_0,
 	background_task_queue_length	= 64,
+	background_signal_wake			= 0,
+	background_signal_tick			= 1,
+	bridge_send_size_max			= 1460,	// one tcp segment
+	bridge_receive_queue_size		= 4096,
 };
 
+typedef enum
+{
+	background_source_bridge,
+	background_source_longop,
+	background_source_command,
+	background_source_display,
+	background_source_sensor,
+	background_source_size,
+} background_source_t;
+
+_Static_assert(sizeof(background_source_t) == 4, "sizeof(background_source_t) != 4");
+
 extern queue_t uart_send_queue;
 extern queue_t uart_receive_queue;
 extern os_event_t background_task_queue[background_task_queue_length];
 
+/*
+ * Time in us that the bridge should still hold back length bytes that
+ * have been waiting for waited us, given the coalesce thresholds; 0 means
+ * send now. Thresholds of 0 disable holding back.
+ */
+
+always_inline static attr_const unsigned int bridge_coalesce_wait(unsigned int length, unsigned int waited, unsigned int bytes, unsigned int time)
+{
+	if((time == 0) || (length >= bytes) || (waited >= time))
+		return(0);
+
+	return(time - waited);
+}
+
 bool_t wlan_init(void);
+void background_task_wake(background_source_t source);
 #endif
@@ -142,7 +142,7 @@ irom int log(const char *fmt, ...)
 	va_list ap;
 	int current, n;
 
-	if(ota_is_active() || config_uses_logbuffer())
+	if(ota_is_active())
 		return(0);
 
 	va_start(ap, fmt);
@@ -164,7 +164,7 @@ irom int log(const char *fmt, ...)
 
 attr_speed iram void logchar(char c)
 {
-	if(ota_is_active() || config_uses_logbuffer())
+	if(ota_is_active())
 		return;
 
 	if(flags_cache.flag.log_to_uart)
@@ -219,12 +219,66 @@ irom attr_pure ip_addr_t ip_addr(const char *src)
 	return(ip_addr_to_bytes.ip_addr);
 }
 
+static const parse_args_t *parse_args_current = (parse_args_t *)0;
+
+irom void parse_args_bind(parse_args_t *args, const string_t *src, char delimiter)
+{
+	int offset;
+
+	args->src = src;
+	args->previous = parse_args_current;
+	args->delimiter = delimiter;
+	args->truncated = false;
+	args->offset[0] = 0;
+	args->count = 1;
+
+	for(offset = 0; (offset < src->size) && (offset < src->length); offset++)
+	{
+		if(string_at(src, offset) != delimiter)
+			continue;
+
+		if(args->count >= parse_args_size)
+		{
+			args->truncated = true;
+			break;
+		}
+
+		args->offset[args->count++] = offset + 1;
+	}
+
+	parse_args_current = args;
+}
+
+irom void parse_args_unbind(const parse_args_t *args)
+{
+	parse_args_current = args->previous;
+}
+
+irom int parse_offset(int index, const string_t *src, char delimiter)
+{
+	const parse_args_t *args = parse_args_current;
+	int offset;
+
+	if(!args || (args->src != src) || (args->delimiter != delimiter) || (index < 0) || ((index >= args->count) && args->truncated))
+		return(string_sep(src, 0, index, delimiter));
+
+	if(index >= args->count)
+		return(-1);
+
+	offset = args->offset[index];
+
+	if((offset >= src->size) || (offset >= src->length))
+		return(-1);
+
+	return(offset);
+}
+
 irom parse_error_t parse_string(int index, const string_t *src, string_t *dst, char delimiter)
 {
 	uint8_t current;
 	int offset;
 
-	if((offset = string_sep(src, 0, index, delimiter)) < 0)
+	if((offset = parse_offset(index, src, delimiter)) < 0)
 		return(parse_out_of_range);
 
 	for(; offset < src->length; offset++)
@@ -252,7 +306,7 @@ irom parse_error_t parse_int(int index, const string_t *src, int *dst, int base,
 	value = 0;
 	valid = false;
 
-	if((offset = string_sep(src, 0, index, delimiter)) < 0)
+	if((offset = parse_offset(index, src, delimiter)) < 0)
 		return(parse_out_of_range);
 
 	if(base == 0)
@@ -322,13 +376,13 @@ irom parse_error_t parse_int(int index, const string_t *src, int *dst, int base,
 	return(parse_ok);
 }
 
-irom parse_error_t parse_float(int index, const string_t *src, double *dst, char delimiter)
+irom parse_error_t parse_milli(int index, const string_t *src, int *dst, char delimiter)
 {
 	int offset;
 	int decimal;
 	bool_t negative;
 	bool_t valid;
-	double result;
+	int result;
 	char current;
 
 	valid = false;
@@ -337,7 +391,7 @@ irom parse_error_t parse_float(int index, const string_t *src, double *dst, char
 	result = 0;
 	decimal = 0;
 
-	if((offset = string_sep(src, 0, index, delimiter)) < 0)
+	if((offset = parse_offset(index, src, delimiter)) < 0)
 		return(parse_out_of_range);
 
 	if((offset < src->length) && (string_at(src, offset) == '-'))
@@ -353,7 +407,7 @@ irom parse_error_t parse_float(int index, const string_t *src, double *dst, char
 		if((current == '.') || (current == ','))
 		{
 			if(decimal == 0)
-				decimal = 1;
+				decimal = 1000;
 			else
 				break;
 		}
@@ -369,13 +423,20 @@ irom parse_error_t parse_float(int index, const string_t *src, double *dst, char
 
 				if(decimal > 0)
 				{
-					decimal *= 10;
-					result += (double)(current - '0') / (double)decimal;
+					decimal /= 10;
+
+					if(result > (0x7fffffff - ((current - '0') * decimal)))
+						return(parse_out_of_range);
+
+					result += (current - '0') * decimal;
 				}
 				else
 				{
+					if(result > ((0x7fffffff - ((current - '0') * 1000)) / 10))
+						return(parse_out_of_range);
+
 					result *= 10;
-					result += (double)(current - '0');
+					result += (current - '0') * 1000;
 				}
 			}
 		}
@@ -550,11 +611,67 @@ irom void string_mac(string_t *dst, uint8 addr[6])
 		mac_addr_to_bytes.byte[5]);
 }
 
-irom int string_double(string_t *dst, double value, int precision, double top_decimal)
+static const char string_digit_pairs[200] =
 {
-	double compare;
-	int decimal;
-	bool_t skip_leading_zeroes;
+	'0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+	'1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+	'2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+	'3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+	'4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+	'5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+	'6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+	'7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+	'8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+	'9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9',
+};
+
+/*
+ * Convert two digits per division, the lx106 has no hardware divider,
+ * so this halves the number of (library) divisions compared to one
+ * digit at a time.
+ */
+
+irom static void string_append_decimal(string_t *dst, unsigned int value, int min_digits)
+{
+	char buffer[12];
+	int position, pair;
+
+	position = sizeof(buffer);
+
+	while(value >= 100)
+	{
+		pair = (value % 100) * 2;
+		value /= 100;
+
+		buffer[--position] = string_digit_pairs[pair + 1];
+		buffer[--position] = string_digit_pairs[pair + 0];
+	}
+
+	if(value >= 10)
+	{
+		buffer[--position] = string_digit_pairs[(value * 2) + 1];
+		buffer[--position] = string_digit_pairs[(value * 2) + 0];
+	}
+	else
+		buffer[--position] = (char)('0' + value);
+
+	while((((int)sizeof(buffer) - position) < min_digits) && (position > 0))
+		buffer[--position] = '0';
+
+	for(; position < (int)sizeof(buffer); position++)
+		string_append_char(dst, buffer[position]);
+}
+
+/*
+ * Format a fixed point value in 1/1000 units with "precision" decimals
+ * (at most 3, truncated, not rounded). If the value exceeds
+ * 10 * top_decimal, "+++" is printed instead.
+ */
+
+irom int string_milli(string_t *dst, int value, int precision, unsigned int top_decimal)
+{
+	static const unsigned int divisor[4] = { 1000, 100, 10, 1 };
+	unsigned int magnitude, integer;
 	int original_length;
 
 	original_length = dst->length;
@@ -562,12 +679,14 @@ irom int string_double(string_t *dst, double value, int precision, double top_de
 	if(value < 0)
 	{
 		string_append_char(dst, '-');
-		value = 0 - value;
+		magnitude = 0U - (unsigned int)value;
 	}
+	else
+		magnitude = (unsigned int)value;
 
-	skip_leading_zeroes = true;
+	integer = magnitude / 1000;
 
-	if(value > (10 * top_decimal))
+	if(((integer / 10) > top_decimal) || (((integer / 10) == top_decimal) && ((integer % 10) || (magnitude % 1000))))
 	{
 		string_append_char(dst, '+');
 		string_append_char(dst, '+');
@@ -576,42 +695,17 @@ irom int string_double(string_t *dst, double value, int precision, double top_de
 		return(dst->length - original_length);
 	}
 
-	for(compare = top_decimal; compare > 0; compare /= 10)
-	{
-		if(value >= compare)
-		{
-			skip_leading_zeroes = false;
-
-			decimal = (unsigned int)(value / compare);
-			value -= decimal * compare;
-
-			string_append_char(dst, (char)(decimal + '0'));
-		}
-		else
-			if(!skip_leading_zeroes)
-				string_append_char(dst, '0');
-
-		if((compare <= 1) && (precision == 0))
-			break;
-
-		if((unsigned int)compare == 1)
-		{
-			if(skip_leading_zeroes)
-			{
-				string_append_char(dst, '0');
-				skip_leading_zeroes = false;
-			}
+	string_append_decimal(dst, integer, 1);
 
-			string_append_char(dst, '.');
-		}
+	if(precision > 3)
+		precision = 3;
 
-		if((compare <= 1) && (precision > 0))
-			--precision;
+	if(precision > 0)
+	{
+		string_append_char(dst, '.');
+		string_append_decimal(dst, (magnitude % 1000) / divisor[precision], precision);
 	}
 
-	if(dst->length == original_length)
-		string_append_char(dst, '0');
-
 	return(dst->length - original_length);
 }
 
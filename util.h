@@ -160,7 +160,7 @@ void string_trim_nl(string_t *dst);
 void string_bin_to_hex(string_t *dst, const char *src, int length);
 void string_ip(string_t *dst, ip_addr_t);
 void string_mac(string_t *dst, uint8 mac_addr[6]);
-int string_double(string_t *dst, double value, int precision, double top_decimal);
+int string_milli(string_t *dst, int value, int precision, unsigned int top_decimal);
 void string_crc32_init(void);
 uint32_t string_crc32(const string_t *src, int offset, int length);
 
@@ -325,7 +325,32 @@ always_inline static void string_append_string(string_t *dst, const string_t *sr
 	dst->length += length;
 }
 
+/*
+ * A command line can be split into arguments once, before running the
+ * handler, after which parse_*() on the same string and delimiter looks
+ * up the argument offset instead of rescanning the line from the start.
+ * Parsing any other string falls back to scanning.
+ */
+
+enum
+{
+	parse_args_size = 32,
+};
+
+typedef struct parse_args_T
+{
+	const string_t			*src;
+	const struct parse_args_T	*previous;
+	char					delimiter;
+	bool_t					truncated;
+	int						count;
+	uint16_t				offset[parse_args_size];
+} parse_args_t;
+
+void parse_args_bind(parse_args_t *args, const string_t *src, char delim);
+void parse_args_unbind(const parse_args_t *args);
+int parse_offset(int index, const string_t *src, char delim);
 parse_error_t parse_string(int index, const string_t *in, string_t *out, char delim);
 parse_error_t parse_int(int index, const string_t *src, int *dst, int base, char delim);
-parse_error_t parse_float(int index, const string_t *, double *, char delim);
+parse_error_t parse_milli(int index, const string_t *, int *, char delim);
 #endif